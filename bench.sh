@@ -0,0 +1,42 @@
+#!/bin/bash
+# Boots the kernel headless with "bench" on its command line, collects
+# the JSON lines it writes to serial into build/bench.jsonl and turns
+# the isa-debug-exit status back into a normal exit code.
+
+QEMU=${QEMU:-qemu-system-i386}
+TIMEOUT=${BENCH_TIMEOUT:-120}
+OUT=build/bench.jsonl
+LOG=build/bench.log
+
+if [ ! -f build/toyos.elf ]; then
+    echo "Error: build/toyos.elf not found"
+    echo "Run make first"
+    exit 1
+fi
+
+echo "Running benchmarks in QEMU (timeout ${TIMEOUT}s)..."
+
+timeout "$TIMEOUT" $QEMU \
+    -smp 1 \
+    -kernel build/toyos.elf \
+    -append bench \
+    -display none \
+    -serial stdio \
+    -device isa-debug-exit,iobase=0xf4,iosize=0x04 \
+    -no-reboot > "$LOG"
+status=$?
+
+tr -d '\r' < "$LOG" | grep '^{' > "$OUT"
+
+# The kernel writes 0 to the port on success; QEMU reports (0 << 1) | 1
+if [ $status -eq 124 ]; then
+    echo "Error: timed out, serial output in $LOG"
+    exit 1
+elif [ $status -ne 1 ]; then
+    echo "Error: QEMU exited with status $status, serial output in $LOG"
+    exit 1
+fi
+
+grep '"bench"' "$OUT" | sed -e 's/[{}"]//g' -e 's/,/  /g'
+grep '"boot":"total"' "$OUT" | sed -e 's/[{}"]//g' -e 's/,/  /g'
+echo "Results: $OUT"
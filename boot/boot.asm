@@ -25,8 +25,8 @@ extern kernel_main
 _start:
     mov esp, stack_top
     
-    push eax
     push ebx
+    push eax
     
     call kernel_main
     
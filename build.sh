@@ -8,7 +8,11 @@ mkdir -p build
 
 echo "[1/4] Building Rust module..."
 cd rust_module
-cargo build --release --target i686-unknown-linux-gnu
+if [ "$PROFILE" = "1" ]; then
+    RUSTFLAGS="-C force-frame-pointers=yes" cargo build --release --target i686-toyos.json -Z build-std=core,compiler_builtins
+else
+    cargo build --release --target i686-toyos.json -Z build-std=core,compiler_builtins
+fi
 cd ..
 
 echo "[2/4] Assembling bootloader..."
@@ -18,8 +22,17 @@ nasm -f elf32 kernel/idt_load.asm -o build/idt_load.o
 nasm -f elf32 kernel/interrupt.asm -o build/interrupt.o
 nasm -f elf32 kernel/asm_utils.asm -o build/asm_utils.o
 nasm -f elf32 kernel/paging_asm.asm -o build/paging_asm.o
+nasm -f elf32 kernel/task_switch.asm -o build/task_switch.o
+nasm -f elf32 kernel/syscall.asm -o build/syscall_asm.o
+nasm -f elf32 kernel/smp_trampoline.asm -o build/smp_trampoline.o
 
-CFLAGS="-m32 -ffreestanding -nostdlib -fno-pie -fno-stack-protector -Wall -O2"
+CFLAGS="-m32 -ffreestanding -nostdlib -fno-pie -fno-stack-protector -mgeneral-regs-only -Wall -O2"
+if [ "$RELEASE" = "1" ]; then
+    CFLAGS="$CFLAGS -DLOG_NO_DEBUG"
+fi
+if [ "$PROFILE" = "1" ]; then
+    CFLAGS="$CFLAGS -fno-omit-frame-pointer"
+fi
 
 echo "[3/4] Compiling kernel..."
 gcc $CFLAGS -c kernel/kernel.c        -o build/kernel.o
@@ -38,11 +51,38 @@ gcc $CFLAGS -c kernel/task.c          -o build/task.o
 gcc $CFLAGS -c kernel/heap.c          -o build/heap.o
 gcc $CFLAGS -c kernel/power.c         -o build/power.o
 gcc $CFLAGS -c kernel/cursor.c        -o build/cursor.o
+gcc $CFLAGS -c kernel/ipc.c           -o build/ipc.o
+gcc $CFLAGS -c kernel/ring.c          -o build/ring.o
+gcc $CFLAGS -c kernel/syscall.c       -o build/syscall.o
+gcc $CFLAGS -c kernel/futex.c         -o build/futex.o
+gcc $CFLAGS -c kernel/shm.c           -o build/shm.o
+gcc $CFLAGS -c kernel/trace.c         -o build/trace.o
+gcc $CFLAGS -c kernel/shell_stats.c   -o build/shell_stats.o
+gcc $CFLAGS -c kernel/ksyms.c         -o build/ksyms.o
+gcc $CFLAGS -c kernel/profile.c       -o build/profile.o
+gcc $CFLAGS -c kernel/cpu.c           -o build/cpu.o
+gcc $CFLAGS -c kernel/fpu.c           -o build/fpu.o
+gcc $CFLAGS -c kernel/acpi.c          -o build/acpi.o
+gcc $CFLAGS -c kernel/apic.c          -o build/apic.o
+gcc $CFLAGS -c kernel/smp.c           -o build/smp.o
+gcc $CFLAGS -c kernel/lock.c          -o build/lock.o
+gcc $CFLAGS -c kernel/elf.c           -o build/elf.o
+gcc $CFLAGS -c kernel/user.c          -o build/user.o
+gcc $CFLAGS -c kernel/bench.c         -o build/bench.o
+gcc $CFLAGS -c kernel/bench_suite.c   -o build/bench_suite.o
+gcc $CFLAGS -c kernel/boottime.c      -o build/boottime.o
+gcc $CFLAGS -c kernel/format.c        -o build/format.o
 
 echo "[4/4] Compiling C++ driver..."
-CXXFLAGS="-m32 -ffreestanding -nostdlib -fno-pie -fno-stack-protector -fno-exceptions -fno-rtti -Wall -O2"
+CXXFLAGS="-m32 -ffreestanding -nostdlib -fno-pie -fno-stack-protector -mgeneral-regs-only -fno-exceptions -fno-rtti -Wall -O2"
+if [ "$RELEASE" = "1" ]; then
+    CXXFLAGS="$CXXFLAGS -DLOG_NO_DEBUG"
+fi
+if [ "$PROFILE" = "1" ]; then
+    CXXFLAGS="$CXXFLAGS -fno-omit-frame-pointer"
+fi
 g++ $CXXFLAGS -c driver/driver.cpp    -o build/driver.o
-g++ $CXXFLAGS -c driver/logger.cpp    -o build/logger.o
+g++ $CXXFLAGS -c driver/logger.cpp  -I kernel/ -o build/logger.o
 gcc $CFLAGS   -c driver/keyboard.c  -I kernel/ -o build/keyboard.o
 
 echo "Linking..."
@@ -50,25 +90,30 @@ GCC_LIB_PATH=$(dirname $(gcc -m32 -print-libgcc-file-name) 2>/dev/null || echo "
 
 OBJS="build/boot.o \
     build/gdt_flush.o build/idt_load.o build/interrupt.o \
-    build/asm_utils.o build/paging_asm.o \
+    build/asm_utils.o build/paging_asm.o build/task_switch.o build/syscall_asm.o build/smp_trampoline.o \
     build/kernel.o build/memory_funcs.o build/string.o \
     build/gdt.o build/idt.o build/pic.o build/timer.o \
     build/serial.o build/paging.o build/interrupt_handlers.o \
     build/irq.o build/shell.o build/task.o build/heap.o \
-    build/power.o build/cursor.o \
+    build/power.o build/cursor.o build/ipc.o build/ring.o \
+    build/syscall.o build/futex.o build/shm.o build/trace.o build/shell_stats.o \
+    build/ksyms.o build/profile.o build/cpu.o build/fpu.o \
+    build/acpi.o build/apic.o build/smp.o build/lock.o build/elf.o build/user.o \
+    build/bench.o build/bench_suite.o build/boottime.o build/format.o \
     build/driver.o build/logger.o build/keyboard.o"
 
+LIBS="rust_module/target/i686-toyos/release/librust_module.a"
 if [ -n "$GCC_LIB_PATH" ] && [ -f "$GCC_LIB_PATH/libgcc.a" ]; then
-    ld -m elf_i386 -T kernel/linker.ld -o build/toyos.elf \
-        $OBJS \
-        rust_module/target/i686-unknown-linux-gnu/release/librust_module.a \
-        -L"$GCC_LIB_PATH" -lgcc
-else
-    ld -m elf_i386 -T kernel/linker.ld -o build/toyos.elf \
-        $OBJS \
-        rust_module/target/i686-unknown-linux-gnu/release/librust_module.a
+    LIBS="$LIBS -L$GCC_LIB_PATH -lgcc"
 fi
 
+# Link once without a symbol table, generate it from that image and link
+# again. The table only adds data, so text addresses do not move.
+ld -m elf_i386 -T kernel/linker.ld -o build/toyos-nosyms.elf $OBJS $LIBS
+bash gen_ksyms.sh build/toyos-nosyms.elf > build/ksyms_table.c
+gcc $CFLAGS -I kernel -c build/ksyms_table.c -o build/ksyms_table.o
+ld -m elf_i386 -T kernel/linker.ld -o build/toyos.elf $OBJS build/ksyms_table.o $LIBS
+
 echo "Build complete: build/toyos.elf"
 echo ""
-echo "Run with: qemu-system-i386 -kernel build/toyos.elf"
+echo "Run with: qemu-system-i386 -smp 4 -kernel build/toyos.elf"
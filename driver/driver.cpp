@@ -85,9 +85,12 @@ public:
     }
 
     void writeStringAt(const char* str, unsigned int x, unsigned int y) {
-        if (!initialized) return;
-        while (*str && x < VGA_WIDTH) {
-            writeAt(*str++, x++, y);
+        if (!initialized || x >= VGA_WIDTH || y >= VGA_HEIGHT) return;
+        unsigned short* cell = &buffer[y * VGA_WIDTH + x];
+        unsigned short* end = &buffer[(y + 1) * VGA_WIDTH];
+        const unsigned short attr = (unsigned short)color << 8;
+        while (*str && cell < end) {
+            *cell++ = attr | (unsigned char)*str++;
         }
     }
 
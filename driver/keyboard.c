@@ -1,14 +1,24 @@
 #include "port.h"
+#include "ring.h"
+#include "keyboard.h"
+#include "irq.h"
 #include <stdint.h>
 #include <stdbool.h>
-
-extern void terminal_putchar(char c);
+#include <stddef.h>
 
 #define KEYBOARD_DATA_PORT 0x60
 #define KEY_RELEASE_MASK   0x80
 #define SCANCODE_SHIFT_L   0x2A
 #define SCANCODE_SHIFT_R   0x36
 #define SCANCODE_CAPS_LOCK 0x3A
+#define SCANCODE_KP_ENTER  0x1C
+#define SCANCODE_KP_SLASH  0x35
+#define SCANCODE_EXTENDED  0xE0
+#define SCANCODE_PAUSE     0xE1
+#define SCANCODE_ACK       0xFA
+#define SCANCODE_RESEND    0xFE
+#define SCANCODE_ERROR     0xFF
+#define KEYBOARD_BUFFER_SIZE 128
 
 static const char scancode_table_normal[] = {
     0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
@@ -26,8 +36,16 @@ static const char scancode_table_shifted[] = {
     '*', 0, ' '
 };
 
+/* Decoder state; only touched in task context */
 static bool shift_active = false;
 static bool caps_lock_on = false;
+static bool extended_pending = false;
+static uint8_t pause_skip = 0;
+static uint32_t keys_down[256 / 32];
+
+/* The IRQ handler only moves raw scancodes into this ring */
+static ring_t scancode_ring;
+static uint8_t scancode_storage[RING_STORAGE_SIZE(KEYBOARD_BUFFER_SIZE, sizeof(uint8_t))];
 
 static char apply_case(char c) {
     if (c < 'a' || c > 'z') return c;
@@ -39,38 +57,135 @@ static char resolve_char(uint8_t scancode) {
 
     if (shift_active) {
         char c = scancode_table_shifted[scancode];
-        if (c >= 'A' && c <= 'Z') return apply_case(c - 32);
+        if (c >= 'A' && c <= 'Z') return apply_case(c + 32);
         return c;
     }
 
     return apply_case(scancode_table_normal[scancode]);
 }
 
+static char resolve_extended(uint8_t scancode) {
+    switch (scancode) {
+        case SCANCODE_KP_ENTER: return '\n';
+        case SCANCODE_KP_SLASH: return '/';
+        default: return 0;
+    }
+}
+
+static bool key_is_down(uint8_t code) {
+    return (keys_down[code >> 5] & (1u << (code & 31))) != 0;
+}
+
+/* Record the key as held; returns true if it already was (typematic repeat) */
+static bool mark_key(uint8_t code, bool released) {
+    bool was_down = key_is_down(code);
+    if (released) {
+        keys_down[code >> 5] &= ~(1u << (code & 31));
+    } else {
+        keys_down[code >> 5] |= 1u << (code & 31);
+    }
+    return was_down && !released;
+}
+
 void keyboard_handler(void) {
     uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-    bool is_release = scancode & KEY_RELEASE_MASK;
+    ring_push(&scancode_ring, &scancode);
+}
+
+static void keyboard_irq(void* ctx) {
+    (void)ctx;
+    keyboard_handler();
+}
+
+/* Turn one scancode into an event. Returns false for prefixes and
+   controller responses that do not complete a key. */
+static bool decode_scancode(uint8_t scancode, key_event_t* event) {
+    if (pause_skip > 0) {
+        pause_skip--;
+        return false;
+    }
+
+    switch (scancode) {
+        case SCANCODE_EXTENDED:
+            extended_pending = true;
+            return false;
+        case SCANCODE_PAUSE:
+            /* Pause sends E1 1D 45 E1 9D C5 and has no release */
+            pause_skip = 5;
+            event->code = KEY_PAUSE;
+            event->ascii = 0;
+            event->flags = 0;
+            return true;
+        case SCANCODE_ACK:
+        case SCANCODE_RESEND:
+        case SCANCODE_ERROR:
+        case 0x00:
+            return false;
+    }
+
+    bool extended = extended_pending;
+    bool released = (scancode & KEY_RELEASE_MASK) != 0;
     uint8_t key = scancode & ~KEY_RELEASE_MASK;
+    extended_pending = false;
 
-    if (key == SCANCODE_SHIFT_L || key == SCANCODE_SHIFT_R) {
-        shift_active = !is_release;
-        return;
+    /* E0 2A / E0 AA are fake shifts some keyboards wrap around extended keys */
+    if (extended && (key == SCANCODE_SHIFT_L || key == SCANCODE_SHIFT_R)) {
+        return false;
     }
 
-    if (key == SCANCODE_CAPS_LOCK && !is_release) {
+    event->code = extended ? (key | KEY_EXTENDED) : key;
+    event->flags = released ? KEY_RELEASED : 0;
+    if (mark_key(event->code, released)) {
+        event->flags |= KEY_REPEAT;
+    }
+
+    if (!extended && (key == SCANCODE_SHIFT_L || key == SCANCODE_SHIFT_R)) {
+        shift_active = key_is_down(SCANCODE_SHIFT_L) || key_is_down(SCANCODE_SHIFT_R);
+    } else if (!extended && key == SCANCODE_CAPS_LOCK && event->flags == 0) {
         caps_lock_on = !caps_lock_on;
-        return;
     }
 
-    if (is_release) return;
+    if (released) {
+        event->ascii = 0;
+    } else {
+        event->ascii = extended ? resolve_extended(key) : resolve_char(key);
+    }
+    return true;
+}
+
+bool keyboard_read_key(key_event_t* event) {
+    uint8_t scancode;
+    while (ring_pop(&scancode_ring, &scancode)) {
+        if (decode_scancode(scancode, event)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    char c = resolve_char(key);
-    if (c != 0) {
-        extern void shell_handle_input(char);
-        shell_handle_input(c);
+bool keyboard_read_char(char* c) {
+    key_event_t event;
+    while (keyboard_read_key(&event)) {
+        if (!(event.flags & KEY_RELEASED) && event.ascii != 0) {
+            *c = event.ascii;
+            return true;
+        }
     }
+    return false;
+}
+
+bool keyboard_has_input(void) {
+    return ring_count(&scancode_ring) != 0;
 }
 
 void keyboard_init(void) {
     shift_active = false;
     caps_lock_on = false;
+    extended_pending = false;
+    pause_skip = 0;
+    for (uint32_t i = 0; i < sizeof(keys_down) / sizeof(keys_down[0]); i++) {
+        keys_down[i] = 0;
+    }
+    ring_init(&scancode_ring, scancode_storage, KEYBOARD_BUFFER_SIZE, sizeof(uint8_t), RING_SINGLE_PRODUCER);
+    irq_register(1, keyboard_irq, NULL);
 }
@@ -1,7 +1,38 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+/* key_event_t.code: set-1 make code, with KEY_EXTENDED for E0-prefixed keys */
+#define KEY_EXTENDED 0x80
+
+#define KEY_UP       (KEY_EXTENDED | 0x48)
+#define KEY_DOWN     (KEY_EXTENDED | 0x50)
+#define KEY_LEFT     (KEY_EXTENDED | 0x4B)
+#define KEY_RIGHT    (KEY_EXTENDED | 0x4D)
+#define KEY_HOME     (KEY_EXTENDED | 0x47)
+#define KEY_END      (KEY_EXTENDED | 0x4F)
+#define KEY_PAGEUP   (KEY_EXTENDED | 0x49)
+#define KEY_PAGEDOWN (KEY_EXTENDED | 0x51)
+#define KEY_INSERT   (KEY_EXTENDED | 0x52)
+#define KEY_DELETE   (KEY_EXTENDED | 0x53)
+#define KEY_PAUSE    0xFF
+
+/* key_event_t.flags */
+#define KEY_RELEASED 0x01
+#define KEY_REPEAT   0x02    /* make code for a key already held */
+
+typedef struct {
+    uint8_t code;
+    char ascii;    /* 0 if the key has no character */
+    uint8_t flags;
+} key_event_t;
+
 void keyboard_init(void);
 void keyboard_handler(void);
+bool keyboard_read_key(key_event_t* event);
+bool keyboard_read_char(char* c);
+bool keyboard_has_input(void);
 
 #endif
@@ -1,113 +1,136 @@
+#include "logger.h"
+#include "lock.h"
+
 extern "C" {
     void terminal_writestring(const char* s);
     void terminal_putchar(char c);
-    void terminal_setcolor(unsigned char color);
 }
 
+#define ANSI_INFO    "\x1b[96m"
+#define ANSI_WARNING "\x1b[93m"
+#define ANSI_ERROR   "\x1b[91m"
+#define ANSI_DEBUG   "\x1b[90m"
+#define ANSI_RESET   "\x1b[0m"
+
 inline void* operator new(unsigned int, void* p) { return p; }
 
-enum LogLevel {
-    LOG_INFO = 0,
-    LOG_WARNING = 1,
-    LOG_ERROR = 2,
-    LOG_DEBUG = 3
-};
+// One line at a time across all loggers and CPUs
+static spinlock_t log_lock = SPINLOCK_INIT;
 
 class Logger {
 private:
-    static const unsigned char COLOR_INFO = 0x0B;
-    static const unsigned char COLOR_WARNING = 0x0E;
-    static const unsigned char COLOR_ERROR = 0x0C;
-    static const unsigned char COLOR_DEBUG = 0x08;
-    
     const char* module_name;
-    bool enabled;
+    volatile uint8_t mask;
     
+    // Colors are sent as ANSI escapes; ESC[0m returns to whatever color
+    // the caller had set.
     void print_prefix(LogLevel level) {
-        terminal_putchar('[');
-        
         switch(level) {
             case LOG_INFO:
-                terminal_setcolor(COLOR_INFO);
-                terminal_writestring("INFO");
+                terminal_writestring("[" ANSI_INFO "INFO" ANSI_RESET "] ");
                 break;
             case LOG_WARNING:
-                terminal_setcolor(COLOR_WARNING);
-                terminal_writestring("WARN");
+                terminal_writestring("[" ANSI_WARNING "WARN" ANSI_RESET "] ");
                 break;
             case LOG_ERROR:
-                terminal_setcolor(COLOR_ERROR);
-                terminal_writestring("ERR ");
+                terminal_writestring("[" ANSI_ERROR "ERR " ANSI_RESET "] ");
                 break;
             case LOG_DEBUG:
-                terminal_setcolor(COLOR_DEBUG);
-                terminal_writestring("DBG ");
+                terminal_writestring("[" ANSI_DEBUG "DBG " ANSI_RESET "] ");
                 break;
         }
         
-        terminal_setcolor(0x07);
-        terminal_writestring("] ");
         terminal_writestring(module_name);
         terminal_writestring(": ");
     }
     
 public:
-    Logger(const char* name) : module_name(name), enabled(true) {}
+    Logger(const char* name) : module_name(name), mask(LOG_MASK_DEFAULT) {}
     
-    void info(const char* message) {
-        if(!enabled) return;
-        print_prefix(LOG_INFO);
+    // The compile-time check comes first, so a call at a level outside
+    // LOG_COMPILED_LEVELS folds away together with its message.
+    template<LogLevel L>
+    void log(const char* message) {
+        if (!LOG_LEVEL_COMPILED(L)) return;
+        if (!(mask & LOG_LEVEL_BIT(L))) return;
+        SpinLockGuard guard(log_lock);
+        print_prefix(L);
         terminal_writestring(message);
         terminal_putchar('\n');
     }
     
-    void warning(const char* message) {
-        if(!enabled) return;
-        print_prefix(LOG_WARNING);
-        terminal_writestring(message);
-        terminal_putchar('\n');
-    }
+    void info(const char* message) { log<LOG_INFO>(message); }
+    void warning(const char* message) { log<LOG_WARNING>(message); }
+    void error(const char* message) { log<LOG_ERROR>(message); }
+    void debug(const char* message) { log<LOG_DEBUG>(message); }
     
-    void error(const char* message) {
-        if(!enabled) return;
-        print_prefix(LOG_ERROR);
-        terminal_writestring(message);
-        terminal_putchar('\n');
+    void write(uint8_t level, const char* message) {
+        switch(level) {
+            case LOG_INFO: info(message); break;
+            case LOG_WARNING: warning(message); break;
+            case LOG_ERROR: error(message); break;
+            case LOG_DEBUG: debug(message); break;
+        }
     }
     
-    void debug(const char* message) {
-        if(!enabled) return;
-        print_prefix(LOG_DEBUG);
-        terminal_writestring(message);
-        terminal_putchar('\n');
-    }
+    uint8_t get_mask() { return mask; }
     
-    void set_enabled(bool enable) {
-        enabled = enable;
+    void set_mask(uint8_t new_mask) {
+        mask = new_mask & LOG_COMPILED_LEVELS;
     }
 };
 
-static char logger_buf[sizeof(Logger)];
-static Logger* system_logger = nullptr;
+// Global constructors are not run at boot, so loggers are placed into
+// static storage by cpp_logger_init().
+static char logger_buf[TRACE_MOD_COUNT][sizeof(Logger)] __attribute__((aligned(alignof(Logger))));
+static Logger* loggers[TRACE_MOD_COUNT];
+
+static Logger* logger_for(uint8_t module) {
+    return module < TRACE_MOD_COUNT ? loggers[module] : nullptr;
+}
 
 extern "C" void cpp_logger_init() {
-    system_logger = new (logger_buf) Logger("System");
+    spin_register(&log_lock, "log");
+    for (uint8_t m = 0; m < TRACE_MOD_COUNT; m++) {
+        loggers[m] = new (logger_buf[m]) Logger(trace_module_name(m));
+    }
+}
+
+extern "C" void log_write(uint8_t module, uint8_t level, const char* msg) {
+    Logger* logger = logger_for(module);
+    if(logger) {
+        logger->write(level, msg);
+    }
+}
+
+extern "C" uint8_t log_get_mask(uint8_t module) {
+    Logger* logger = logger_for(module);
+    return logger ? logger->get_mask() : 0;
+}
+
+extern "C" bool log_set_mask(uint8_t module, uint8_t mask) {
+    Logger* logger = logger_for(module);
+    if(!logger) {
+        return false;
+    }
+    logger->set_mask(mask);
+    return true;
 }
 
 extern "C" void cpp_log_info(const char* msg) {
-    if(system_logger) {
-        system_logger->info(msg);
+    if(loggers[TRACE_MOD_KERNEL]) {
+        loggers[TRACE_MOD_KERNEL]->info(msg);
     }
 }
 
 extern "C" void cpp_log_warning(const char* msg) {
-    if(system_logger) {
-        system_logger->warning(msg);
+    if(loggers[TRACE_MOD_KERNEL]) {
+        loggers[TRACE_MOD_KERNEL]->warning(msg);
     }
 }
 
 extern "C" void cpp_log_error(const char* msg) {
-    if(system_logger) {
-        system_logger->error(msg);
+    if(loggers[TRACE_MOD_KERNEL]) {
+        loggers[TRACE_MOD_KERNEL]->error(msg);
     }
 }
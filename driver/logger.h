@@ -0,0 +1,44 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Same numbering as trace_level_t */
+typedef enum {
+    LOG_INFO = 0,
+    LOG_WARNING = 1,
+    LOG_ERROR = 2,
+    LOG_DEBUG = 3,
+} LogLevel;
+
+#define LOG_MASK_ALL     0xF
+#define LOG_MASK_DEFAULT (LOG_LEVEL_BIT(LOG_INFO) | LOG_LEVEL_BIT(LOG_WARNING) | LOG_LEVEL_BIT(LOG_ERROR))
+
+void cpp_logger_init(void);
+void cpp_log_info(const char* msg);
+void cpp_log_warning(const char* msg);
+void cpp_log_error(const char* msg);
+
+/* One logger per trace module (TRACE_MOD_*), each with a runtime mask of
+   LOG_LEVEL_BIT()s. Levels outside LOG_COMPILED_LEVELS cannot be enabled. */
+void log_write(uint8_t module, uint8_t level, const char* msg);
+uint8_t log_get_mask(uint8_t module);
+bool log_set_mask(uint8_t module, uint8_t mask);
+
+#define KLOG(module, level, msg) \
+    do { \
+        if (LOG_LEVEL_COMPILED(level)) \
+            log_write(module, level, msg); \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Print a C table of the text symbols in a kernel ELF, sorted by address.
+# Usage: ./gen_ksyms.sh build/toyos-nosyms.elf > build/ksyms_table.c
+
+set -e
+
+NM=${NM:-nm}
+
+echo '#include "ksyms.h"'
+echo ''
+echo 'const ksym_t ksyms_table[] = {'
+# Names are demangled for C++ and Rust; ';' separates frames in folded
+# stack output, so it is replaced.
+$NM -n -C "$1" | awk '$2 ~ /^[tTwW]$/ && $1 !~ /^0+$/ {
+    name = substr($0, index($0, " " $2 " ") + 3)
+    gsub(/\\/, "\\\\", name)
+    gsub(/"/, "\\\"", name)
+    gsub(/;/, ":", name)
+    printf "    { 0x%s, \"%s\" },\n", $1, name
+}'
+echo '};'
+echo ''
+echo 'const uint32_t ksyms_count = sizeof(ksyms_table) / sizeof(ksyms_table[0]);'
@@ -0,0 +1,131 @@
+#include <stddef.h>
+#include "acpi.h"
+#include "string.h"
+
+#define EBDA_SEGMENT_PTR 0x40E
+#define BIOS_AREA_START  0xE0000
+#define BIOS_AREA_END    0x100000
+
+#define MADT_LOCAL_APIC      0
+#define MADT_LAPIC_ENABLED   0x01
+
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct {
+    acpi_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_local_apic_t;
+
+static bool checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+/* The RSDP sits on a 16-byte boundary */
+static const acpi_rsdp_t* scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        const acpi_rsdp_t* rsdp = (const acpi_rsdp_t*)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksum_ok(rsdp, sizeof(*rsdp))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+static const acpi_rsdp_t* find_rsdp(void) {
+    /* Real-mode segment of the EBDA, from the BIOS data area. Loaded in
+       asm: GCC treats pointers into page zero as invalid. */
+    uint16_t segment;
+    __asm__ volatile("movw (%1), %0" : "=r"(segment) : "r"(EBDA_SEGMENT_PTR));
+    uint32_t ebda = (uint32_t)segment << 4;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        const acpi_rsdp_t* rsdp = scan_rsdp(ebda, ebda + 1024);
+        if (rsdp) {
+            return rsdp;
+        }
+    }
+    return scan_rsdp(BIOS_AREA_START, BIOS_AREA_END);
+}
+
+static const acpi_header_t* find_table(const acpi_header_t* rsdt, const char* signature) {
+    uint32_t count = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+    const uint32_t* entries = (const uint32_t*)(rsdt + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        const acpi_header_t* table = (const acpi_header_t*)entries[i];
+        if (memcmp(table->signature, signature, 4) == 0 && checksum_ok(table, table->length)) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+bool acpi_parse_madt(acpi_madt_info_t* info) {
+    info->lapic_base = LAPIC_DEFAULT_BASE;
+    info->cpu_count = 0;
+
+    const acpi_rsdp_t* rsdp = find_rsdp();
+    if (!rsdp) {
+        return false;
+    }
+    const acpi_header_t* rsdt = (const acpi_header_t*)rsdp->rsdt_address;
+    if (memcmp(rsdt->signature, "RSDT", 4) != 0 || !checksum_ok(rsdt, rsdt->length)) {
+        return false;
+    }
+    const acpi_madt_t* madt = (const acpi_madt_t*)find_table(rsdt, "APIC");
+    if (!madt) {
+        return false;
+    }
+
+    info->lapic_base = madt->lapic_address;
+    const uint8_t* p = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (p + sizeof(madt_entry_t) <= end) {
+        const madt_entry_t* entry = (const madt_entry_t*)p;
+        if (entry->length < sizeof(madt_entry_t)) {
+            break;
+        }
+        if (entry->type == MADT_LOCAL_APIC && entry->length >= sizeof(madt_local_apic_t)) {
+            const madt_local_apic_t* lapic = (const madt_local_apic_t*)entry;
+            if ((lapic->flags & MADT_LAPIC_ENABLED) && info->cpu_count < MAX_CPUS) {
+                info->apic_ids[info->cpu_count++] = lapic->apic_id;
+            }
+        }
+        p += entry->length;
+    }
+    return info->cpu_count > 0;
+}
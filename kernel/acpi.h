@@ -0,0 +1,23 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "percpu.h"
+
+#define LAPIC_DEFAULT_BASE 0xFEE00000
+
+/* What the MADT says about the processors. Disabled entries are
+   skipped; at most MAX_CPUS are kept. */
+typedef struct {
+    uint32_t lapic_base;
+    uint32_t cpu_count;
+    uint8_t apic_ids[MAX_CPUS];
+} acpi_madt_info_t;
+
+/* Finds the RSDP in the EBDA or the BIOS area, follows the RSDT to the
+   MADT and fills info. Paging is off, so the tables are read in place.
+   Returns false if there is no valid MADT. */
+bool acpi_parse_madt(acpi_madt_info_t* info);
+
+#endif
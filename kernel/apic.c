@@ -0,0 +1,144 @@
+#include <stddef.h>
+#include "apic.h"
+#include "idt.h"
+#include "timer.h"
+#include "cpu.h"
+#include "percpu.h"
+
+#define LAPIC_ID         0x020
+#define LAPIC_TPR        0x080
+#define LAPIC_EOI        0x0B0
+#define LAPIC_SVR        0x0F0
+#define LAPIC_ICR_LOW    0x300
+#define LAPIC_ICR_HIGH   0x310
+#define LAPIC_LVT_TIMER  0x320
+#define LAPIC_LVT_LINT0  0x350
+#define LAPIC_LVT_LINT1  0x360
+#define LAPIC_LVT_ERROR  0x370
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR  0x390
+#define LAPIC_TIMER_DIV  0x3E0
+
+#define SVR_ENABLE        0x100
+#define LVT_MASKED        0x10000
+#define LVT_TIMER_PERIODIC 0x20000
+#define TIMER_DIV_16      0x3
+
+#define ICR_INIT          0x00000500
+#define ICR_STARTUP       0x00000600
+#define ICR_ASSERT        0x00004000
+#define ICR_PENDING       0x00001000
+
+#define CALIBRATE_US 10000
+
+extern void apic_vector48(void);
+extern void apic_vector49(void);
+extern void apic_vector63(void);
+
+static volatile uint32_t* lapic_base;
+static uint32_t timer_count;    /* initial count for LAPIC_TIMER_HZ */
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+void lapic_setup(uint32_t base) {
+    lapic_base = (volatile uint32_t*)base;
+    idt_set_gate(APIC_VECTOR_TIMER, (uint32_t)apic_vector48, 0x08, 0x8E);
+    idt_set_gate(APIC_VECTOR_RESCHED, (uint32_t)apic_vector49, 0x08, 0x8E);
+    idt_set_gate(APIC_VECTOR_SPURIOUS, (uint32_t)apic_vector63, 0x08, 0x8E);
+}
+
+bool lapic_present(void) {
+    return lapic_base != NULL;
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* Count LAPIC timer ticks (divide by 16) over a PIT one-shot. Runs on
+   the BSP with interrupts off; every CPU shares the bus clock, so the
+   APs reuse the result. */
+static uint32_t lapic_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+
+    timer_oneshot_start(CALIBRATE_US);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    while (!timer_oneshot_expired()) {
+        cpu_relax();
+    }
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    return elapsed * (1000000 / CALIBRATE_US) / LAPIC_TIMER_HZ;
+}
+
+void lapic_init(void) {
+    uint32_t flags = irq_save();
+
+    /* The BSP keeps the BIOS LINT0/LINT1 setup (ExtINT from the PIC,
+       NMI); APs take no legacy interrupts. */
+    if (this_cpu()->id != 0) {
+        lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+        lapic_write(LAPIC_LVT_LINT1, LVT_MASKED);
+    }
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_VECTOR_SPURIOUS);
+
+    if (timer_count == 0) {
+        timer_count = lapic_calibrate();
+    }
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_PERIODIC | APIC_VECTOR_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, timer_count);
+
+    irq_restore(flags);
+}
+
+/* ICR writes are two stores; keep them together on this CPU */
+static void lapic_send(uint32_t apic_id, uint32_t command) {
+    uint32_t flags = irq_save();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) {
+        cpu_relax();
+    }
+    irq_restore(flags);
+}
+
+void lapic_send_init(uint32_t apic_id) {
+    lapic_send(apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint32_t vector) {
+    lapic_send(apic_id, ICR_STARTUP | ICR_ASSERT | (vector & 0xFF));
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    lapic_send(apic_id, ICR_ASSERT | vector);
+}
+
+void apic_handler(uint32_t vector) {
+    switch (vector) {
+        case APIC_VECTOR_TIMER:
+            this_cpu()->ticks++;
+            break;
+        case APIC_VECTOR_RESCHED:
+            /* Nothing to do: the interrupt already ended the idle hlt */
+            break;
+        case APIC_VECTOR_SPURIOUS:
+            return;     /* no EOI for spurious vectors */
+    }
+    lapic_eoi();
+}
@@ -0,0 +1,34 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Vectors delivered by the local APIC, above the remapped PIC range */
+#define APIC_VECTOR_TIMER    48
+#define APIC_VECTOR_RESCHED  49
+#define APIC_VECTOR_SPURIOUS 63
+
+#define LAPIC_TIMER_HZ 100
+
+/* Records the MMIO base and installs the APIC vectors in the IDT. Called
+   once on the BSP before lapic_init(). */
+void lapic_setup(uint32_t base);
+bool lapic_present(void);
+
+/* Per-CPU: software-enables the local APIC and starts its periodic timer.
+   The first call (on the BSP) calibrates the timer against the PIT. */
+void lapic_init(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+
+/* Startup IPIs for an application processor; see smp.c for the timing */
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint32_t vector);
+/* Interrupts the CPU with the given APIC ID with vector */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/* Called by irq_handler() for vectors APIC_VECTOR_TIMER and up */
+void apic_handler(uint32_t vector);
+
+#endif
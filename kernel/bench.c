@@ -0,0 +1,159 @@
+#include <stddef.h>
+#include "bench.h"
+#include "cpu.h"
+#include "serial.h"
+#include "shell.h"
+#include "terminal.h"
+#include "power.h"
+#include "syscall.h"
+#include "smp.h"
+
+extern const bench_t _bench_start[];
+extern const bench_t _bench_end[];
+
+/* Only one benchmark runs at a time, so one sample buffer will do */
+static uint32_t samples[BENCH_MAX_ITERATIONS];
+static uint32_t timer_overhead;
+
+/* Shell sort: no recursion and no scratch space, fast enough for a few
+   thousand samples */
+static void sort_samples(uint32_t* values, uint32_t count) {
+    static const uint32_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (uint32_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        uint32_t gap = gaps[g];
+        for (uint32_t i = gap; i < count; i++) {
+            uint32_t value = values[i];
+            uint32_t j = i;
+            while (j >= gap && values[j - gap] > value) {
+                values[j] = values[j - gap];
+                j -= gap;
+            }
+            values[j] = value;
+        }
+    }
+}
+
+/* The cheapest back-to-back rdtsc pair; taken off every sample */
+static uint32_t measure_overhead(void) {
+    uint32_t best = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint64_t start = rdtsc();
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        if (cycles < best) best = cycles;
+    }
+    return best;
+}
+
+static bool name_matches(const char* name, const char* prefix) {
+    while (*prefix) {
+        if (*name++ != *prefix++) return false;
+    }
+    return true;
+}
+
+bool bench_run_one(const bench_t* bench, bench_result_t* result) {
+    uint32_t count = bench->iterations;
+    if (count == 0 || count > BENCH_MAX_ITERATIONS || !bench->run) {
+        return false;
+    }
+    if (timer_overhead == 0) {
+        timer_overhead = measure_overhead();
+    }
+
+    if (bench->setup) bench->setup();
+    for (uint32_t i = 0; i < BENCH_WARMUP; i++) {
+        bench->run();
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t start = rdtsc();
+        bench->run();
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        samples[i] = cycles > timer_overhead ? cycles - timer_overhead : 0;
+    }
+    if (bench->teardown) bench->teardown();
+
+    sort_samples(samples, count);
+    result->iterations = count;
+    result->min = samples[0];
+    result->median = samples[count / 2];
+    result->p99 = samples[(count * 99) / 100];
+    result->max = samples[count - 1];
+    return true;
+}
+
+static void json_field(const char* key, uint32_t value) {
+    serial_write(",\"");
+    serial_write(key);
+    serial_write("\":");
+    serial_write_dec(value);
+}
+
+/* One line per benchmark, e.g.
+   {"bench":"kmalloc_64","iters":4096,"min":41,"median":45,"p99":90,"max":2210,"unit":"cycles"} */
+static void report(const bench_t* bench, const bench_result_t* result) {
+    serial_write("{\"bench\":\"");
+    serial_write(bench->name);
+    serial_write("\"");
+    json_field("iters", result->iterations);
+    json_field("min", result->min);
+    json_field("median", result->median);
+    json_field("p99", result->p99);
+    json_field("max", result->max);
+    serial_write(",\"unit\":\"cycles\"}\n");
+
+    char buf[16];
+    terminal_writestring("  ");
+    terminal_writestring(bench->name);
+    terminal_writestring(": median ");
+    itoa_simple((int32_t)result->median, buf);
+    terminal_writestring(buf);
+    terminal_writestring(", p99 ");
+    itoa_simple((int32_t)result->p99, buf);
+    terminal_writestring(buf);
+    terminal_writestring(" cycles\n");
+}
+
+uint32_t bench_run_all(const char* filter) {
+    uint32_t run = 0;
+    bench_result_t result;
+
+    timer_overhead = measure_overhead();
+    serial_write("{\"suite\":\"start\"");
+    json_field("cpus", smp_cpu_count());
+    json_field("overhead", timer_overhead);
+    serial_write("}\n");
+
+    for (const bench_t* bench = _bench_start; bench < _bench_end; bench++) {
+        if (filter && !name_matches(bench->name, filter)) continue;
+        if (bench_run_one(bench, &result)) {
+            report(bench, &result);
+            run++;
+        }
+    }
+
+    serial_write("{\"suite\":\"done\"");
+    json_field("count", run);
+    serial_write("}\n");
+    serial_flush();
+    return run;
+}
+
+void bench_boot_task(void) {
+    terminal_writestring("[BENCH] Running benchmarks...\n");
+    uint32_t run = bench_run_all(NULL);
+    qemu_debug_exit(run ? 0 : 1);
+}
+
+static void bench_cmd(char* args) {
+    if (bench_run_all(*args ? args : NULL) == 0) {
+        terminal_writestring("bench: no benchmark matches\n");
+    }
+}
+
+static const shell_command_t bench_command = {
+    "bench", "Run microbenchmarks, JSON on serial [prefix]", bench_cmd
+};
+
+void bench_init(void) {
+    shell_register_command(&bench_command);
+}
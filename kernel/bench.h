@@ -0,0 +1,51 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BENCH_MAX_ITERATIONS 4096
+#define BENCH_WARMUP 64
+
+/* One timed operation. setup and teardown run once, outside the timing,
+   and may be NULL; run is timed once per iteration. */
+typedef struct {
+    const char* name;
+    uint32_t iterations;        /* at most BENCH_MAX_ITERATIONS */
+    void (*setup)(void);
+    void (*run)(void);
+    void (*teardown)(void);
+} bench_t;
+
+/* Cycles per run, with the cost of the rdtsc pair taken off */
+typedef struct {
+    uint32_t iterations;
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+    uint32_t max;
+} bench_result_t;
+
+/* Places a benchmark in the .bench section, where the harness finds it
+   without a central list. Names are plain identifiers. */
+#define BENCH_DEFINE(id, iters, setup_fn, run_fn, teardown_fn)                  \
+    static const bench_t bench_##id                                             \
+        __attribute__((section(".bench"), used, aligned(4))) =                  \
+        { #id, (iters), (setup_fn), (run_fn), (teardown_fn) }
+
+#define BENCH(id, iters, run_fn) BENCH_DEFINE(id, iters, NULL, run_fn, NULL)
+
+/* Registers the shell's "bench" */
+void bench_init(void);
+
+/* Runs every benchmark whose name starts with filter (NULL for all),
+   writing one JSON line per benchmark to the serial port. Returns the
+   number run. */
+uint32_t bench_run_all(const char* filter);
+bool bench_run_one(const bench_t* bench, bench_result_t* result);
+
+/* Boot-time entry for "bench" on the kernel command line: runs the
+   whole suite from its own task, then leaves QEMU through isa-debug-exit */
+void bench_boot_task(void);
+
+#endif
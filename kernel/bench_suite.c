@@ -0,0 +1,104 @@
+#include <stddef.h>
+#include "bench.h"
+#include "heap.h"
+#include "task.h"
+#include "vfs.h"
+#include "ipc.h"
+#include "syscall.h"
+#include "syscall_wrapper.h"
+
+/* The kernel's standard benchmarks. Each run function is one operation,
+   or one allocate/free pair, so results are cycles per operation. */
+
+extern uint32_t rust_allocate_page(void);
+extern void rust_free_page(uint32_t page);
+
+#define BENCH_IPC_PID 0xBE7C
+#define BENCH_FILE "bench.dat"
+#define BENCH_PAYLOAD 64
+
+static uint8_t payload[BENCH_PAYLOAD];
+static uint8_t receive_buf[IPC_INLINE_SIZE];
+
+static void kmalloc_64_run(void) {
+    kfree(kmalloc(64));
+}
+BENCH(kmalloc_64, 4096, kmalloc_64_run);
+
+static void kmalloc_1k_run(void) {
+    kfree(kmalloc(1024));
+}
+BENCH(kmalloc_1k, 4096, kmalloc_1k_run);
+
+static void page_alloc_run(void) {
+    uint32_t page = rust_allocate_page();
+    if (page) {
+        rust_free_page(page);
+    }
+}
+BENCH(page_alloc, 4096, page_alloc_run);
+
+/* int 0x80 from ring 0: entry stub, dispatch and iret, without the
+   privilege change (user/syscost.c measures that one) */
+static void syscall_getpid_run(void) {
+    syscall0(SYS_GETPID);
+}
+BENCH(syscall_getpid, 4096, syscall_getpid_run);
+
+/* A partner task that hands the CPU straight back: one run is two
+   context switches. Only meaningful when both tasks share a run queue,
+   as they do with one CPU. */
+static volatile bool partner_stop;
+
+static void partner_task(void) {
+    while (!partner_stop) {
+        task_yield();
+    }
+}
+
+static void yield_setup(void) {
+    partner_stop = false;
+    task_create(partner_task);
+}
+
+static void yield_run(void) {
+    task_yield();
+}
+
+static void yield_teardown(void) {
+    partner_stop = true;
+    task_yield();
+}
+BENCH_DEFINE(yield_pingpong, 2048, yield_setup, yield_run, yield_teardown);
+
+static void vfs_setup(void) {
+    rust_vfs_create((const uint8_t*)BENCH_FILE, sizeof(BENCH_FILE) - 1, VFS_TYPE_REGULAR);
+    rust_vfs_write((const uint8_t*)BENCH_FILE, sizeof(BENCH_FILE) - 1, payload, BENCH_PAYLOAD);
+}
+
+static void vfs_teardown(void) {
+    rust_vfs_remove((const uint8_t*)BENCH_FILE, sizeof(BENCH_FILE) - 1);
+}
+
+static void vfs_write_run(void) {
+    rust_vfs_write((const uint8_t*)BENCH_FILE, sizeof(BENCH_FILE) - 1, payload, BENCH_PAYLOAD);
+}
+BENCH_DEFINE(vfs_write_64, 4096, vfs_setup, vfs_write_run, vfs_teardown);
+
+static void vfs_read_run(void) {
+    rust_vfs_read((const uint8_t*)BENCH_FILE, sizeof(BENCH_FILE) - 1, receive_buf, BENCH_PAYLOAD);
+}
+BENCH_DEFINE(vfs_read_64, 4096, vfs_setup, vfs_read_run, vfs_teardown);
+
+/* Send to a mailbox nobody waits on, then take the message back out:
+   the queueing cost without a wake-up */
+static void ipc_run(void) {
+    ipc_message_info_t info;
+    ipc_send(IPC_MSG_DATA, 1, BENCH_IPC_PID, payload, BENCH_PAYLOAD);
+    ipc_recv(BENCH_IPC_PID, &info, receive_buf, sizeof(receive_buf));
+}
+
+static void ipc_teardown(void) {
+    ipc_close(BENCH_IPC_PID);
+}
+BENCH_DEFINE(ipc_send_recv_64, 4096, NULL, ipc_run, ipc_teardown);
@@ -0,0 +1,155 @@
+#include "boottime.h"
+#include "cpu.h"
+#include "format.h"
+#include "serial.h"
+#include "shell.h"
+#include "terminal.h"
+#include "timer.h"
+
+#define CALIBRATE_US 10000
+
+/* Only the BSP runs kernel_main, so no lock: the table is complete
+   before any other task can read it */
+static boot_phase_t phases[BOOT_MAX_PHASES];
+static uint32_t phase_count;
+static uint64_t boot_start;
+static uint64_t boot_end;
+static uint32_t tsc_khz;
+
+static bool have_tsc(void) {
+    return cpu_has(CPU_FEATURE_TSC);
+}
+
+static void end_phase(uint64_t now) {
+    if (phase_count > 0) {
+        boot_phase_t* last = &phases[phase_count - 1];
+        last->cycles = now - last->start;
+    }
+}
+
+void boot_phase(const char* name) {
+    if (!have_tsc() || boot_end != 0) return;
+    if (phase_count == BOOT_MAX_PHASES) {
+        /* The last phase runs on and takes in the rest */
+        return;
+    }
+    uint64_t now = rdtsc();
+    end_phase(now);
+    if (phase_count == 0) {
+        boot_start = now;
+    }
+    phases[phase_count].name = name;
+    phases[phase_count].start = now;
+    phases[phase_count].cycles = 0;
+    phase_count++;
+}
+
+void boot_done(void) {
+    if (!have_tsc() || boot_end != 0 || phase_count == 0) return;
+    boot_end = rdtsc();
+    end_phase(boot_end);
+}
+
+uint64_t boot_cycles_to_shell(void) {
+    return boot_end ? boot_end - boot_start : 0;
+}
+
+/* The TSC starts at zero on reset, and nothing here writes it */
+uint64_t boot_cycles_before_kernel(void) {
+    return boot_start;
+}
+
+uint32_t boot_get_phases(boot_phase_t* out, uint32_t max) {
+    uint32_t count = phase_count < max ? phase_count : max;
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = phases[i];
+    }
+    return count;
+}
+
+uint32_t boot_tsc_khz(void) {
+    if (tsc_khz == 0 && have_tsc()) {
+        uint32_t flags = irq_save();
+        timer_oneshot_start(CALIBRATE_US);
+        uint64_t start = rdtsc();
+        while (!timer_oneshot_expired()) {
+            cpu_relax();
+        }
+        uint64_t cycles = rdtsc() - start;
+        irq_restore(flags);
+        tsc_khz = (uint32_t)(cycles / (CALIBRATE_US / 1000));
+    }
+    return tsc_khz;
+}
+
+uint64_t boot_cycles_to_us(uint64_t cycles) {
+    return div64(cycles * 1000, boot_tsc_khz());
+}
+
+static void json_field(const char* key, uint64_t value) {
+    serial_write(",\"");
+    serial_write(key);
+    serial_write("\":");
+    char digits[FORMAT_DEC_MAX];
+    format_dec(value, digits);
+    serial_write(digits);
+}
+
+/* e.g. {"boot":"paging","cycles":51234,"us":21}
+        {"boot":"total","cycles":...,"us":...,"loader_us":...,"tsc_khz":...} */
+void boot_report_serial(void) {
+    if (boot_end == 0) return;
+    for (uint32_t i = 0; i < phase_count; i++) {
+        serial_write("{\"boot\":\"");
+        serial_write(phases[i].name);
+        serial_write("\"");
+        json_field("cycles", phases[i].cycles);
+        json_field("us", boot_cycles_to_us(phases[i].cycles));
+        serial_write("}\n");
+    }
+    serial_write("{\"boot\":\"total\"");
+    json_field("cycles", boot_cycles_to_shell());
+    json_field("us", boot_cycles_to_us(boot_cycles_to_shell()));
+    json_field("loader_us", boot_cycles_to_us(boot_start));
+    json_field("tsc_khz", boot_tsc_khz());
+    serial_write("}\n");
+}
+
+/* Name, cycles, microseconds and share of the time to shell */
+static void write_row(const char* name, uint64_t cycles) {
+    uint32_t len = 0;
+    terminal_writestring("  ");
+    terminal_writestring(name);
+    while (name[len]) len++;
+    while (len++ < 12) {
+        terminal_putchar(' ');
+    }
+    terminal_write_dec(cycles, 14);
+    terminal_write_dec(boot_cycles_to_us(cycles), 10);
+    terminal_write_dec(percent(cycles, boot_cycles_to_shell()), 5);
+    terminal_writestring("%\n");
+}
+
+static void boottime_cmd(char* args) {
+    (void)args;
+    if (boot_end == 0) {
+        terminal_writestring("boottime: no TSC, boot was not timed\n");
+        return;
+    }
+    terminal_writestring("  phase               cycles        us share\n");
+    for (uint32_t i = 0; i < phase_count; i++) {
+        write_row(phases[i].name, phases[i].cycles);
+    }
+    write_row("to shell", boot_cycles_to_shell());
+    terminal_writestring("  before the kernel: ");
+    terminal_write_dec(boot_cycles_to_us(boot_start), 0);
+    terminal_writestring(" us in firmware and loader\n");
+}
+
+static const shell_command_t boottime_command = {
+    "boottime", "Time spent in each boot phase", boottime_cmd
+};
+
+void boot_init(void) {
+    shell_register_command(&boottime_command);
+}
@@ -0,0 +1,41 @@
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BOOT_MAX_PHASES 24
+
+typedef struct {
+    const char* name;
+    uint64_t start;         /* TSC */
+    uint64_t cycles;
+} boot_phase_t;
+
+/* Ends the running phase and starts the next one. Names must be string
+   literals; the table keeps the pointers. Does nothing without a TSC. */
+void boot_phase(const char* name);
+
+/* Ends the last phase: the shell is taking input from here on */
+void boot_done(void);
+
+/* Cycles from the first boot_phase() to boot_done(), 0 before then */
+uint64_t boot_cycles_to_shell(void);
+
+/* Cycles the firmware and boot loader ran before the first phase */
+uint64_t boot_cycles_before_kernel(void);
+
+uint32_t boot_get_phases(boot_phase_t* out, uint32_t max);
+
+/* Measured against the PIT on first use, with interrupts off for 10 ms;
+   0 without a TSC */
+uint32_t boot_tsc_khz(void);
+uint64_t boot_cycles_to_us(uint64_t cycles);
+
+/* One JSON line per phase on serial, then the totals */
+void boot_report_serial(void);
+
+/* Registers the shell's "boottime" */
+void boot_init(void);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include "cpu.h"
+
+#define CPUID_1_EDX_PSE   (1u << 3)
+#define CPUID_1_EDX_TSC   (1u << 4)
+#define CPUID_1_EDX_APIC  (1u << 9)
+#define CPUID_1_EDX_PGE   (1u << 13)
+#define CPUID_1_EDX_FXSR  (1u << 24)
+#define CPUID_1_EDX_SSE   (1u << 25)
+#define CPUID_1_EDX_SSE2  (1u << 26)
+#define CPUID_7_EBX_ERMS  (1u << 9)
+
+#define EFLAGS_ID 0x200000
+
+uint32_t cpu_features = 0;
+
+/* CPUID exists if the ID flag in EFLAGS can be toggled */
+static bool cpuid_supported(void) {
+    uint32_t before, after;
+    __asm__ volatile(
+        "pushf\n\t"
+        "pop %0\n\t"
+        "mov %0, %1\n\t"
+        "xor %2, %1\n\t"
+        "push %1\n\t"
+        "popf\n\t"
+        "pushf\n\t"
+        "pop %1\n\t"
+        "push %0\n\t"
+        "popf"
+        : "=&r"(before), "=&r"(after)
+        : "i"(EFLAGS_ID)
+        : "cc");
+    return ((before ^ after) & EFLAGS_ID) != 0;
+}
+
+void cpu_detect(void) {
+    uint32_t a, b, c, d;
+    uint32_t max_leaf;
+
+    cpu_features = 0;
+    if (!cpuid_supported()) {
+        return;
+    }
+
+    cpuid(0, 0, &max_leaf, &b, &c, &d);
+    if (max_leaf >= 1) {
+        cpuid(1, 0, &a, &b, &c, &d);
+        if (d & CPUID_1_EDX_TSC)  cpu_features |= CPU_FEATURE_TSC;
+        if (d & CPUID_1_EDX_APIC) cpu_features |= CPU_FEATURE_APIC;
+        if (d & CPUID_1_EDX_PSE)  cpu_features |= CPU_FEATURE_PSE;
+        if (d & CPUID_1_EDX_PGE)  cpu_features |= CPU_FEATURE_PGE;
+        if (d & CPUID_1_EDX_FXSR) cpu_features |= CPU_FEATURE_FXSR;
+        if (d & CPUID_1_EDX_SSE)  cpu_features |= CPU_FEATURE_SSE;
+        if (d & CPUID_1_EDX_SSE2) cpu_features |= CPU_FEATURE_SSE2;
+    }
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &a, &b, &c, &d);
+        if (b & CPUID_7_EBX_ERMS) cpu_features |= CPU_FEATURE_ERMS;
+    }
+}
+
+uint32_t cpu_irq_save(void) {
+    return irq_save();
+}
+
+void cpu_irq_restore(uint32_t flags) {
+    irq_restore(flags);
+}
@@ -0,0 +1,58 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EFLAGS_IF 0x200
+
+/* Bits of cpu_features, filled in by cpu_detect() */
+#define CPU_FEATURE_TSC   (1u << 0)
+#define CPU_FEATURE_FXSR  (1u << 1)
+#define CPU_FEATURE_SSE   (1u << 2)
+#define CPU_FEATURE_SSE2  (1u << 3)
+#define CPU_FEATURE_ERMS  (1u << 4)     /* fast rep movsb/stosb */
+#define CPU_FEATURE_APIC  (1u << 5)
+#define CPU_FEATURE_PSE   (1u << 6)     /* 4 MB pages */
+#define CPU_FEATURE_PGE   (1u << 7)     /* global pages */
+
+extern uint32_t cpu_features;
+void cpu_detect(void);
+
+static inline bool cpu_has(uint32_t feature) {
+    return (cpu_features & feature) != 0;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* a, uint32_t* b,
+                         uint32_t* c, uint32_t* d) {
+    __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf\n\t" "pop %0\n\t" "cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        __asm__ volatile("sti" : : : "memory");
+    }
+}
+
+/* Out-of-line irq_save()/irq_restore() for Rust */
+uint32_t cpu_irq_save(void);
+void cpu_irq_restore(uint32_t flags);
+
+/* Spin-wait hint; also lets a hyperthread sibling run */
+static inline void cpu_relax(void) {
+    __asm__ volatile("pause" : : : "memory");
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#include "elf.h"
+
+bool elf_check_header(const elf32_ehdr_t* header) {
+    uint32_t magic = (uint32_t)header->e_ident[0] | ((uint32_t)header->e_ident[1] << 8) |
+                     ((uint32_t)header->e_ident[2] << 16) | ((uint32_t)header->e_ident[3] << 24);
+    if (magic != ELF_MAGIC) return false;
+    if (header->e_ident[4] != ELF_CLASS_32 || header->e_ident[5] != ELF_DATA_LSB) return false;
+    if (header->e_type != ELF_TYPE_EXEC || header->e_machine != ELF_MACHINE_386) return false;
+    if (header->e_phentsize != sizeof(elf32_phdr_t) || header->e_phnum == 0) return false;
+    return true;
+}
+
+/* Written so that no sum can wrap */
+bool elf_check_segment(const elf32_phdr_t* segment, uint32_t base, uint32_t top) {
+    if (segment->p_type != ELF_PT_LOAD) return false;
+    if (segment->p_filesz > segment->p_memsz) return false;
+    if (segment->p_vaddr < base || segment->p_vaddr >= top) return false;
+    if (segment->p_memsz > top - segment->p_vaddr) return false;
+    if (segment->p_filesz > 0xFFFFFFFF - segment->p_offset) return false;
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ELF_MAGIC 0x464C457F        /* "\x7fELF" read as a little-endian word */
+
+#define ELF_CLASS_32 1
+#define ELF_DATA_LSB 1
+#define ELF_TYPE_EXEC 2
+#define ELF_MACHINE_386 3
+
+#define ELF_PT_LOAD 1
+
+#define ELF_PF_X 0x1
+#define ELF_PF_W 0x2
+#define ELF_PF_R 0x4
+
+typedef struct {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} __attribute__((packed)) elf32_ehdr_t;
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} __attribute__((packed)) elf32_phdr_t;
+
+/* A statically linked i386 executable with its program headers where
+   e_phoff says */
+bool elf_check_header(const elf32_ehdr_t* header);
+
+/* A PT_LOAD segment that lies inside [base, top) and does not claim more
+   file bytes than memory */
+bool elf_check_segment(const elf32_phdr_t* segment, uint32_t base, uint32_t top);
+
+#endif
@@ -0,0 +1,48 @@
+#include "format.h"
+#include "terminal.h"
+
+uint64_t div64(uint64_t n, uint32_t d) {
+    uint64_t q = 0;
+    uint64_t r = 0;
+    if (d == 0) return 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if (r >= d) {
+            r -= d;
+            q |= (uint64_t)1 << i;
+        }
+    }
+    return q;
+}
+
+uint32_t percent(uint64_t part, uint64_t whole) {
+    while (whole >> 24) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return whole ? (uint32_t)part * 100 / (uint32_t)whole : 0;
+}
+
+uint32_t format_dec(uint64_t value, char buf[FORMAT_DEC_MAX]) {
+    char digits[FORMAT_DEC_MAX];
+    uint32_t n = 0;
+    do {
+        uint64_t q = div64(value, 10);
+        digits[n++] = '0' + (char)(value - q * 10);
+        value = q;
+    } while (value > 0);
+    for (uint32_t i = 0; i < n; i++) {
+        buf[i] = digits[n - 1 - i];
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+void terminal_write_dec(uint64_t value, uint32_t width) {
+    char buf[FORMAT_DEC_MAX];
+    uint32_t n = format_dec(value, buf);
+    while (width-- > n) {
+        terminal_putchar(' ');
+    }
+    terminal_writestring(buf);
+}
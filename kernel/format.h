@@ -0,0 +1,23 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+
+/* Digits of the largest uint64_t plus the terminator */
+#define FORMAT_DEC_MAX 21
+
+/* Shift-and-subtract division so the kernel does not need libgcc's
+   64-bit helpers. 0 for d == 0. */
+uint64_t div64(uint64_t n, uint32_t d);
+
+/* part as a whole percentage of whole, 0 when whole is 0 */
+uint32_t percent(uint64_t part, uint64_t whole);
+
+/* Writes value in decimal to buf, NUL-terminated, and returns the
+   number of digits */
+uint32_t format_dec(uint64_t value, char buf[FORMAT_DEC_MAX]);
+
+/* Decimal on the terminal, right-aligned in width columns */
+void terminal_write_dec(uint64_t value, uint32_t width);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stddef.h>
+#include "fpu.h"
+#include "cpu.h"
+#include "string.h"
+#include "percpu.h"
+
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR0_TS (1u << 3)
+#define CR0_NE (1u << 5)
+
+#define CR4_OSFXSR     (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+
+#define MXCSR_DEFAULT 0x1F80
+
+#define FPU_NO_CPU 0xFFFFFFFF
+
+/* Lazy restore, eager save. Switching tasks normally just sets CR0.TS;
+   the first x87/SSE instruction after that raises #NM, and only then is
+   the task's image loaded. A task that ran with TS clear may have
+   changed the registers, so it is saved when switched out. That keeps
+   every image that is not running current in memory, so a task can
+   move to another CPU without asking the old one for its registers.
+   fpu_owner[cpu] is whose image that CPU's registers hold; if the same
+   task comes back and was last loaded there, TS is cleared and nothing
+   is reloaded. */
+static fpu_state_t* fpu_owner[MAX_CPUS];
+static fpu_state_t* fpu_current[MAX_CPUS];
+static fpu_state_t fpu_initial;
+static bool enabled = false;
+static uint32_t restore_count;
+
+static inline uint32_t read_cr0(void) {
+    uint32_t value;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline void set_ts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void clts(void) {
+    __asm__ volatile("clts" : : : "memory");
+}
+
+static inline void fxsave(fpu_state_t* state) {
+    __asm__ volatile("fxsave %0" : "=m"(state->data));
+}
+
+static inline void fxrstor(const fpu_state_t* state) {
+    __asm__ volatile("fxrstor %0" : : "m"(state->data));
+}
+
+static void fpu_enable_cpu(void) {
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ volatile("fninit\n\t" "ldmxcsr %0" : : "m"(mxcsr));
+}
+
+bool fpu_init(void) {
+    if (!cpu_has(CPU_FEATURE_FXSR) || !cpu_has(CPU_FEATURE_SSE)) {
+        return false;
+    }
+
+    /* Clean image every new task starts from */
+    fpu_enable_cpu();
+    fxsave(&fpu_initial);
+
+    enabled = true;
+    set_ts();
+    return true;
+}
+
+void fpu_cpu_init(void) {
+    if (!enabled) {
+        return;
+    }
+    fpu_enable_cpu();
+    set_ts();
+}
+
+bool fpu_enabled(void) {
+    return enabled;
+}
+
+void fpu_task_init(fpu_state_t* state) {
+    memcpy(state, &fpu_initial, sizeof(*state));
+    state->last_cpu = FPU_NO_CPU;
+}
+
+/* Called by the scheduler with interrupts off. CR0 is only written when
+   TS actually changes: the write is serializing. */
+void fpu_switch(fpu_state_t* prev, fpu_state_t* next) {
+    uint32_t cpu = cpu_id();
+    fpu_current[cpu] = next;
+    if (!enabled) {
+        return;
+    }
+
+    uint32_t cr0 = read_cr0();
+    if (!(cr0 & CR0_TS) && prev) {
+        fxsave(prev);
+    }
+    bool loaded = next == fpu_owner[cpu] && next->last_cpu == cpu;
+    if (loaded && (cr0 & CR0_TS)) {
+        clts();
+    } else if (!loaded && !(cr0 & CR0_TS)) {
+        write_cr0(cr0 | CR0_TS);
+    }
+}
+
+/* An exiting task's image must not be mistaken for a later one's */
+void fpu_release(fpu_state_t* state) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        fpu_state_t* expected = state;
+        __atomic_compare_exchange_n(&fpu_owner[cpu], &expected, NULL, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+}
+
+bool fpu_handle_nm(void) {
+    uint32_t cpu = cpu_id();
+    fpu_state_t* current = fpu_current[cpu];
+    if (!enabled || current == NULL) {
+        return false;
+    }
+
+    clts();
+    if (fpu_owner[cpu] != current || current->last_cpu != cpu) {
+        fxrstor(current);
+        current->last_cpu = cpu;
+        fpu_owner[cpu] = current;
+        __atomic_fetch_add(&restore_count, 1, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+void fpu_kernel_begin(void) {
+    if (!enabled) {
+        return;
+    }
+    uint32_t flags = irq_save();
+    uint32_t cpu = cpu_id();
+    if (!(read_cr0() & CR0_TS) && fpu_owner[cpu]) {
+        fxsave(fpu_owner[cpu]);
+    }
+    fpu_owner[cpu] = NULL;
+    clts();
+    irq_restore(flags);
+}
+
+void fpu_kernel_end(void) {
+    if (!enabled) {
+        return;
+    }
+    /* No task owns the registers now; the next user reloads its own */
+    set_ts();
+}
+
+uint32_t fpu_get_restore_count(void) {
+    return restore_count;
+}
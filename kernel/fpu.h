@@ -0,0 +1,38 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FPU_STATE_SIZE 512
+
+/* FXSAVE image (x87, MMX and SSE registers plus MXCSR) and the CPU
+   whose registers it was last loaded into */
+typedef struct {
+    uint8_t data[FPU_STATE_SIZE];
+    uint32_t last_cpu;
+} __attribute__((aligned(16))) fpu_state_t;
+
+/* Enables x87/SSE with CR0.TS lazy switching. Returns false, leaving
+   the FPU untouched, if the CPU lacks FXSAVE or SSE. */
+bool fpu_init(void);
+bool fpu_enabled(void);
+/* Same CR0/CR4 setup on an application processor */
+void fpu_cpu_init(void);
+
+/* Scheduler hooks */
+void fpu_task_init(fpu_state_t* state);
+void fpu_switch(fpu_state_t* prev, fpu_state_t* next);
+void fpu_release(fpu_state_t* state);
+
+/* #NM (vector 7) handler; false if the fault is not ours */
+bool fpu_handle_nm(void);
+
+/* Bracket kernel code that uses x87/SSE registers. Saves the owning
+   task's registers first; the section must not block or yield. */
+void fpu_kernel_begin(void);
+void fpu_kernel_end(void);
+
+uint32_t fpu_get_restore_count(void);
+
+#endif
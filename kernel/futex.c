@@ -0,0 +1,117 @@
+#include <stddef.h>
+#include "futex.h"
+#include "paging.h"
+#include "task.h"
+#include "lock.h"
+#include "trace.h"
+#include "user.h"
+
+#define FUTEX_BUCKETS 16
+#define FUTEX_BUCKET_SHIFT 28
+
+typedef struct futex_waiter {
+    uint32_t key;
+    uint32_t task;
+    struct futex_waiter* next;
+} futex_waiter_t;
+
+/* A task sleeps on at most one futex, so one waiter node per task suffices */
+static futex_waiter_t waiters[MAX_TASKS];
+static futex_waiter_t* buckets[FUTEX_BUCKETS];
+static spinlock_t futex_lock = SPINLOCK_INIT;
+
+/* Key on the physical address so a shared region mapped at different
+   virtual addresses still matches. Fails if the word's page is not
+   mapped in the caller's directory. */
+static bool futex_key(volatile uint32_t* addr, uint32_t* key) {
+    uint32_t vaddr = (uint32_t)addr;
+    if (paging_get_current_directory() == NULL) {
+        *key = vaddr;
+        return true;
+    }
+    *key = paging_get_physical_address(vaddr);
+    return *key != 0;
+}
+
+static uint32_t bucket_index(uint32_t key) {
+    return ((key >> 2) * 2654435761u) >> FUTEX_BUCKET_SHIFT;
+}
+
+/* Takes the waiter off its bucket if a wake did not already */
+static void unlink_waiter(futex_waiter_t* waiter) {
+    futex_waiter_t** link = &buckets[bucket_index(waiter->key)];
+    while (*link && *link != waiter) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = waiter->next;
+        waiter->next = NULL;
+    }
+}
+
+/* The waiter is queued before the lock is dropped, so a wake between
+   the unlock and task_block() finds it and leaves a pending wake-up.
+   The word is faulted in first: a page fault under futex_lock would
+   run the loader, or kill the process, with the lock held. */
+int32_t futex_wait(volatile uint32_t* addr, uint32_t expected) {
+    if (!user_fault_in((uint32_t)addr, sizeof(uint32_t))) {
+        return -1;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&futex_lock);
+    uint32_t key;
+    if (!futex_key(addr, &key) || *addr != expected) {
+        spin_unlock_irqrestore(&futex_lock, flags);
+        return -1;
+    }
+
+    uint32_t tid = task_get_current();
+    futex_waiter_t* waiter = &waiters[tid];
+    waiter->key = key;
+    waiter->task = tid;
+    waiter->next = NULL;
+
+    futex_waiter_t** link = &buckets[bucket_index(key)];
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = waiter;
+
+    TRACE2(TRACE_DEBUG, TRACE_MOD_SCHED, "futex wait %x task %u", key, tid);
+    spin_unlock(&futex_lock);
+    task_block();
+
+    /* A stale wake-up can end the block early */
+    spin_lock(&futex_lock);
+    unlink_waiter(waiter);
+    spin_unlock_irqrestore(&futex_lock, flags);
+    return 0;
+}
+
+/* An unmapped word has never been waited on, so there is nobody to wake */
+int32_t futex_wake(volatile uint32_t* addr, uint32_t count) {
+    uint32_t flags = spin_lock_irqsave(&futex_lock);
+    uint32_t key;
+    if (!futex_key(addr, &key)) {
+        spin_unlock_irqrestore(&futex_lock, flags);
+        return 0;
+    }
+    futex_waiter_t** link = &buckets[bucket_index(key)];
+    int32_t woken = 0;
+
+    while (*link && (uint32_t)woken < count) {
+        futex_waiter_t* waiter = *link;
+        if (waiter->key != key) {
+            link = &waiter->next;
+            continue;
+        }
+        *link = waiter->next;
+        waiter->next = NULL;
+        task_unblock(waiter->task);
+        woken++;
+    }
+
+    TRACE2(TRACE_DEBUG, TRACE_MOD_SCHED, "futex wake %x woke %d", key, woken);
+    spin_unlock_irqrestore(&futex_lock, flags);
+    return woken;
+}
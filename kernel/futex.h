@@ -0,0 +1,9 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdint.h>
+
+int32_t futex_wait(volatile uint32_t* addr, uint32_t expected);
+int32_t futex_wake(volatile uint32_t* addr, uint32_t count);
+
+#endif
@@ -14,8 +14,32 @@ struct gdt_ptr {
     uint32_t base;
 } __attribute__((packed));
 
-struct gdt_entry gdt[5];
+/* Hardware task switching is not used: only ss0:esp0 and the I/O map
+   base matter */
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+typedef struct {
+    tss_t tss;
+} __attribute__((aligned(64))) cpu_tss_t;
+
+/* The interrupt and system call stubs find the per-CPU GS selector by
+   subtracting this from the task register (kernel/interrupt.asm) */
+_Static_assert(GDT_TSS_SELECTOR(0) - GDT_PERCPU_SELECTOR(0) == 64, "TSS_TO_PERCPU in the stubs");
+
+struct gdt_entry gdt[GDT_ENTRIES];
 struct gdt_ptr gdtp;
+static cpu_tss_t tss[MAX_CPUS];
 
 extern void gdt_flush(uint32_t);
 
@@ -29,7 +53,7 @@ void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_
 }
 
 void gdt_init(void) {
-    gdtp.limit = (sizeof(struct gdt_entry) * 5) - 1;
+    gdtp.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
     gdtp.base = (uint32_t)&gdt;
     
     gdt_set_gate(0, 0, 0, 0, 0);
@@ -37,6 +61,14 @@ void gdt_init(void) {
     gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
     gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
     gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+
+    /* An I/O map base past the limit means no I/O bitmap: in and out
+       fault in ring 3 */
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        tss[cpu].tss.ss0 = GDT_KERNEL_DATA;
+        tss[cpu].tss.iomap_base = sizeof(tss_t);
+        gdt_set_gate(GDT_TSS_FIRST + cpu, (uint32_t)&tss[cpu].tss, sizeof(tss_t) - 1, 0x89, 0x00);
+    }
     
     gdt_flush((uint32_t)&gdtp);
 }
@@ -45,3 +77,17 @@ void gdt_install(void) {
     gdt_init();
 }
 
+/* Application processors load the table the BSP built */
+void gdt_load(void) {
+    gdt_flush((uint32_t)&gdtp);
+}
+
+
+void tss_load(uint32_t cpu) {
+    uint16_t selector = GDT_TSS_SELECTOR(cpu);
+    __asm__ volatile("ltr %0" : : "r"(selector) : "memory");
+}
+
+void tss_set_kernel_stack(uint32_t esp0) {
+    tss[cpu_id()].tss.esp0 = esp0;
+}
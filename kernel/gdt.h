@@ -2,8 +2,20 @@
 #define GDT_H
 
 #include <stdint.h>
+#include "percpu.h"
 
-#define GDT_ENTRIES 5
+/* null, kernel code/data, user code/data, then one data segment per CPU
+   for GS and one TSS per CPU */
+#define GDT_PERCPU_FIRST 5
+#define GDT_TSS_FIRST (GDT_PERCPU_FIRST + MAX_CPUS)
+#define GDT_ENTRIES (GDT_TSS_FIRST + MAX_CPUS)
+#define GDT_PERCPU_SELECTOR(cpu) ((GDT_PERCPU_FIRST + (cpu)) * 8)
+#define GDT_TSS_SELECTOR(cpu) ((GDT_TSS_FIRST + (cpu)) * 8)
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE 0x1B      /* selector with RPL 3 */
+#define GDT_USER_DATA 0x23
 
 #define GDT_ACCESS_PRESENT 0x80
 #define GDT_ACCESS_RING0 0x00
@@ -17,5 +29,14 @@
 
 void gdt_init(void);
 void gdt_install(void);
+void gdt_load(void);
+void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran);
+
+/* Each CPU has a TSS only for the ring 0 stack the CPU switches to when
+   an interrupt or system call arrives from ring 3. tss_load() loads the
+   task register for cpu on the calling CPU; tss_set_kernel_stack() sets
+   the calling CPU's esp0 and is called on every task switch. */
+void tss_load(uint32_t cpu);
+void tss_set_kernel_stack(uint32_t esp0);
 
 #endif
@@ -1,34 +1,95 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "heap.h"
+#ifdef HEAP_HOSTED
+#include "heap_host.h"          /* tests/host: locks, CPU number, IRQ flags */
+#else
+#include "lock.h"
+#include "cpu.h"
+#include "percpu.h"
+#endif
 
-#define HEAP_START 0x00100000
+#define HEAP_START 0x01000000
 #define HEAP_SIZE 0x00100000
 #define BLOCK_SIZE 16
 
+/* Small requests are rounded up to a power-of-two class, 16 .. 256
+   bytes, and served from a per-CPU magazine of free blocks of that
+   class. Refill and flush move HEAP_MAG_BATCH blocks per trip to the
+   block list, so most calls take no lock and touch no shared line. */
+#define HEAP_CLASSES     5
+#define HEAP_CLASS_MAX   (BLOCK_SIZE << (HEAP_CLASSES - 1))
+#define HEAP_MAG_SIZE    16
+#define HEAP_MAG_BATCH   8
+
+typedef enum {
+    BLOCK_FREE,
+    BLOCK_USED,
+    BLOCK_CACHED,               /* used as far as the list knows, parked in a magazine */
+} block_state_t;
+
 typedef struct heap_block {
     size_t size;
-    bool used;
+    uint8_t state;
+    uint8_t size_class;         /* class + 1, or 0 for a large block */
     struct heap_block* next;
 } heap_block_t;
 
+typedef struct {
+    heap_block_t* blocks[HEAP_MAG_SIZE];
+    uint32_t count;
+} heap_magazine_t;
+
+typedef struct {
+    heap_magazine_t classes[HEAP_CLASSES];
+    uint32_t refills;
+    uint32_t flushes;
+} __attribute__((aligned(64))) heap_cpu_cache_t;
+
 static heap_block_t* heap_start = NULL;
+static uintptr_t heap_end = 0;
 static uint32_t heap_used = 0;
 static uint32_t heap_total = HEAP_SIZE;
+static heap_cpu_cache_t heap_caches[MAX_CPUS];
+
+/* Guards the block list and heap_used. Interrupts stay off while it is
+   held so a handler that allocates cannot deadlock against its CPU.
+   Each CPU's magazines are only touched by that CPU with interrupts
+   off. */
+static spinlock_t heap_lock = SPINLOCK_INIT;
 
 void heap_init(void) {
-    heap_start = (heap_block_t*)HEAP_START;
-    heap_start->size = HEAP_SIZE - sizeof(heap_block_t);
-    heap_start->used = false;
+    heap_init_region((void*)HEAP_START, HEAP_SIZE);
+    spin_register(&heap_lock, "heap");
+}
+
+/* Forgets every earlier allocation, including the cached ones */
+void heap_init_region(void* base, size_t size) {
+    heap_start = (heap_block_t*)base;
+    heap_start->size = size - sizeof(heap_block_t);
+    heap_start->state = BLOCK_FREE;
+    heap_start->size_class = 0;
     heap_start->next = NULL;
+    heap_end = (uintptr_t)base + size;
     heap_used = 0;
+    heap_total = size;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        heap_cpu_cache_t* cache = &heap_caches[cpu];
+        for (uint32_t cls = 0; cls < HEAP_CLASSES; cls++) {
+            cache->classes[cls].count = 0;
+        }
+        cache->refills = 0;
+        cache->flushes = 0;
+    }
 }
 
 static void split_block(heap_block_t* block, size_t size) {
     if (block->size >= size + sizeof(heap_block_t) + BLOCK_SIZE) {
         heap_block_t* new_block = (heap_block_t*)((uint8_t*)block + sizeof(heap_block_t) + size);
         new_block->size = block->size - size - sizeof(heap_block_t);
-        new_block->used = false;
+        new_block->state = BLOCK_FREE;
+        new_block->size_class = 0;
         new_block->next = block->next;
         block->size = size;
         block->next = new_block;
@@ -38,7 +99,7 @@ static void split_block(heap_block_t* block, size_t size) {
 static void merge_free_blocks(void) {
     heap_block_t* current = heap_start;
     while (current && current->next) {
-        if (!current->used && !current->next->used) {
+        if (current->state == BLOCK_FREE && current->next->state == BLOCK_FREE) {
             current->size += sizeof(heap_block_t) + current->next->size;
             current->next = current->next->next;
         } else {
@@ -47,30 +108,115 @@ static void merge_free_blocks(void) {
     }
 }
 
-void* kmalloc(size_t size) {
-    if (size == 0) return NULL;
-    size = (size + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
-    heap_block_t* current = heap_start;
-    while (current) {
-        if (!current->used && current->size >= size) {
+/* First fit; heap_lock held */
+static heap_block_t* alloc_block(size_t size, uint8_t size_class) {
+    for (heap_block_t* current = heap_start; current; current = current->next) {
+        if (current->state == BLOCK_FREE && current->size >= size) {
             split_block(current, size);
-            current->used = true;
-            heap_used += size + sizeof(heap_block_t);
-            return (void*)((uint8_t*)current + sizeof(heap_block_t));
+            current->state = BLOCK_USED;
+            current->size_class = size_class;
+            heap_used += current->size + sizeof(heap_block_t);
+            return current;
         }
-        current = current->next;
     }
     return NULL;
 }
 
+/* heap_lock held; the caller merges once afterwards */
+static void release_block(heap_block_t* block) {
+    block->state = BLOCK_FREE;
+    block->size_class = 0;
+    heap_used -= block->size + sizeof(heap_block_t);
+}
+
+static uint32_t size_class(size_t size) {
+    if (size <= BLOCK_SIZE) return 0;
+    return 32 - __builtin_clz((uint32_t)size - 1) - 4;
+}
+
+static void magazine_refill(heap_cpu_cache_t* cache, uint32_t cls) {
+    heap_magazine_t* mag = &cache->classes[cls];
+    size_t size = (size_t)BLOCK_SIZE << cls;
+
+    spin_lock(&heap_lock);
+    while (mag->count < HEAP_MAG_BATCH) {
+        heap_block_t* block = alloc_block(size, (uint8_t)(cls + 1));
+        if (!block) break;
+        block->state = BLOCK_CACHED;
+        mag->blocks[mag->count++] = block;
+    }
+    spin_unlock(&heap_lock);
+    cache->refills++;
+}
+
+/* Returns the oldest half so the blocks this CPU used last stay cached */
+static void magazine_flush(heap_cpu_cache_t* cache, heap_magazine_t* mag) {
+    spin_lock(&heap_lock);
+    for (uint32_t i = 0; i < HEAP_MAG_BATCH; i++) {
+        release_block(mag->blocks[i]);
+    }
+    merge_free_blocks();
+    spin_unlock(&heap_lock);
+
+    for (uint32_t i = HEAP_MAG_BATCH; i < mag->count; i++) {
+        mag->blocks[i - HEAP_MAG_BATCH] = mag->blocks[i];
+    }
+    mag->count -= HEAP_MAG_BATCH;
+    cache->flushes++;
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0) return NULL;
+
+    if (size <= HEAP_CLASS_MAX) {
+        uint32_t cls = size_class(size);
+        uint32_t flags = irq_save();
+        heap_cpu_cache_t* cache = &heap_caches[cpu_id()];
+        heap_magazine_t* mag = &cache->classes[cls];
+        if (mag->count == 0) {
+            magazine_refill(cache, cls);
+        }
+        heap_block_t* block = mag->count ? mag->blocks[--mag->count] : NULL;
+        if (block) block->state = BLOCK_USED;
+        irq_restore(flags);
+        return block ? (void*)((uint8_t*)block + sizeof(heap_block_t)) : NULL;
+    }
+
+    size = (size + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    heap_block_t* block = alloc_block(size, 0);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return block ? (void*)((uint8_t*)block + sizeof(heap_block_t)) : NULL;
+}
+
+/* A small block goes back to this CPU's magazine, whichever CPU
+   allocated it */
 void kfree(void* ptr) {
     if (!ptr) return;
     heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - sizeof(heap_block_t));
-    if ((uint32_t)block < HEAP_START || (uint32_t)block >= HEAP_START + HEAP_SIZE) return;
-    if (!block->used) return;
-    block->used = false;
-    heap_used -= block->size + sizeof(heap_block_t);
-    merge_free_blocks();
+    if ((uintptr_t)block < (uintptr_t)heap_start || (uintptr_t)block >= heap_end) return;
+
+    if (block->size_class) {
+        uint32_t flags = irq_save();
+        if (block->state == BLOCK_USED) {
+            heap_cpu_cache_t* cache = &heap_caches[cpu_id()];
+            heap_magazine_t* mag = &cache->classes[block->size_class - 1];
+            if (mag->count == HEAP_MAG_SIZE) {
+                magazine_flush(cache, mag);
+            }
+            block->state = BLOCK_CACHED;
+            mag->blocks[mag->count++] = block;
+        }
+        irq_restore(flags);
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    if (block->state == BLOCK_USED) {
+        release_block(block);
+        merge_free_blocks();
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
 
 void* krealloc(void* ptr, size_t size) {
@@ -88,4 +234,83 @@ void* krealloc(void* ptr, size_t size) {
 }
 
 uint32_t heap_get_used(void) { return heap_used; }
+
+/* Magazine counters of other CPUs are read without their owners'
+   cooperation, so they can be off by the calls in flight */
+void heap_get_stats(heap_stats_t* stats) {
+    stats->used_blocks = 0;
+    stats->free_blocks = 0;
+    stats->free_bytes = 0;
+    stats->largest_free = 0;
+    stats->cached_blocks = 0;
+    stats->refills = 0;
+    stats->flushes = 0;
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    for (heap_block_t* block = heap_start; block; block = block->next) {
+        if (block->state == BLOCK_USED) {
+            stats->used_blocks++;
+        } else if (block->state == BLOCK_CACHED) {
+            stats->cached_blocks++;
+        } else {
+            stats->free_blocks++;
+            stats->free_bytes += block->size;
+            if (block->size > stats->largest_free) {
+                stats->largest_free = block->size;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->refills += heap_caches[cpu].refills;
+        stats->flushes += heap_caches[cpu].flushes;
+    }
+}
 uint32_t heap_get_free(void) { return heap_total - heap_used; }
+
+/* Blocks must tile the region exactly, no two free blocks may be
+   neighbours, heap_used must match the blocks not free, and every
+   magazine entry must be a cached block of its class */
+bool heap_check(void) {
+    bool ok = true;
+    uint32_t used = 0;
+    uint32_t cached = 0;
+    uint32_t parked = 0;
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    for (heap_block_t* block = heap_start; block; block = block->next) {
+        uintptr_t end = (uintptr_t)block + sizeof(heap_block_t) + block->size;
+        uintptr_t expected = block->next ? (uintptr_t)block->next : heap_end;
+        if (end != expected || block->state > BLOCK_CACHED ||
+            block->size_class > HEAP_CLASSES) {
+            ok = false;
+            break;
+        }
+        if (block->state == BLOCK_FREE) {
+            if (block->next && block->next->state == BLOCK_FREE) ok = false;
+        } else {
+            used += block->size + sizeof(heap_block_t);
+            if (block->state == BLOCK_CACHED) cached++;
+        }
+    }
+    if (used != heap_used) ok = false;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (uint32_t cls = 0; cls < HEAP_CLASSES; cls++) {
+            const heap_magazine_t* mag = &heap_caches[cpu].classes[cls];
+            if (mag->count > HEAP_MAG_SIZE) {
+                ok = false;
+                continue;
+            }
+            for (uint32_t i = 0; i < mag->count; i++) {
+                const heap_block_t* block = mag->blocks[i];
+                if (block->state != BLOCK_CACHED || block->size_class != cls + 1) ok = false;
+            }
+            parked += mag->count;
+        }
+    }
+    if (parked != cached) ok = false;
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return ok;
+}
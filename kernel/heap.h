@@ -3,12 +3,30 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t free_bytes;
+    uint32_t largest_free;
+    uint32_t cached_blocks;     /* free small blocks held in per-CPU magazines */
+    uint32_t refills;           /* magazine refills from the block list */
+    uint32_t flushes;           /* magazine flushes back to it */
+} heap_stats_t;
 
 void heap_init(void);
+/* heap_init() on an arbitrary region, for host builds of heap.c */
+void heap_init_region(void* base, size_t size);
 void* kmalloc(size_t size);
 void kfree(void* ptr);
 void* krealloc(void* ptr, size_t size);
 uint32_t heap_get_used(void);
 uint32_t heap_get_free(void);
+void heap_get_stats(heap_stats_t* stats);
+
+/* Walks every block and magazine and checks the allocator's invariants;
+   slow, for tests and debugging */
+bool heap_check(void);
 
 #endif
@@ -24,6 +24,11 @@ void idt_init(void) {
     idt_load((uint32_t)&idtp);
 }
 
+/* Application processors share the BSP's table */
+void idt_reload(void) {
+    idt_load((uint32_t)&idtp);
+}
+
 extern void isr0(void);
 extern void isr1(void);
 extern void isr2(void);
@@ -20,6 +20,7 @@ struct idt_ptr {
 
 void idt_init(void);
 void idt_install(void);
+void idt_reload(void);
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t selector, uint8_t flags);
 
 #endif
@@ -9,6 +9,21 @@ idt_flush:
     lidt [idtp]
     ret
 
+; Coming from ring 3, GS holds the user data selector. The per-CPU GS
+; selector sits a fixed distance below this CPU's TSS selector (see
+; kernel/gdt.h), so the task register gives it back. %1 is the offset
+; of the saved CS from ESP.
+TSS_TO_PERCPU equ 64
+
+%macro KERNEL_GS 1
+    test byte [esp + %1], 3
+    jz %%kernel
+    str ax
+    sub ax, TSS_TO_PERCPU
+    mov gs, ax
+%%kernel:
+%endmacro
+
 %macro ISR_NOERRCODE 1
 global isr%1
 isr%1:
@@ -71,7 +86,8 @@ isr_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
+    KERNEL_GS 60
+    cld
     mov eax, esp
     push eax
     call isr_handler
@@ -110,6 +126,21 @@ IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
 
+; Local APIC vectors (kernel/apic.h) share the IRQ path; irq_handler
+; tells them apart by vector number
+%macro APIC_VECTOR 1
+global apic_vector%1
+apic_vector%1:
+    cli
+    push byte 0
+    push byte %1
+    jmp irq_common_stub
+%endmacro
+
+APIC_VECTOR 48
+APIC_VECTOR 49
+APIC_VECTOR 63
+
 extern irq_handler
 
 irq_common_stub:
@@ -122,7 +153,8 @@ irq_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
+    KERNEL_GS 60
+    cld
     mov eax, esp
     push eax
     call irq_handler
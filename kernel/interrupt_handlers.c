@@ -1,6 +1,16 @@
 #include <stdint.h>
 #include "terminal.h"
 #include "port.h"
+#include "serial.h"
+#include "irq.h"
+#include "pic.h"
+#include "cpu.h"
+#include "profile.h"
+#include "fpu.h"
+#include "apic.h"
+#include "percpu.h"
+#include "task.h"
+#include "user.h"
 
 typedef struct {
     uint32_t gs, fs, es, ds;
@@ -34,31 +44,184 @@ static const char* exception_messages[] = {
     "Machine Check"
 };
 
+static const char* exception_name(uint32_t int_no) {
+    return int_no < 19 ? exception_messages[int_no] : "Reserved";
+}
+
+static inline uint32_t read_cr2(void) {
+    uint32_t addr;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(addr));
+    return addr;
+}
+
+static inline bool from_user(const registers_t* regs) {
+    return (regs->cs & 3) == 3;
+}
+
+/* Page faults in a process's user window are its lazily loaded pages.
+   Any other exception raised by a process, or a fault on a user address
+   it handed to a system call, ends the process instead of the kernel. */
 void isr_handler(registers_t* regs) {
+    if (regs->int_no == 7 && fpu_handle_nm()) {
+        return;
+    }
+    if (regs->int_no == 14) {
+        uint32_t addr = read_cr2();
+        if (user_handle_page_fault(addr, regs->err_code)) {
+            return;
+        }
+        if (user_current_pid() != 0 && !from_user(regs) && paging_is_user_range(addr, 1)) {
+            user_fault(exception_name(regs->int_no), regs->eip);
+        }
+    }
+    if (regs->int_no < 32 && from_user(regs)) {
+        user_fault(exception_name(regs->int_no), regs->eip);
+    }
     if (regs->int_no < 32) {
+        /* A fault during a quiet boot must still be seen */
+        terminal_set_quiet(false);
         terminal_setcolor(0x4F);
         terminal_writestring("\nException: ");
-        if (regs->int_no < 19) {
-            terminal_writestring(exception_messages[regs->int_no]);
-        } else {
-            terminal_writestring("Reserved");
-        }
+        terminal_writestring(exception_name(regs->int_no));
         terminal_writestring("\n");
+        terminal_flush();
+        serial_flush();
         for(;;);
     }
 }
 
+static irq_stats_t irq_stats[IRQ_LINES];
+/* Every CPU takes the APIC vectors, so each counts them in its own
+   slots and irq_get_stats() adds the CPUs up */
+static irq_stats_t apic_stats[MAX_CPUS][IRQ_STAT_SLOTS - IRQ_LINES];
+
+static irq_stats_t* apic_slot(uint32_t vector) {
+    irq_stats_t* slots = apic_stats[cpu_id()];
+    switch (vector) {
+        case APIC_VECTOR_TIMER:    return &slots[IRQ_APIC_TIMER - IRQ_LINES];
+        case APIC_VECTOR_RESCHED:  return &slots[IRQ_APIC_RESCHED - IRQ_LINES];
+        case APIC_VECTOR_SPURIOUS: return &slots[IRQ_APIC_SPURIOUS - IRQ_LINES];
+    }
+    return NULL;
+}
+
+/* Runs with interrupts off at the end of every IRQ: a few adds, two
+   compares and one bit scan. */
+static inline void irq_account(irq_stats_t* stats, uint64_t elapsed) {
+    uint32_t cycles = (elapsed >> 32) ? 0xFFFFFFFF : (uint32_t)elapsed;
+    uint32_t bucket = 0;
+    if (cycles >> (IRQ_HIST_SHIFT + 1)) {
+        bucket = (31 - __builtin_clz(cycles)) - IRQ_HIST_SHIFT;
+        if (bucket >= IRQ_HIST_BUCKETS) {
+            bucket = IRQ_HIST_BUCKETS - 1;
+        }
+    }
+
+    stats->count++;
+    stats->cycles += cycles;
+    if (cycles < stats->min_cycles) stats->min_cycles = cycles;
+    if (cycles > stats->max_cycles) stats->max_cycles = cycles;
+    stats->histogram[bucket]++;
+}
+
+/* Kernel tasks are scheduled cooperatively, but a user task caught by
+   a timer tick gives up its CPU, so a program that never makes a system
+   call cannot keep it */
+static void preempt_user(const registers_t* regs) {
+    if (from_user(regs)) {
+        task_yield();
+    }
+}
+
 void irq_handler(registers_t* regs) {
-    if (regs->int_no >= 40) {
-        outb(0xA0, 0x20);
-    }
-    outb(0x20, 0x20);
-    
-    if (regs->int_no == 32) {
-        extern void timer_handler(void);
-        timer_handler();
-    } else if (regs->int_no == 33) {
-        extern void keyboard_handler(void);
-        keyboard_handler();
+    uint64_t start = rdtsc();
+    uint8_t irq = regs->int_no - 32;
+
+    if (regs->int_no >= APIC_VECTOR_TIMER) {
+        irq_stats_t* stats = apic_slot(regs->int_no);
+        apic_handler(regs->int_no);
+        if (regs->int_no == APIC_VECTOR_SPURIOUS) {
+            stats->spurious++;
+            return;
+        }
+        if (stats) {
+            irq_account(stats, rdtsc() - start);
+        }
+        if (regs->int_no == APIC_VECTOR_TIMER) {
+            preempt_user(regs);
+        }
+        return;
+    }
+    if (irq >= IRQ_LINES) {
+        return;
+    }
+    if (pic_is_spurious(irq)) {
+        irq_stats[irq].spurious++;
+        return;
+    }
+
+    pic_send_eoi(irq);
+    if (irq == 0) {
+        profile_sample(regs->eip, regs->ebp);
+    }
+    irq_dispatch(irq);
+
+    irq_account(&irq_stats[irq], rdtsc() - start);
+    if (irq == 0) {
+        preempt_user(regs);
+    }
+}
+
+static void merge_stats(irq_stats_t* total, const irq_stats_t* cpu) {
+    total->count += cpu->count;
+    total->spurious += cpu->spurious;
+    total->cycles += cpu->cycles;
+    if (cpu->min_cycles < total->min_cycles) total->min_cycles = cpu->min_cycles;
+    if (cpu->max_cycles > total->max_cycles) total->max_cycles = cpu->max_cycles;
+    for (uint32_t b = 0; b < IRQ_HIST_BUCKETS; b++) {
+        total->histogram[b] += cpu->histogram[b];
+    }
+}
+
+static void clear_stats(irq_stats_t* stats) {
+    stats->count = 0;
+    stats->spurious = 0;
+    stats->cycles = 0;
+    stats->min_cycles = 0xFFFFFFFF;
+    stats->max_cycles = 0;
+    for (uint32_t b = 0; b < IRQ_HIST_BUCKETS; b++) {
+        stats->histogram[b] = 0;
+    }
+}
+
+/* Another CPU may be updating its APIC slots while they are summed */
+bool irq_get_stats(uint8_t irq, irq_stats_t* stats) {
+    if (irq >= IRQ_STAT_SLOTS) return false;
+    uint32_t flags = irq_save();
+    if (irq < IRQ_LINES) {
+        *stats = irq_stats[irq];
+    } else {
+        clear_stats(stats);
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            merge_stats(stats, &apic_stats[cpu][irq - IRQ_LINES]);
+        }
+    }
+    irq_restore(flags);
+    if (stats->count == 0) {
+        stats->min_cycles = 0;
+    }
+    return true;
+}
+
+void irq_reset_stats(void) {
+    uint32_t flags = irq_save();
+    for (uint32_t irq = 0; irq < IRQ_LINES; irq++) {
+        clear_stats(&irq_stats[irq]);
+    }
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (uint32_t slot = 0; slot < IRQ_STAT_SLOTS - IRQ_LINES; slot++) {
+            clear_stats(&apic_stats[cpu][slot]);
+        }
     }
+    irq_restore(flags);
 }
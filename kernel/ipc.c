@@ -0,0 +1,58 @@
+#include "ipc.h"
+#include "task.h"
+#include "cpu.h"
+#include "trace.h"
+
+/* Direct handoff: a receiver parked in ipc_recv() runs next instead of
+   waiting for its turn in the round robin. */
+static void wake_receiver(uint32_t receiver_pid) {
+    int32_t waiter = rust_ipc_take_waiter(receiver_pid);
+    if (waiter >= 0 && task_unblock((uint32_t)waiter)) {
+        task_switch_to((uint32_t)waiter);
+    }
+}
+
+bool ipc_send(uint8_t msg_type, uint32_t sender_pid, uint32_t receiver_pid, const void* data, size_t len) {
+    uint32_t flags = irq_save();
+    bool sent = rust_ipc_send(msg_type, sender_pid, receiver_pid, (const uint8_t*)data, len);
+    TRACE4(sent ? TRACE_DEBUG : TRACE_WARNING, TRACE_MOD_IPC, "send %u -> %u type %u len %u",
+           sender_pid, receiver_pid, msg_type, len);
+    if (sent) {
+        wake_receiver(receiver_pid);
+    }
+    irq_restore(flags);
+    return sent;
+}
+
+int32_t ipc_recv(uint32_t receiver_pid, ipc_message_info_t* info, void* buf, size_t buf_len) {
+    uint32_t flags = irq_save();
+    for (;;) {
+        int32_t received = rust_ipc_receive(receiver_pid, info, (uint8_t*)buf, buf_len);
+        if (received >= 0) {
+            irq_restore(flags);
+            return received;
+        }
+        if (!rust_ipc_park(receiver_pid, task_get_current())) {
+            /* Refused for a pending message, or there is no mailbox to
+               sleep on (PID 0, or every mailbox in use) */
+            if (rust_ipc_has_message(receiver_pid)) continue;
+            irq_restore(flags);
+            return -1;
+        }
+        task_block();
+        /* ipc_close() wakes the receiver too */
+        if (!rust_ipc_is_open(receiver_pid)) {
+            irq_restore(flags);
+            return -1;
+        }
+    }
+}
+
+void ipc_close(uint32_t pid) {
+    uint32_t flags = irq_save();
+    int32_t waiter = rust_ipc_close(pid);
+    if (waiter >= 0) {
+        task_unblock((uint32_t)waiter);
+    }
+    irq_restore(flags);
+}
@@ -0,0 +1,31 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define IPC_INLINE_SIZE 128
+
+#define IPC_MSG_DATA    1
+#define IPC_MSG_SIGNAL  2
+
+typedef struct {
+    uint8_t msg_type;
+    uint32_t sender_pid;
+    uint32_t length;
+} ipc_message_info_t;
+
+bool rust_ipc_send(uint8_t msg_type, uint32_t sender_pid, uint32_t receiver_pid, const uint8_t* data, size_t data_len);
+int32_t rust_ipc_receive(uint32_t receiver_pid, ipc_message_info_t* info, uint8_t* buf, size_t buf_len);
+bool rust_ipc_has_message(uint32_t receiver_pid);
+bool rust_ipc_park(uint32_t receiver_pid, uint32_t task_id);
+int32_t rust_ipc_take_waiter(uint32_t receiver_pid);
+int32_t rust_ipc_close(uint32_t pid);
+bool rust_ipc_is_open(uint32_t pid);
+
+bool ipc_send(uint8_t msg_type, uint32_t sender_pid, uint32_t receiver_pid, const void* data, size_t len);
+int32_t ipc_recv(uint32_t receiver_pid, ipc_message_info_t* info, void* buf, size_t buf_len);
+void ipc_close(uint32_t pid);
+
+#endif
@@ -1,14 +1,9 @@
 #include <stdint.h>
 #include "port.h"
 #include "idt.h"
-
-#define PIC1_COMMAND 0x20
-#define PIC1_DATA 0x21
-#define PIC2_COMMAND 0xA0
-#define PIC2_DATA 0xA1
-#define ICW1_INIT 0x10
-#define ICW1_ICW4 0x01
-#define ICW4_8086 0x01
+#include "irq.h"
+#include "pic.h"
+#include "cpu.h"
 
 extern void irq0(void);
 extern void irq1(void);
@@ -27,35 +22,87 @@ extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
 
+static void (* const irq_stubs[IRQ_LINES])(void) = {
+    irq0, irq1, irq2, irq3, irq4, irq5, irq6, irq7,
+    irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15,
+};
+
+typedef struct {
+    irq_handler_t handler;
+    void* ctx;
+} irq_action_t;
+
+/* Handlers of one line run in registration order. Lines with no handler
+   stay masked at the PIC, so they never interrupt. */
+static irq_action_t irq_actions[IRQ_LINES][IRQ_MAX_SHARED];
+static uint8_t irq_action_count[IRQ_LINES];
+
+bool irq_register(uint8_t irq, irq_handler_t handler, void* ctx) {
+    if (irq >= IRQ_LINES || irq == PIC_CASCADE_IRQ || handler == 0) {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    uint8_t count = irq_action_count[irq];
+    if (count == IRQ_MAX_SHARED) {
+        irq_restore(flags);
+        return false;
+    }
+    irq_actions[irq][count].handler = handler;
+    irq_actions[irq][count].ctx = ctx;
+    irq_action_count[irq] = count + 1;
+    if (count == 0) {
+        irq_clear_mask(irq);
+    }
+    irq_restore(flags);
+    return true;
+}
+
+bool irq_unregister(uint8_t irq, irq_handler_t handler, void* ctx) {
+    if (irq >= IRQ_LINES) {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    uint8_t count = irq_action_count[irq];
+    for (uint8_t i = 0; i < count; i++) {
+        if (irq_actions[irq][i].handler != handler || irq_actions[irq][i].ctx != ctx) {
+            continue;
+        }
+        for (uint8_t j = i + 1; j < count; j++) {
+            irq_actions[irq][j - 1] = irq_actions[irq][j];
+        }
+        irq_action_count[irq] = count - 1;
+        if (count == 1) {
+            irq_set_mask(irq);
+        }
+        irq_restore(flags);
+        return true;
+    }
+    irq_restore(flags);
+    return false;
+}
+
+/* Called by irq_handler() with interrupts off */
+void irq_dispatch(uint8_t irq) {
+    const irq_action_t* action = irq_actions[irq];
+    for (uint8_t i = irq_action_count[irq]; i > 0; i--, action++) {
+        action->handler(action->ctx);
+    }
+}
+
 void irq_remap(void) {
-    outb(PIC1_COMMAND, ICW1_INIT | ICW1_ICW4);
-    outb(PIC2_COMMAND, ICW1_INIT | ICW1_ICW4);
-    outb(PIC1_DATA, 0x20);
-    outb(PIC2_DATA, 0x28);
-    outb(PIC1_DATA, 0x04);
-    outb(PIC2_DATA, 0x02);
-    outb(PIC1_DATA, ICW4_8086);
-    outb(PIC2_DATA, ICW4_8086);
-    outb(PIC1_DATA, 0x0);
-    outb(PIC2_DATA, 0x0);
+    pic_remap(0x20, 0x28);
+    pic_mask_all();
 }
 
 void irq_install(void) {
     irq_remap();
-    idt_set_gate(32, (uint32_t)irq0, 0x08, 0x8E);
-    idt_set_gate(33, (uint32_t)irq1, 0x08, 0x8E);
-    idt_set_gate(34, (uint32_t)irq2, 0x08, 0x8E);
-    idt_set_gate(35, (uint32_t)irq3, 0x08, 0x8E);
-    idt_set_gate(36, (uint32_t)irq4, 0x08, 0x8E);
-    idt_set_gate(37, (uint32_t)irq5, 0x08, 0x8E);
-    idt_set_gate(38, (uint32_t)irq6, 0x08, 0x8E);
-    idt_set_gate(39, (uint32_t)irq7, 0x08, 0x8E);
-    idt_set_gate(40, (uint32_t)irq8, 0x08, 0x8E);
-    idt_set_gate(41, (uint32_t)irq9, 0x08, 0x8E);
-    idt_set_gate(42, (uint32_t)irq10, 0x08, 0x8E);
-    idt_set_gate(43, (uint32_t)irq11, 0x08, 0x8E);
-    idt_set_gate(44, (uint32_t)irq12, 0x08, 0x8E);
-    idt_set_gate(45, (uint32_t)irq13, 0x08, 0x8E);
-    idt_set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
-    idt_set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
+    irq_reset_stats();
+    for (uint8_t irq = 0; irq < IRQ_LINES; irq++) {
+        idt_set_gate(32 + irq, (uint32_t)irq_stubs[irq], 0x08, 0x8E);
+        if (irq_action_count[irq] != 0) {
+            irq_clear_mask(irq);
+        }
+    }
 }
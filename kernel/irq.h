@@ -1,7 +1,48 @@
 #ifndef IRQ_H
 #define IRQ_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IRQ_LINES      16
+#define IRQ_MAX_SHARED 4    /* handlers per line */
+
+/* Statistics slots after the PIC lines for the local APIC vectors */
+#define IRQ_APIC_TIMER    (IRQ_LINES + 0)
+#define IRQ_APIC_RESCHED  (IRQ_LINES + 1)
+#define IRQ_APIC_SPURIOUS (IRQ_LINES + 2)
+#define IRQ_STAT_SLOTS    (IRQ_LINES + 3)
+
+typedef void (*irq_handler_t)(void* ctx);
+
+/* Handler latency histogram: bucket 0 counts runs under
+   2^(IRQ_HIST_SHIFT + 1) TSC cycles, each later bucket doubles the
+   bound, and the last one is open-ended. */
+#define IRQ_HIST_BUCKETS 16
+#define IRQ_HIST_SHIFT   6
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint32_t spurious;  /* IRQ7/IRQ15 with no request in service, or
+                           the APIC spurious vector */
+    uint64_t cycles;    /* TSC cycles spent in the handler */
+    uint32_t histogram[IRQ_HIST_BUCKETS];
+} irq_stats_t;
+
 void irq_remap(void);
 void irq_install(void);
 
+/* Attach a handler to a line and unmask it. Several handlers may share
+   a line; each is called on every interrupt and must check its own
+   device. Returns false if the line is full or invalid. */
+bool irq_register(uint8_t irq, irq_handler_t handler, void* ctx);
+/* Detach a handler; the line is masked again once it has none. */
+bool irq_unregister(uint8_t irq, irq_handler_t handler, void* ctx);
+void irq_dispatch(uint8_t irq);
+
+bool irq_get_stats(uint8_t irq, irq_stats_t* stats);
+void irq_reset_stats(void);
+
 #endif
@@ -0,0 +1,40 @@
+#include <stddef.h>
+#include "ksyms.h"
+
+/* Weak so the first-pass link, which has no table yet, still resolves;
+   the table only adds .rodata, so text addresses match between passes. */
+extern const ksym_t ksyms_table[] __attribute__((weak));
+extern const uint32_t ksyms_count __attribute__((weak));
+
+extern char _text_start[];
+extern char _text_end[];
+
+bool ksym_available(void) {
+    return &ksyms_count != NULL && ksyms_count != 0;
+}
+
+bool ksym_is_text(uint32_t addr) {
+    return addr >= (uint32_t)_text_start && addr < (uint32_t)_text_end;
+}
+
+const char* ksym_lookup(uint32_t addr, uint32_t* start) {
+    if (!ksym_available() || !ksym_is_text(addr) || addr < ksyms_table[0].addr) {
+        return NULL;
+    }
+
+    uint32_t lo = 0;
+    uint32_t hi = ksyms_count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ksyms_table[mid].addr <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (start) {
+        *start = ksyms_table[lo].addr;
+    }
+    return ksyms_table[lo].name;
+}
@@ -0,0 +1,21 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* One text symbol of the kernel image. The table is generated from the
+   first-pass link by gen_ksyms.sh and linked into the final image, sorted
+   by address. */
+typedef struct {
+    uint32_t addr;
+    const char* name;
+} ksym_t;
+
+bool ksym_available(void);
+/* Name of the function containing addr, or NULL. *start receives the
+   symbol's address when start is not NULL. */
+const char* ksym_lookup(uint32_t addr, uint32_t* start);
+bool ksym_is_text(uint32_t addr);
+
+#endif
@@ -0,0 +1,288 @@
+#include <stddef.h>
+#include "lock.h"
+#include "cpu.h"
+#include "task.h"
+
+_Static_assert(sizeof(spinlock_t) == 24, "layout shared with sync.rs");
+_Static_assert(sizeof(rwlock_t) == 24, "layout shared with sync.rs");
+_Static_assert(sizeof(mutex_t) == 48, "layout shared with sync.rs");
+_Static_assert(MAX_TASKS <= 32, "mutex waiters are a 32-bit mask");
+
+typedef struct {
+    const char* name;
+    lock_kind_t kind;
+    lock_stats_t* stats;
+} lock_entry_t;
+
+static lock_entry_t registry[LOCK_REGISTRY_MAX];
+static uint32_t registry_count;
+static spinlock_t registry_lock;
+
+/* ---- Ticket spinlock ---- */
+
+void spin_init(spinlock_t* lock) {
+    lock->next = 0;
+    lock->owner = 0;
+    lock->stats.acquired = 0;
+    lock->stats.contended = 0;
+    lock->stats.wait_cycles = 0;
+}
+
+/* The stats are only written by the holder, so they need no atomics */
+void spin_lock(spinlock_t* lock) {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        uint64_t start = rdtsc();
+        while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+            cpu_relax();
+        }
+        lock->stats.contended++;
+        lock->stats.wait_cycles += rdtsc() - start;
+    }
+    lock->stats.acquired++;
+}
+
+/* Takes a ticket only if it would be served at once */
+bool spin_trylock(spinlock_t* lock) {
+    uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint32_t expected = owner;
+    if (!__atomic_compare_exchange_n(&lock->next, &expected, owner + 1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    lock->stats.acquired++;
+    return true;
+}
+
+void spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+/* ---- Reader-writer lock ---- */
+
+void rwlock_init(rwlock_t* lock) {
+    lock->count = 0;
+    lock->writers_waiting = 0;
+    lock->stats.acquired = 0;
+    lock->stats.contended = 0;
+    lock->stats.wait_cycles = 0;
+}
+
+/* Readers update the counters together, so theirs are atomic and they
+   do not add to wait_cycles (a 64-bit atomic add is a cmpxchg8b loop) */
+void read_lock(rwlock_t* lock) {
+    bool waited = false;
+    for (;;) {
+        int32_t count = __atomic_load_n(&lock->count, __ATOMIC_RELAXED);
+        if (count >= 0 && __atomic_load_n(&lock->writers_waiting, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&lock->count, &count, count + 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        waited = true;
+        cpu_relax();
+    }
+    __atomic_fetch_add(&lock->stats.acquired, 1, __ATOMIC_RELAXED);
+    if (waited) {
+        __atomic_fetch_add(&lock->stats.contended, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void read_unlock(rwlock_t* lock) {
+    __atomic_fetch_sub(&lock->count, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock_t* lock) {
+    int32_t expected = 0;
+    if (__atomic_compare_exchange_n(&lock->count, &expected, -1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&lock->stats.acquired, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint64_t start = rdtsc();
+    __atomic_fetch_add(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+    for (;;) {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&lock->count, &expected, -1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        cpu_relax();
+    }
+    __atomic_fetch_sub(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lock->stats.acquired, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lock->stats.contended, 1, __ATOMIC_RELAXED);
+    lock->stats.wait_cycles += rdtsc() - start;
+}
+
+void write_unlock(rwlock_t* lock) {
+    __atomic_store_n(&lock->count, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t read_lock_irqsave(rwlock_t* lock) {
+    uint32_t flags = irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+void read_unlock_irqrestore(rwlock_t* lock, uint32_t flags) {
+    read_unlock(lock);
+    irq_restore(flags);
+}
+
+uint32_t write_lock_irqsave(rwlock_t* lock) {
+    uint32_t flags = irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+void write_unlock_irqrestore(rwlock_t* lock, uint32_t flags) {
+    write_unlock(lock);
+    irq_restore(flags);
+}
+
+/* ---- Sleeping mutex ---- */
+
+void mutex_init(mutex_t* lock) {
+    lock->owner = 0;
+    lock->waiters = 0;
+    spin_init(&lock->wait_lock);
+    lock->stats.acquired = 0;
+    lock->stats.contended = 0;
+    lock->stats.wait_cycles = 0;
+}
+
+static bool mutex_try_acquire(mutex_t* lock, uint32_t self) {
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n(&lock->owner, &expected, self, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+bool mutex_trylock(mutex_t* lock) {
+    if (!mutex_try_acquire(lock, task_get_current() + 1)) {
+        return false;
+    }
+    lock->stats.acquired++;
+    return true;
+}
+
+/* A waiter sets its bit before its last try, and mutex_unlock() clears
+   owner before it looks at the bits, so either the try succeeds or the
+   unlock sees the bit. A wake-up that lands before task_block() is kept
+   as wake_pending, so it is not lost either. */
+void mutex_lock(mutex_t* lock) {
+    uint32_t tid = task_get_current();
+    uint32_t self = tid + 1;
+    uint32_t bit = 1u << tid;
+
+    if (mutex_try_acquire(lock, self)) {
+        lock->stats.acquired++;
+        return;
+    }
+
+    uint64_t start = rdtsc();
+    if (task_current_is_idle()) {
+        while (!mutex_try_acquire(lock, self)) {
+            task_yield();
+            cpu_relax();
+        }
+    } else {
+        for (;;) {
+            uint32_t flags = spin_lock_irqsave(&lock->wait_lock);
+            __atomic_fetch_or(&lock->waiters, bit, __ATOMIC_SEQ_CST);
+            bool acquired = mutex_try_acquire(lock, self);
+            if (acquired) {
+                __atomic_fetch_and(&lock->waiters, ~bit, __ATOMIC_RELAXED);
+            }
+            spin_unlock_irqrestore(&lock->wait_lock, flags);
+            if (acquired) {
+                break;
+            }
+            task_block();
+        }
+    }
+    lock->stats.acquired++;
+    lock->stats.contended++;
+    lock->stats.wait_cycles += rdtsc() - start;
+}
+
+void mutex_unlock(mutex_t* lock) {
+    __atomic_store_n(&lock->owner, 0, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&lock->waiters, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+
+    /* The woken task takes its bit out here and puts it back if another
+       task got the lock first */
+    int32_t next = -1;
+    uint32_t flags = spin_lock_irqsave(&lock->wait_lock);
+    uint32_t waiters = lock->waiters;
+    if (waiters) {
+        next = __builtin_ctz(waiters);
+        __atomic_fetch_and(&lock->waiters, ~(1u << next), __ATOMIC_RELAXED);
+    }
+    spin_unlock_irqrestore(&lock->wait_lock, flags);
+    if (next >= 0) {
+        task_unblock((uint32_t)next);
+    }
+}
+
+/* ---- Registry ---- */
+
+static void lock_register(const char* name, lock_kind_t kind, lock_stats_t* stats) {
+    uint32_t flags = spin_lock_irqsave(&registry_lock);
+    if (registry_count < LOCK_REGISTRY_MAX) {
+        registry[registry_count].name = name;
+        registry[registry_count].kind = kind;
+        registry[registry_count].stats = stats;
+        registry_count++;
+    }
+    spin_unlock_irqrestore(&registry_lock, flags);
+}
+
+void spin_register(spinlock_t* lock, const char* name) {
+    lock_register(name, LOCK_KIND_SPIN, &lock->stats);
+}
+
+void rwlock_register(rwlock_t* lock, const char* name) {
+    lock_register(name, LOCK_KIND_RW, &lock->stats);
+}
+
+void mutex_register(mutex_t* lock, const char* name) {
+    lock_register(name, LOCK_KIND_MUTEX, &lock->stats);
+}
+
+uint32_t lock_registry_count(void) {
+    return __atomic_load_n(&registry_count, __ATOMIC_ACQUIRE);
+}
+
+/* A snapshot, not taken under the lock it describes */
+bool lock_get_info(uint32_t index, lock_info_t* info) {
+    if (index >= lock_registry_count()) return false;
+    info->name = registry[index].name;
+    info->kind = registry[index].kind;
+    info->stats = *registry[index].stats;
+    return true;
+}
+
+/* Counters of a lock held right now may lose the update in flight */
+void lock_reset_stats(void) {
+    uint32_t count = lock_registry_count();
+    for (uint32_t i = 0; i < count; i++) {
+        registry[i].stats->acquired = 0;
+        registry[i].stats->contended = 0;
+        registry[i].stats->wait_cycles = 0;
+    }
+}
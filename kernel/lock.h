@@ -0,0 +1,149 @@
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counted by every lock and shown by the shell's "lockstat" command.
+   wait_cycles is TSC time spent waiting by contended acquisitions. */
+typedef struct {
+    uint32_t acquired;
+    uint32_t contended;
+    uint64_t wait_cycles;
+} lock_stats_t;
+
+/* Ticket lock: CPUs get the lock in the order they asked for it. The
+   plain variants leave the interrupt flag alone, so a lock also taken
+   by an interrupt handler must be held with the _irqsave variants.
+   All-zero is unlocked, so static locks need no init call. Layout is
+   shared with rust_module/src/sync.rs. */
+typedef struct {
+    volatile uint32_t next;     /* next ticket to hand out */
+    volatile uint32_t owner;    /* ticket being served */
+    lock_stats_t stats;
+} spinlock_t;
+
+/* Spinning reader-writer lock. Readers share it, a writer is alone. A
+   waiting writer stops new readers from entering, so a stream of
+   readers cannot starve it. Not recursive: a reader that takes it again
+   while a writer waits deadlocks. */
+typedef struct {
+    volatile int32_t count;             /* readers inside, or -1 for a writer */
+    volatile uint32_t writers_waiting;
+    lock_stats_t stats;
+} rwlock_t;
+
+/* Sleeping lock for task context. A task that finds it held blocks
+   through the scheduler until the owner unlocks; the lowest waiting
+   task ID is woken first. Must not be taken in an interrupt handler.
+   An idle task cannot block, so it yields until the lock is free. */
+typedef struct {
+    volatile uint32_t owner;        /* task ID + 1, 0 when free */
+    volatile uint32_t waiters;      /* bit per waiting task ID */
+    spinlock_t wait_lock;
+    lock_stats_t stats;
+} mutex_t;
+
+#define SPINLOCK_INIT { 0, 0, { 0, 0, 0 } }
+#define RWLOCK_INIT   { 0, 0, { 0, 0, 0 } }
+#define MUTEX_INIT    { 0, 0, SPINLOCK_INIT, { 0, 0, 0 } }
+
+void spin_init(spinlock_t* lock);
+void spin_lock(spinlock_t* lock);
+bool spin_trylock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+uint32_t spin_lock_irqsave(spinlock_t* lock);
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags);
+
+void rwlock_init(rwlock_t* lock);
+void read_lock(rwlock_t* lock);
+void read_unlock(rwlock_t* lock);
+void write_lock(rwlock_t* lock);
+void write_unlock(rwlock_t* lock);
+uint32_t read_lock_irqsave(rwlock_t* lock);
+void read_unlock_irqrestore(rwlock_t* lock, uint32_t flags);
+uint32_t write_lock_irqsave(rwlock_t* lock);
+void write_unlock_irqrestore(rwlock_t* lock, uint32_t flags);
+
+void mutex_init(mutex_t* lock);
+void mutex_lock(mutex_t* lock);
+bool mutex_trylock(mutex_t* lock);
+void mutex_unlock(mutex_t* lock);
+
+/* Named locks for "lockstat". name must stay valid; registering more
+   than LOCK_REGISTRY_MAX locks drops the extras. */
+#define LOCK_REGISTRY_MAX 32
+
+typedef enum {
+    LOCK_KIND_SPIN,
+    LOCK_KIND_RW,
+    LOCK_KIND_MUTEX,
+} lock_kind_t;
+
+typedef struct {
+    const char* name;
+    lock_kind_t kind;
+    lock_stats_t stats;
+} lock_info_t;
+
+void spin_register(spinlock_t* lock, const char* name);
+void rwlock_register(rwlock_t* lock, const char* name);
+void mutex_register(mutex_t* lock, const char* name);
+uint32_t lock_registry_count(void);
+bool lock_get_info(uint32_t index, lock_info_t* info);
+void lock_reset_stats(void);
+
+#ifdef __cplusplus
+}
+
+/* Scoped holders for C++ code. Each one takes the lock in its
+   constructor and releases it when it goes out of scope. */
+class SpinLockGuard {
+public:
+    explicit SpinLockGuard(spinlock_t& lock) : lock_(lock), flags_(spin_lock_irqsave(&lock)) {}
+    ~SpinLockGuard() { spin_unlock_irqrestore(&lock_, flags_); }
+    SpinLockGuard(const SpinLockGuard&) = delete;
+    SpinLockGuard& operator=(const SpinLockGuard&) = delete;
+private:
+    spinlock_t& lock_;
+    uint32_t flags_;
+};
+
+class ReadLockGuard {
+public:
+    explicit ReadLockGuard(rwlock_t& lock) : lock_(lock), flags_(read_lock_irqsave(&lock)) {}
+    ~ReadLockGuard() { read_unlock_irqrestore(&lock_, flags_); }
+    ReadLockGuard(const ReadLockGuard&) = delete;
+    ReadLockGuard& operator=(const ReadLockGuard&) = delete;
+private:
+    rwlock_t& lock_;
+    uint32_t flags_;
+};
+
+class WriteLockGuard {
+public:
+    explicit WriteLockGuard(rwlock_t& lock) : lock_(lock), flags_(write_lock_irqsave(&lock)) {}
+    ~WriteLockGuard() { write_unlock_irqrestore(&lock_, flags_); }
+    WriteLockGuard(const WriteLockGuard&) = delete;
+    WriteLockGuard& operator=(const WriteLockGuard&) = delete;
+private:
+    rwlock_t& lock_;
+    uint32_t flags_;
+};
+
+class MutexGuard {
+public:
+    explicit MutexGuard(mutex_t& lock) : lock_(lock) { mutex_lock(&lock); }
+    ~MutexGuard() { mutex_unlock(&lock_); }
+    MutexGuard(const MutexGuard&) = delete;
+    MutexGuard& operator=(const MutexGuard&) = delete;
+private:
+    mutex_t& lock_;
+};
+#endif
+
+#endif
@@ -14,9 +14,14 @@ typedef struct {
     uint32_t present    : 1;
     uint32_t rw         : 1;
     uint32_t user       : 1;
+    uint32_t write_through : 1;
+    uint32_t cache_disable : 1;
     uint32_t accessed   : 1;
     uint32_t dirty      : 1;
-    uint32_t unused     : 7;
+    uint32_t pat        : 1;
+    uint32_t global     : 1;
+    uint32_t owned      : 1;    /* available to software: freed with the directory */
+    uint32_t unused     : 2;
     uint32_t frame      : 20;
 } page_t;
 
@@ -24,10 +29,12 @@ typedef struct {
     page_t pages[1024];
 } page_table_t;
 
+/* tables_physical is what CR3 points at, so the structure is page
+   aligned */
 typedef struct {
     uint32_t tables_physical[1024];
     page_table_t* tables[1024];
     uint32_t physical_addr;
-} page_directory_t;
+} __attribute__((aligned(4096))) page_directory_t;
 
 #endif
@@ -1,12 +1,35 @@
 #include "paging.h"
 #include <stddef.h>
+#include "cpu.h"
+#include "percpu.h"
+#include "lock.h"
+#include "string.h"
 
-static page_directory_t kernel_directory __attribute__((aligned(4096)));
-static page_table_t kernel_tables[1024] __attribute__((aligned(4096)));
-static page_directory_t* current_directory = NULL;
+#define PDE_LARGE 0x080                 /* 4 MB page */
+#define PDE_GLOBAL 0x100
+#define PDE_CACHE_DISABLE 0x010
 
+#define CR4_PSE 0x10
+#define CR4_PGE 0x80
+
+#define USER_PDE_FIRST (PAGING_USER_BASE >> 22)
+#define USER_PDE_END (PAGING_USER_TOP >> 22)
+#define DEVICE_PDE_FIRST (0xC0000000 >> 22)     /* local APIC, I/O APIC */
+
+extern uint32_t rust_allocate_page(void);
+extern void rust_free_page(uint32_t page);
 extern void paging_enable(uint32_t page_directory);
 
+static page_directory_t kernel_directory;
+static page_directory_t directories[PAGING_MAX_DIRECTORIES];
+static bool directory_used[PAGING_MAX_DIRECTORIES];
+static spinlock_t directory_lock = SPINLOCK_INIT;
+
+/* NULL while a kernel task runs on that CPU */
+static page_directory_t* current_directory[MAX_CPUS];
+static bool enabled = false;
+static uint32_t cr4_bits;
+
 static uint32_t get_page_directory_index(uint32_t virtual_addr) {
     return virtual_addr >> 22;
 }
@@ -15,71 +38,188 @@ static uint32_t get_page_table_index(uint32_t virtual_addr) {
     return (virtual_addr >> 12) & 0x3FF;
 }
 
-void paging_init(void) {
-    for (int i = 0; i < 1024; i++) {
-        kernel_directory.tables_physical[i] = 0;
+static inline void flush_tlb_entry(uint32_t virtual_addr) {
+    __asm__ volatile("invlpg (%0)" : : "r"(virtual_addr) : "memory");
+}
+
+static inline void load_cr3(uint32_t physical) {
+    __asm__ volatile("mov %0, %%cr3" : : "r"(physical) : "memory");
+}
+
+/* One directory page covers all 4 GB with 4 MB pages, so there are no
+   kernel page tables to fill or share. Kernel pages are global when the
+   CPU allows it and survive the CR3 reload on every user task switch. */
+bool paging_init(void) {
+    if (!cpu_has(CPU_FEATURE_PSE)) {
+        return false;
+    }
+
+    uint32_t global = cpu_has(CPU_FEATURE_PGE) ? PDE_GLOBAL : 0;
+    for (uint32_t i = 0; i < 1024; i++) {
         kernel_directory.tables[i] = NULL;
+        if (i >= USER_PDE_FIRST && i < USER_PDE_END) {
+            kernel_directory.tables_physical[i] = 0;
+            continue;
+        }
+        uint32_t pde = (i << 22) | PAGE_PRESENT | PAGE_WRITE | PDE_LARGE | global;
+        if (i >= DEVICE_PDE_FIRST) {
+            pde |= PDE_CACHE_DISABLE;
+        }
+        kernel_directory.tables_physical[i] = pde;
+    }
+    kernel_directory.physical_addr = (uint32_t)kernel_directory.tables_physical;
+
+    cr4_bits = CR4_PSE | (global ? CR4_PGE : 0);
+    enabled = true;
+    paging_init_cpu();
+    return true;
+}
+
+void paging_init_cpu(void) {
+    if (!enabled) return;
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= cr4_bits;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+    paging_enable(kernel_directory.physical_addr);
+}
+
+bool paging_enabled(void) {
+    return enabled;
+}
+
+/* Starts as a copy of the kernel directory with an empty user window */
+page_directory_t* paging_create_directory(void) {
+    if (!enabled) return NULL;
+
+    page_directory_t* directory = NULL;
+    uint32_t flags = spin_lock_irqsave(&directory_lock);
+    for (uint32_t i = 0; i < PAGING_MAX_DIRECTORIES; i++) {
+        if (!directory_used[i]) {
+            directory_used[i] = true;
+            directory = &directories[i];
+            break;
+        }
     }
-    
-    for (int i = 0; i < 1024; i++) {
-        for (int j = 0; j < 1024; j++) {
-            kernel_tables[i].pages[j].present = 0;
-            kernel_tables[i].pages[j].rw = 1;
-            kernel_tables[i].pages[j].user = 0;
-            kernel_tables[i].pages[j].frame = 0;
+    spin_unlock_irqrestore(&directory_lock, flags);
+    if (!directory) return NULL;
+
+    memcpy(directory->tables_physical, kernel_directory.tables_physical,
+           sizeof(directory->tables_physical));
+    memset(directory->tables, 0, sizeof(directory->tables));
+    directory->physical_addr = (uint32_t)directory->tables_physical;
+    return directory;
+}
+
+/* Frees the user page tables and every frame mapped with PAGE_OWNED */
+void paging_destroy_directory(page_directory_t* directory) {
+    for (uint32_t i = USER_PDE_FIRST; i < USER_PDE_END; i++) {
+        page_table_t* table = directory->tables[i];
+        if (!table) continue;
+        for (uint32_t j = 0; j < 1024; j++) {
+            if (table->pages[j].present && table->pages[j].owned) {
+                rust_free_page(table->pages[j].frame << 12);
+            }
         }
-        kernel_directory.tables[i] = &kernel_tables[i];
-        kernel_directory.tables_physical[i] = ((uint32_t)&kernel_tables[i]) | PAGE_PRESENT | PAGE_WRITE;
+        rust_free_page((uint32_t)table);
+        directory->tables[i] = NULL;
+        directory->tables_physical[i] = 0;
     }
-    
-    current_directory = &kernel_directory;
-    paging_enable((uint32_t)kernel_directory.tables_physical);
+
+    uint32_t flags = spin_lock_irqsave(&directory_lock);
+    directory_used[paging_directory_id(directory)] = false;
+    spin_unlock_irqrestore(&directory_lock, flags);
+}
+
+uint32_t paging_directory_id(const page_directory_t* directory) {
+    return (uint32_t)(directory - directories);
 }
 
-void paging_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+/* Called on every task switch with interrupts off; NULL loads the kernel
+   directory */
+void paging_switch_directory(page_directory_t* directory) {
+    if (!enabled) return;
+    uint32_t cpu = cpu_id();
+    if (current_directory[cpu] == directory) return;
+    current_directory[cpu] = directory;
+    load_cr3(directory ? directory->physical_addr : kernel_directory.physical_addr);
+}
+
+page_directory_t* paging_get_current_directory(void) {
+    return enabled ? current_directory[cpu_id()] : NULL;
+}
+
+bool paging_is_user_range(uint32_t addr, uint32_t size) {
+    return addr >= PAGING_USER_BASE && addr < PAGING_USER_TOP && size <= PAGING_USER_TOP - addr;
+}
+
+/* Page tables are allocated on first use. The entry is built aside and
+   stored whole so a concurrent walk never sees it half written. */
+bool paging_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    page_directory_t* directory = paging_get_current_directory();
+    if (!directory || !paging_is_user_range(virtual_addr, PAGE_SIZE)) {
+        return false;
+    }
+
     uint32_t pd_index = get_page_directory_index(virtual_addr);
     uint32_t pt_index = get_page_table_index(virtual_addr);
-    
-    if (current_directory->tables[pd_index] == NULL) {
-        return;
+
+    page_table_t* table = directory->tables[pd_index];
+    if (table == NULL) {
+        uint32_t frame = rust_allocate_page();
+        if (frame == 0) {
+            return false;
+        }
+        memset((void*)frame, 0, PAGE_SIZE);
+        table = (page_table_t*)frame;
+        directory->tables[pd_index] = table;
+        directory->tables_physical[pd_index] = frame | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
     }
-    
-    page_t* page = &current_directory->tables[pd_index]->pages[pt_index];
-    page->present = (flags & PAGE_PRESENT) ? 1 : 0;
-    page->rw = (flags & PAGE_WRITE) ? 1 : 0;
-    page->user = (flags & PAGE_USER) ? 1 : 0;
-    page->frame = physical_addr >> 12;
+
+    page_t page = { 0 };
+    page.present = (flags & PAGE_PRESENT) ? 1 : 0;
+    page.rw = (flags & PAGE_WRITE) ? 1 : 0;
+    page.user = (flags & PAGE_USER) ? 1 : 0;
+    page.owned = (flags & PAGE_OWNED) ? 1 : 0;
+    page.frame = physical_addr >> 12;
+    table->pages[pt_index] = page;
+    flush_tlb_entry(virtual_addr);
+    return true;
 }
 
+/* Only drops the mapping: the frame may now belong to someone else */
 void paging_unmap_page(uint32_t virtual_addr) {
-    uint32_t pd_index = get_page_directory_index(virtual_addr);
-    uint32_t pt_index = get_page_table_index(virtual_addr);
-    
-    if (current_directory->tables[pd_index] == NULL) {
+    page_directory_t* directory = paging_get_current_directory();
+    if (!directory || !paging_is_user_range(virtual_addr, PAGE_SIZE)) {
+        return;
+    }
+
+    page_table_t* table = directory->tables[get_page_directory_index(virtual_addr)];
+    if (table == NULL) {
         return;
     }
-    
-    page_t* page = &current_directory->tables[pd_index]->pages[pt_index];
-    page->present = 0;
-    page->frame = 0;
+
+    page_t page = { 0 };
+    table->pages[get_page_table_index(virtual_addr)] = page;
+    flush_tlb_entry(virtual_addr);
 }
 
+/* Outside the user window every address maps to itself */
 uint32_t paging_get_physical_address(uint32_t virtual_addr) {
-    uint32_t pd_index = get_page_directory_index(virtual_addr);
-    uint32_t pt_index = get_page_table_index(virtual_addr);
-    
-    if (current_directory->tables[pd_index] == NULL) {
+    page_directory_t* directory = paging_get_current_directory();
+    if (!directory || !paging_is_user_range(virtual_addr, 1)) {
+        return virtual_addr;
+    }
+
+    page_table_t* table = directory->tables[get_page_directory_index(virtual_addr)];
+    if (table == NULL) {
         return 0;
     }
-    
-    page_t* page = &current_directory->tables[pd_index]->pages[pt_index];
+
+    page_t* page = &table->pages[get_page_table_index(virtual_addr)];
     if (!page->present) {
         return 0;
     }
-    
-    return (page->frame << 12) | (virtual_addr & 0xFFF);
-}
 
-page_directory_t* paging_get_current_directory(void) {
-    return current_directory;
+    return (page->frame << 12) | (virtual_addr & 0xFFF);
 }
@@ -2,16 +2,42 @@
 #define PAGING_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "memory.h"
 
 #define PAGE_PRESENT 0x1
 #define PAGE_WRITE 0x2
 #define PAGE_USER 0x4
+#define PAGE_OWNED 0x200        /* frame is freed with its directory */
 
-void paging_init(void);
-void paging_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
+/* Every directory maps all memory 1:1 for the kernel with 4 MB pages,
+   except this window, which holds the pages of the directory's user
+   process */
+#define PAGING_USER_BASE 0x40000000
+#define PAGING_USER_TOP 0x80000000
+#define PAGING_MAX_DIRECTORIES 8
+
+/* paging_init() builds the kernel directory and turns paging on for the
+   BSP; false if the CPU has no 4 MB pages. Each AP then calls
+   paging_init_cpu(). */
+bool paging_init(void);
+void paging_init_cpu(void);
+bool paging_enabled(void);
+
+/* User address spaces. A directory is created for a process, switched
+   to whenever its task runs, and destroyed once no CPU has it loaded.
+   The current directory is NULL while a kernel task runs. */
+page_directory_t* paging_create_directory(void);
+void paging_destroy_directory(page_directory_t* directory);
+uint32_t paging_directory_id(const page_directory_t* directory);
+void paging_switch_directory(page_directory_t* directory);
+page_directory_t* paging_get_current_directory(void);
+bool paging_is_user_range(uint32_t addr, uint32_t size);
+
+/* These work on the current directory's user window, and only from the
+   task that owns it */
+bool paging_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
 void paging_unmap_page(uint32_t virtual_addr);
 uint32_t paging_get_physical_address(uint32_t virtual_addr);
-page_directory_t* paging_get_current_directory(void);
 
 #endif
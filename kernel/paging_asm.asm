@@ -1,6 +1,9 @@
 section .text
 global paging_enable
 
+; void paging_enable(uint32_t page_directory)
+; Loads CR3 and sets CR0.PG and CR0.WP, so ring 0 also honours read-only
+; user pages
 paging_enable:
     push ebp
     mov ebp, esp
@@ -9,7 +12,7 @@ paging_enable:
     mov cr3, eax
     
     mov eax, cr0
-    or eax, 0x80000000
+    or eax, 0x80010000
     mov cr0, eax
     
     pop ebp
@@ -0,0 +1,47 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_CPUS 8
+
+/* One per CPU, reached through a GS segment whose base is the structure
+   itself, so this_cpu() is a single load. Modules keep their own per-CPU
+   state in arrays indexed by id. */
+typedef struct cpu {
+    struct cpu* self;           /* must stay first: read as %gs:0 */
+    uint32_t id;
+    uint32_t apic_id;
+    uint32_t current;           /* running task */
+    volatile uint32_t ticks;    /* local APIC timer ticks */
+    volatile bool online;
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    __asm__ volatile("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+static inline uint32_t cpu_id(void) {
+    return this_cpu()->id;
+}
+
+static inline bool cpu_online(uint32_t id) {
+    return id < MAX_CPUS && __atomic_load_n(&cpus[id].online, __ATOMIC_ACQUIRE);
+}
+
+/* Fills the per-CPU GDT descriptors and points the BSP's GS at cpus[0].
+   Must run right after gdt_install(), before anything calls this_cpu(). */
+void percpu_init(void);
+
+/* Loads GS and the task register for cpus[id] on the calling CPU */
+void percpu_load(uint32_t id);
+
+/* Out-of-line cpu_id() for Rust */
+uint32_t percpu_id(void);
+
+#endif
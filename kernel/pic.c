@@ -1,5 +1,6 @@
 #include "pic.h"
 #include "port.h"
+#include "cpu.h"
 
 void pic_remap(uint8_t offset1, uint8_t offset2) {
     uint8_t mask1 = inb(PIC1_DATA);
@@ -29,37 +30,71 @@ void pic_remap(uint8_t offset1, uint8_t offset2) {
     outb(PIC2_DATA, mask2);
 }
 
+/* Specific EOI clears exactly the line being serviced. A slave line
+   also needs the master's cascade line acknowledged. */
 void pic_send_eoi(uint8_t irq) {
     if (irq >= 8) {
-        outb(PIC2_COMMAND, PIC_EOI);
+        outb(PIC2_COMMAND, PIC_SPECIFIC_EOI | (irq - 8));
+        outb(PIC1_COMMAND, PIC_SPECIFIC_EOI | PIC_CASCADE_IRQ);
+    } else {
+        outb(PIC1_COMMAND, PIC_SPECIFIC_EOI | irq);
     }
-    outb(PIC1_COMMAND, PIC_EOI);
 }
 
+uint16_t pic_read_isr(void) {
+    outb(PIC1_COMMAND, PIC_READ_ISR);
+    outb(PIC2_COMMAND, PIC_READ_ISR);
+    return (inb(PIC2_COMMAND) << 8) | inb(PIC1_COMMAND);
+}
+
+/* IRQ7 and IRQ15 also fire when a request goes away before the CPU
+   acknowledges it. The in-service bit is clear then, and the line must
+   not get an EOI; a spurious IRQ15 still needs one for the cascade. */
+bool pic_is_spurious(uint8_t irq) {
+    if (irq != 7 && irq != 15) {
+        return false;
+    }
+    if (pic_read_isr() & (1 << irq)) {
+        return false;
+    }
+    if (irq == 15) {
+        outb(PIC1_COMMAND, PIC_SPECIFIC_EOI | PIC_CASCADE_IRQ);
+    }
+    return true;
+}
+
+/* Cached so masking a line needs no port read */
+static uint16_t pic_mask = 0xFFFF;
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, pic_mask & 0xFF);
+    outb(PIC2_DATA, pic_mask >> 8);
+}
+
+void pic_mask_all(void) {
+    uint32_t flags = irq_save();
+    pic_mask = 0xFFFF;
+    pic_write_mask();
+    irq_restore(flags);
+}
+
+/* The cascade line is open only while some slave line is */
 void irq_set_mask(uint8_t irq_line) {
-    uint16_t port;
-    uint8_t value;
-    
-    if (irq_line < 8) {
-        port = PIC1_DATA;
-    } else {
-        port = PIC2_DATA;
-        irq_line -= 8;
+    uint32_t flags = irq_save();
+    pic_mask |= 1 << irq_line;
+    if ((pic_mask & 0xFF00) == 0xFF00) {
+        pic_mask |= 1 << PIC_CASCADE_IRQ;
     }
-    value = inb(port) | (1 << irq_line);
-    outb(port, value);
+    pic_write_mask();
+    irq_restore(flags);
 }
 
 void irq_clear_mask(uint8_t irq_line) {
-    uint16_t port;
-    uint8_t value;
-    
-    if (irq_line < 8) {
-        port = PIC1_DATA;
-    } else {
-        port = PIC2_DATA;
-        irq_line -= 8;
+    uint32_t flags = irq_save();
+    pic_mask &= ~(1 << irq_line);
+    if (irq_line >= 8) {
+        pic_mask &= ~(1 << PIC_CASCADE_IRQ);
     }
-    value = inb(port) & ~(1 << irq_line);
-    outb(port, value);
+    pic_write_mask();
+    irq_restore(flags);
 }
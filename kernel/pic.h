@@ -2,6 +2,7 @@
 #define PIC_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define PIC1 0x20
 #define PIC2 0xA0
@@ -10,7 +11,10 @@
 #define PIC2_COMMAND PIC2
 #define PIC2_DATA (PIC2 + 1)
 
-#define PIC_EOI 0x20
+#define PIC_EOI          0x20
+#define PIC_SPECIFIC_EOI 0x60
+#define PIC_READ_ISR     0x0B
+#define PIC_CASCADE_IRQ  2
 
 #define ICW1_ICW4 0x01
 #define ICW1_INIT 0x10
@@ -18,6 +22,9 @@
 
 void pic_remap(uint8_t offset1, uint8_t offset2);
 void pic_send_eoi(uint8_t irq);
+uint16_t pic_read_isr(void);
+bool pic_is_spurious(uint8_t irq);
+void pic_mask_all(void);
 void irq_set_mask(uint8_t irq_line);
 void irq_clear_mask(uint8_t irq_line);
 
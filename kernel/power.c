@@ -3,6 +3,7 @@
 
 #define ACPI_POWER_OFF 0x2000
 #define QEMU_SHUTDOWN_PORT 0x604
+#define QEMU_DEBUG_EXIT_PORT 0xF4
 
 void acpi_power_off(void) {
     outw(QEMU_SHUTDOWN_PORT, ACPI_POWER_OFF);
@@ -24,3 +25,8 @@ void halt(void) {
     __asm__ volatile("cli");
     for (;;) __asm__ volatile("hlt");
 }
+
+void qemu_debug_exit(uint8_t code) {
+    outb(QEMU_DEBUG_EXIT_PORT, code);
+    acpi_power_off();
+}
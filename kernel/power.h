@@ -1,8 +1,14 @@
 #ifndef POWER_H
 #define POWER_H
 
+#include <stdint.h>
+
 void acpi_power_off(void);
 void reboot(void);
 void halt(void);
 
+/* Leaves QEMU started with -device isa-debug-exit,iobase=0xf4; QEMU
+   exits with status (code << 1) | 1. Powers off without the device. */
+void qemu_debug_exit(uint8_t code);
+
 #endif
@@ -0,0 +1,209 @@
+#include <stddef.h>
+#include "profile.h"
+#include "ksyms.h"
+#include "timer.h"
+#include "serial.h"
+#include "cpu.h"
+
+#define PROFILE_MASK (PROFILE_SLOTS - 1)
+#define PROFILE_PROBES 16
+
+_Static_assert((PROFILE_SLOTS & PROFILE_MASK) == 0, "profile table size must be a power of two");
+
+/* pcs[0] is the sampled EIP, later entries are return addresses from
+   the frame-pointer chain, innermost first. */
+typedef struct {
+    uint32_t count;
+    uint32_t depth;
+    uint32_t pcs[PROFILE_MAX_DEPTH];
+} profile_slot_t;
+
+static profile_slot_t slots[PROFILE_SLOTS];
+static uint32_t slots_used;
+static uint32_t samples;
+static uint32_t dropped;
+static uint32_t profile_flags;
+static volatile bool running;
+
+static profile_func_t top_funcs[PROFILE_TOP_MAX];
+
+extern char _bss_start[];
+extern char _bss_end[];
+
+/* Every kernel stack (boot stack and task stacks) lives in .bss; a frame
+   pointer outside it, or one that does not move up the stack, ends the
+   walk. Code built without -fno-omit-frame-pointer uses EBP freely, so
+   this is what keeps a bogus chain from faulting. */
+static bool frame_ok(uint32_t fp, uint32_t prev) {
+    return (fp & 3) == 0 && fp > prev &&
+           fp >= (uint32_t)_bss_start && fp + 8 <= (uint32_t)_bss_end;
+}
+
+static uint32_t hash_stack(const uint32_t* pcs, uint32_t depth) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < depth; i++) {
+        h = (h ^ pcs[i]) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+void profile_sample(uint32_t eip, uint32_t ebp) {
+    if (!running) {
+        return;
+    }
+
+    uint32_t pcs[PROFILE_MAX_DEPTH];
+    uint32_t depth = 0;
+    pcs[depth++] = eip;
+
+    if (profile_flags & PROFILE_BACKTRACE) {
+        uint32_t fp = ebp;
+        uint32_t prev = 0;
+        while (depth < PROFILE_MAX_DEPTH && frame_ok(fp, prev)) {
+            uint32_t ret = ((uint32_t*)fp)[1];
+            if (!ksym_is_text(ret)) {
+                break;
+            }
+            pcs[depth++] = ret;
+            prev = fp;
+            fp = ((uint32_t*)fp)[0];
+        }
+    }
+
+    samples++;
+    uint32_t h = hash_stack(pcs, depth);
+    for (uint32_t probe = 0; probe < PROFILE_PROBES; probe++) {
+        profile_slot_t* slot = &slots[(h + probe) & PROFILE_MASK];
+        if (slot->count == 0) {
+            slot->depth = depth;
+            for (uint32_t i = 0; i < depth; i++) {
+                slot->pcs[i] = pcs[i];
+            }
+            slot->count = 1;
+            slots_used++;
+            return;
+        }
+        if (slot->depth != depth) {
+            continue;
+        }
+        uint32_t i = 0;
+        while (i < depth && slot->pcs[i] == pcs[i]) {
+            i++;
+        }
+        if (i == depth) {
+            slot->count++;
+            return;
+        }
+    }
+    dropped++;
+}
+
+void profile_start(uint32_t flags, uint32_t oversample) {
+    profile_flags = flags;
+    timer_set_oversample(oversample);
+    running = true;
+}
+
+void profile_stop(void) {
+    running = false;
+    timer_set_oversample(1);
+}
+
+void profile_clear(void) {
+    uint32_t flags = irq_save();
+    for (uint32_t i = 0; i < PROFILE_SLOTS; i++) {
+        slots[i].count = 0;
+    }
+    slots_used = 0;
+    samples = 0;
+    dropped = 0;
+    irq_restore(flags);
+}
+
+void profile_get_stats(profile_stats_t* stats) {
+    stats->samples = samples;
+    stats->dropped = dropped;
+    stats->stacks = slots_used;
+    stats->rate = timer_get_interrupt_rate();
+    stats->running = running;
+}
+
+/* Readers pause sampling rather than copying the table, so a long
+   serial dump never holds interrupts off. */
+static bool profile_pause(void) {
+    bool was_running = running;
+    running = false;
+    return was_running;
+}
+
+uint32_t profile_top(profile_func_t* out, uint32_t max) {
+    bool was_running = profile_pause();
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < PROFILE_SLOTS; i++) {
+        if (slots[i].count == 0) continue;
+        uint32_t addr = slots[i].pcs[0];
+        const char* name = ksym_lookup(addr, &addr);
+
+        uint32_t f = 0;
+        while (f < count && top_funcs[f].addr != addr) {
+            f++;
+        }
+        if (f == count) {
+            if (count == PROFILE_TOP_MAX) continue;
+            top_funcs[count].name = name;
+            top_funcs[count].addr = addr;
+            top_funcs[count].samples = 0;
+            count++;
+        }
+        top_funcs[f].samples += slots[i].count;
+    }
+    running = was_running;
+
+    /* Selection sort of the first max entries */
+    if (max > count) {
+        max = count;
+    }
+    for (uint32_t i = 0; i < max; i++) {
+        uint32_t best = i;
+        for (uint32_t j = i + 1; j < count; j++) {
+            if (top_funcs[j].samples > top_funcs[best].samples) {
+                best = j;
+            }
+        }
+        profile_func_t tmp = top_funcs[i];
+        top_funcs[i] = top_funcs[best];
+        top_funcs[best] = tmp;
+        out[i] = top_funcs[i];
+    }
+    return max;
+}
+
+static void dump_frame(uint32_t pc) {
+    const char* name = ksym_lookup(pc, NULL);
+    if (name) {
+        serial_write(name);
+    } else {
+        serial_write_hex(pc);
+    }
+}
+
+void profile_dump_serial(void) {
+    bool was_running = profile_pause();
+
+    serial_write("--- profile begin ---\n");
+    for (uint32_t i = 0; i < PROFILE_SLOTS; i++) {
+        const profile_slot_t* slot = &slots[i];
+        if (slot->count == 0) continue;
+        for (uint32_t d = slot->depth; d > 0; d--) {
+            /* Return addresses may point just past a function's end */
+            dump_frame(d > 1 ? slot->pcs[d - 1] - 1 : slot->pcs[0]);
+            serial_putchar(d > 1 ? ';' : ' ');
+        }
+        serial_write_dec(slot->count);
+        serial_putchar('\n');
+    }
+    serial_write("--- profile end ---\n");
+
+    running = was_running;
+}
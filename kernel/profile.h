@@ -0,0 +1,44 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PROFILE_MAX_DEPTH 8
+#define PROFILE_SLOTS     512     /* distinct stacks kept, power of two */
+#define PROFILE_TOP_MAX   128     /* distinct functions profile_top() ranks */
+
+/* profile_start() flags */
+#define PROFILE_BACKTRACE 0x1
+
+typedef struct {
+    uint32_t samples;       /* samples recorded */
+    uint32_t dropped;       /* samples lost because the table was full */
+    uint32_t stacks;        /* distinct stacks in the table */
+    uint32_t rate;          /* samples per second while running */
+    bool running;
+} profile_stats_t;
+
+typedef struct {
+    const char* name;       /* NULL when no symbol table is linked in */
+    uint32_t addr;
+    uint32_t samples;
+} profile_func_t;
+
+/* Samples are taken on IRQ0; oversample > 1 runs the PIT faster while
+   the profiler is on without changing the tick rate. */
+void profile_start(uint32_t flags, uint32_t oversample);
+void profile_stop(void);
+void profile_clear(void);
+void profile_get_stats(profile_stats_t* stats);
+
+/* Called from the IRQ0 path with the interrupted EIP and EBP */
+void profile_sample(uint32_t eip, uint32_t ebp);
+
+/* Leaf functions by sample count, highest first */
+uint32_t profile_top(profile_func_t* out, uint32_t max);
+
+/* Folded stacks ("outer;inner count" per line) for flamegraph.pl */
+void profile_dump_serial(void);
+
+#endif
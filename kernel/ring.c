@@ -0,0 +1,84 @@
+#include "ring.h"
+#include "string.h"
+
+_Static_assert(sizeof(ring_t) == 3 * RING_CACHE_LINE, "ring_t layout is shared with Rust");
+
+/* Slot protocol (bounded MPMC queue after D. Vyukov, used here with one
+   consumer): slot N starts with sequence N. A producer that claimed
+   position P writes the element and publishes sequence P + 1. The consumer
+   takes position P once it sees P + 1 and recycles the slot by storing
+   P + capacity. */
+
+static inline uint32_t* slot_seq(const ring_t* ring, uint32_t pos) {
+    return (uint32_t*)(ring->storage + (pos & ring->mask) * ring->slot_size);
+}
+
+bool ring_init(ring_t* ring, void* storage, uint32_t capacity, uint32_t elem_size, uint32_t flags) {
+    if (!ring || !storage || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    ring->head = 0;
+    ring->tail = 0;
+    ring->mask = capacity - 1;
+    ring->elem_size = elem_size;
+    ring->slot_size = RING_SLOT_SIZE(elem_size);
+    ring->flags = flags;
+    ring->storage = (uint8_t*)storage;
+    for (uint32_t i = 0; i < capacity; i++) {
+        *slot_seq(ring, i) = i;
+    }
+    return true;
+}
+
+bool ring_push(ring_t* ring, const void* elem) {
+    uint32_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t* seq;
+
+    for (;;) {
+        seq = slot_seq(ring, pos);
+        int32_t diff = (int32_t)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff < 0) {
+            return false;
+        }
+        if (diff > 0) {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!(ring->flags & RING_MULTI_PRODUCER)) {
+            __atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    memcpy(seq + 1, elem, ring->elem_size);
+    __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool ring_pop(ring_t* ring, void* elem) {
+    uint32_t pos = ring->head;
+    uint32_t* seq = slot_seq(ring, pos);
+
+    if (__atomic_load_n(seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return false;
+    }
+
+    memcpy(elem, seq + 1, ring->elem_size);
+    __atomic_store_n(seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+uint32_t ring_count(const ring_t* ring) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    return tail - head;
+}
+
+uint32_t ring_capacity(const ring_t* ring) {
+    return ring->mask + 1;
+}
@@ -0,0 +1,43 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RING_CACHE_LINE 64
+
+#define RING_SINGLE_PRODUCER 0x0
+#define RING_MULTI_PRODUCER  0x1
+
+/* Each slot holds a sequence word followed by the element, padded to 4 bytes */
+#define RING_SLOT_SIZE(elem_size) (4 + (((elem_size) + 3) & ~3u))
+#define RING_STORAGE_SIZE(capacity, elem_size) ((capacity) * RING_SLOT_SIZE(elem_size))
+
+/* Bounded lock-free queue with a single consumer and either one or many
+   producers. Producer and consumer indices live on separate cache lines.
+   Layout is shared with rust_module/src/ring.rs. */
+typedef struct ring {
+    uint32_t head __attribute__((aligned(RING_CACHE_LINE)));
+    uint32_t tail __attribute__((aligned(RING_CACHE_LINE)));
+    uint32_t mask __attribute__((aligned(RING_CACHE_LINE)));
+    uint32_t elem_size;
+    uint32_t slot_size;
+    uint32_t flags;
+    uint8_t* storage;
+} ring_t;
+
+bool ring_init(ring_t* ring, void* storage, uint32_t capacity, uint32_t elem_size, uint32_t flags);
+bool ring_push(ring_t* ring, const void* elem);
+bool ring_pop(ring_t* ring, void* elem);
+uint32_t ring_count(const ring_t* ring);
+uint32_t ring_capacity(const ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,29 +1,214 @@
+#include <stdbool.h>
+#include <stddef.h>
 #include "serial.h"
 #include "port.h"
+#include "ring.h"
+#include "cpu.h"
+#include "irq.h"
+#include "lock.h"
+
+#define UART_DATA 0
+#define UART_IER  1
+#define UART_IIR  2
+#define UART_FCR  2
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+#define UART_MSR  6
+
+#define IER_RX_AVAILABLE 0x01
+#define IER_TX_EMPTY     0x02
+
+#define IIR_NO_INTERRUPT 0x01
+#define IIR_ID_MASK      0x0E
+#define IIR_MODEM_STATUS 0x00
+#define IIR_TX_EMPTY     0x02
+#define IIR_RX_AVAILABLE 0x04
+#define IIR_LINE_STATUS  0x06
+#define IIR_RX_TIMEOUT   0x0C
+
+#define LSR_DATA_READY 0x01
+#define LSR_THR_EMPTY  0x20
+
+#define UART_FIFO_SIZE 16
+
+#define SERIAL_TX_BUFFER_SIZE 1024
+#define SERIAL_RX_BUFFER_SIZE 128
+
+/* Output is queued in tx_ring and drained by the THR-empty interrupt
+   (IRQ4), UART_FIFO_SIZE bytes at a time. tx_idle is set when that
+   interrupt found nothing to send; the next writer restarts the
+   transmitter by filling the FIFO itself. The ring has a single
+   consumer, so every drain and THR write holds tx_lock. */
+static ring_t tx_ring;
+static uint8_t tx_storage[RING_STORAGE_SIZE(SERIAL_TX_BUFFER_SIZE, sizeof(char))];
+static ring_t rx_ring;
+static uint8_t rx_storage[RING_STORAGE_SIZE(SERIAL_RX_BUFFER_SIZE, sizeof(char))];
+
+static volatile bool tx_idle;
+static spinlock_t tx_lock = SPINLOCK_INIT;
+static bool serial_ready = false;
+
+static int serial_transmit_empty(void) {
+    return inb(SERIAL_COM1 + UART_LSR) & LSR_THR_EMPTY;
+}
+
+/* Caller holds tx_lock with interrupts disabled. Returns the number of
+   bytes sent. */
+static uint32_t serial_tx_fill(void) {
+    if (serial_transmit_empty() == 0) {
+        return 0;
+    }
+
+    uint32_t sent = 0;
+    char c;
+    while (sent < UART_FIFO_SIZE && ring_pop(&tx_ring, &c)) {
+        outb(SERIAL_COM1 + UART_DATA, c);
+        sent++;
+    }
+    return sent;
+}
+
+static void serial_kick(void) {
+    if (!tx_idle) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    if (tx_idle) {
+        tx_idle = false;
+        if (serial_tx_fill() == 0 && ring_count(&tx_ring) == 0) {
+            tx_idle = true;
+        }
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+static void serial_enqueue(char c) {
+    while (!ring_push(&tx_ring, &c)) {
+        /* Buffer full. Interrupts may be off (early boot, exception
+           paths), so make progress by polling the UART directly. */
+        uint32_t flags = spin_lock_irqsave(&tx_lock);
+        serial_tx_fill();
+        spin_unlock_irqrestore(&tx_lock, flags);
+    }
+}
+
+static void serial_irq(void* ctx) {
+    (void)ctx;
+    serial_handler();
+}
 
 void serial_init(void) {
-    outb(SERIAL_COM1 + 1, 0x00);
-    outb(SERIAL_COM1 + 3, 0x80);
-    outb(SERIAL_COM1 + 0, 0x03);
-    outb(SERIAL_COM1 + 1, 0x00);
-    outb(SERIAL_COM1 + 3, 0x03);
-    outb(SERIAL_COM1 + 2, 0xC7);
-    outb(SERIAL_COM1 + 4, 0x0B);
+    ring_init(&tx_ring, tx_storage, SERIAL_TX_BUFFER_SIZE, sizeof(char), RING_MULTI_PRODUCER);
+    ring_init(&rx_ring, rx_storage, SERIAL_RX_BUFFER_SIZE, sizeof(char), RING_SINGLE_PRODUCER);
+    tx_idle = true;
+
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, 0x80);
+    outb(SERIAL_COM1 + UART_DATA, 0x03);
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, 0x03);
+    outb(SERIAL_COM1 + UART_FCR, 0xC7);
+    outb(SERIAL_COM1 + UART_MCR, 0x0B);
+    outb(SERIAL_COM1 + UART_IER, IER_RX_AVAILABLE | IER_TX_EMPTY);
+
+    spin_register(&tx_lock, "serial_tx");
+    serial_ready = true;
+    irq_register(4, serial_irq, NULL);
 }
 
-static int serial_transmit_empty(void) {
-    return inb(SERIAL_COM1 + 5) & 0x20;
+void serial_handler(void) {
+    for (;;) {
+        uint8_t iir = inb(SERIAL_COM1 + UART_IIR);
+        if (iir & IIR_NO_INTERRUPT) {
+            break;
+        }
+
+        switch (iir & IIR_ID_MASK) {
+            case IIR_TX_EMPTY:
+                spin_lock(&tx_lock);
+                if (serial_tx_fill() == 0) {
+                    tx_idle = true;
+                }
+                spin_unlock(&tx_lock);
+                break;
+            case IIR_RX_AVAILABLE:
+            case IIR_RX_TIMEOUT:
+                while (inb(SERIAL_COM1 + UART_LSR) & LSR_DATA_READY) {
+                    char c = inb(SERIAL_COM1 + UART_DATA);
+                    ring_push(&rx_ring, &c);
+                }
+                break;
+            case IIR_LINE_STATUS:
+                inb(SERIAL_COM1 + UART_LSR);
+                break;
+            case IIR_MODEM_STATUS:
+                inb(SERIAL_COM1 + UART_MSR);
+                break;
+        }
+    }
 }
 
 void serial_putchar(char c) {
-    while (serial_transmit_empty() == 0);
-    outb(SERIAL_COM1, c);
+    if (!serial_ready) {
+        uint32_t flags = spin_lock_irqsave(&tx_lock);
+        while (serial_transmit_empty() == 0);
+        outb(SERIAL_COM1, c);
+        spin_unlock_irqrestore(&tx_lock, flags);
+        return;
+    }
+
+    serial_enqueue(c);
+    serial_kick();
 }
 
 void serial_write(const char* str) {
+    if (!serial_ready) {
+        while (*str) {
+            serial_putchar(*str++);
+        }
+        return;
+    }
+
     while (*str) {
-        serial_putchar(*str++);
+        serial_enqueue(*str++);
+    }
+    serial_kick();
+}
+
+void serial_write_bytes(const void* data, size_t len) {
+    const char* bytes = (const char*)data;
+    if (!serial_ready) {
+        for (size_t i = 0; i < len; i++) {
+            serial_putchar(bytes[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        serial_enqueue(bytes[i]);
+    }
+    serial_kick();
+}
+
+void serial_flush(void) {
+    if (!serial_ready) {
+        return;
     }
+
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    while (ring_count(&tx_ring) != 0) {
+        serial_tx_fill();
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+bool serial_read_char(char* c) {
+    return ring_pop(&rx_ring, c);
+}
+
+bool serial_has_input(void) {
+    return ring_count(&rx_ring) != 0;
 }
 
 void serial_write_hex(uint32_t value) {
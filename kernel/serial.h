@@ -2,6 +2,8 @@
 #define SERIAL_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 #define SERIAL_COM1 0x3F8
 #define SERIAL_COM2 0x2F8
@@ -9,8 +11,14 @@
 #define SERIAL_COM4 0x2E8
 
 void serial_init(void);
+void serial_handler(void);
 void serial_putchar(char c);
 void serial_write(const char* str);
+/* Raw bytes, NULs and newlines included */
+void serial_write_bytes(const void* data, size_t len);
+void serial_flush(void);
+bool serial_read_char(char* c);
+bool serial_has_input(void);
 void serial_write_hex(uint32_t value);
 void serial_write_dec(uint32_t value);
 
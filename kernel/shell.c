@@ -2,11 +2,19 @@
 #include <stdbool.h>
 #include "terminal.h"
 #include "string.h"
+#include "shell.h"
+#include "trace.h"
+#include "task.h"
+#include "cpu.h"
+#include "irq.h"
 
 #define SHELL_BUFFER_SIZE 256
+#define SHELL_TRACE_LINES 16
+#define SHELL_MAX_COMMANDS 32
 
 static char command_buffer[SHELL_BUFFER_SIZE];
 static uint32_t buffer_pos = 0;
+static uint32_t shell_tid = (uint32_t)-1;
 
 extern void terminal_writestring(const char* str);
 extern void terminal_putchar(char c);
@@ -14,40 +22,32 @@ extern void terminal_setcolor(uint8_t color);
 extern int strcmp(const char* s1, const char* s2);
 
 static void shell_prompt(void) {
-    terminal_setcolor(0x0A);
-    terminal_writestring("toyos> ");
-    terminal_setcolor(0x0F);
+    terminal_writestring("\x1b[92mtoyos> \x1b[97m");
 }
 
-static void clear_screen_cmd(void) {
+static void clear_screen_cmd(char* args) {
+    (void)args;
     extern void terminal_initialize(void);
     terminal_initialize();
 }
 
-static void help_cmd(void) {
-    terminal_writestring("Available commands:\n");
-    terminal_writestring("  help     - Show this message\n");
-    terminal_writestring("  clear    - Clear screen\n");
-    terminal_writestring("  version  - Show OS version\n");
-    terminal_writestring("  meminfo  - Display memory stats\n");
-    terminal_writestring("  time     - Show system uptime\n");
-    terminal_writestring("  echo     - Echo arguments\n");
-    terminal_writestring("  shutdown - Power off\n");
-    terminal_writestring("  reboot   - Restart system\n");
-}
+static void help_cmd(char* args);
 
-static void version_cmd(void) {
+static void version_cmd(char* args) {
+    (void)args;
     terminal_writestring("ToyOS v0.1\n");
     terminal_writestring("Multi-language kernel\n");
 }
 
-static void meminfo_cmd(void) {
+static void meminfo_cmd(char* args) {
+    (void)args;
     extern void rust_print_stats(void);
     terminal_writestring("Memory Information:\n");
     rust_print_stats();
 }
 
-static void time_cmd(void) {
+static void time_cmd(char* args) {
+    (void)args;
     extern uint32_t timer_ticks;
     terminal_writestring("System uptime: ");
     uint32_t seconds = timer_ticks / 100;
@@ -67,7 +67,7 @@ static void time_cmd(void) {
     terminal_writestring("\n");
 }
 
-static void echo_cmd(const char* args) {
+static void echo_cmd(char* args) {
     if (*args == '\0') {
         terminal_writestring("\n");
         return;
@@ -76,6 +76,185 @@ static void echo_cmd(const char* args) {
     terminal_writestring("\n");
 }
 
+static void trace_cmd(char* args) {
+    if (strcmp(args, "serial") == 0) {
+        trace_dump_serial();
+        terminal_writestring("Trace written to COM1\n");
+        return;
+    }
+    if (strcmp(args, "clear") == 0) {
+        trace_clear();
+        return;
+    }
+
+    trace_record_t records[SHELL_TRACE_LINES];
+    char line[TRACE_LINE_LEN];
+    uint32_t count = trace_snapshot(records, SHELL_TRACE_LINES);
+    if (count == 0) {
+        terminal_writestring("No trace records\n");
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        trace_format(&records[i], line, sizeof(line));
+        terminal_writestring(line);
+        terminal_writestring("\n");
+    }
+}
+
+static int32_t find_module(const char* name) {
+    for (uint8_t m = 0; m < TRACE_MOD_COUNT; m++) {
+        if (strcmp(name, trace_module_name(m)) == 0) {
+            return m;
+        }
+    }
+    return -1;
+}
+
+/* Mask is one hex digit of LOG_LEVEL_BIT()s: 1 info, 2 warn, 4 err, 8 debug */
+static int32_t parse_log_mask(const char* s) {
+    if (strcmp(s, "on") == 0) return 0xF;
+    if (strcmp(s, "off") == 0) return 0;
+    if (s[0] == '\0' || s[1] != '\0') return -1;
+    if (s[0] >= '0' && s[0] <= '9') return s[0] - '0';
+    if (s[0] >= 'a' && s[0] <= 'f') return s[0] - 'a' + 10;
+    return -1;
+}
+
+static void log_cmd(char* args) {
+    extern uint8_t log_get_mask(uint8_t module);
+    extern bool log_set_mask(uint8_t module, uint8_t mask);
+    const char hex[] = "0123456789abcdef";
+
+    if (*args == '\0') {
+        for (uint8_t m = 0; m < TRACE_MOD_COUNT; m++) {
+            uint8_t mask = log_get_mask(m);
+            terminal_writestring("  ");
+            terminal_writestring(trace_module_name(m));
+            terminal_writestring("\t");
+            terminal_putchar(hex[mask & 0xF]);
+            terminal_writestring((mask & LOG_LEVEL_BIT(TRACE_INFO)) ? "  info" : "");
+            terminal_writestring((mask & LOG_LEVEL_BIT(TRACE_WARNING)) ? " warn" : "");
+            terminal_writestring((mask & LOG_LEVEL_BIT(TRACE_ERROR)) ? " err" : "");
+            terminal_writestring((mask & LOG_LEVEL_BIT(TRACE_DEBUG)) ? " debug" : "");
+            terminal_writestring("\n");
+        }
+        if (!LOG_LEVEL_COMPILED(TRACE_DEBUG)) {
+            terminal_writestring("Debug logging is compiled out\n");
+        }
+        return;
+    }
+
+    char* value = args;
+    while (*value && *value != ' ') value++;
+    if (*value) {
+        *value++ = '\0';
+        while (*value == ' ') value++;
+    }
+
+    int32_t mask = parse_log_mask(value);
+    if (mask < 0) {
+        terminal_writestring("Usage: log [module|all] [0-f|on|off]\n");
+        return;
+    }
+
+    if (strcmp(args, "all") == 0) {
+        for (uint8_t m = 0; m < TRACE_MOD_COUNT; m++) {
+            log_set_mask(m, (uint8_t)mask);
+        }
+        return;
+    }
+
+    int32_t module = find_module(args);
+    if (module < 0) {
+        terminal_writestring("Unknown module: ");
+        terminal_writestring(args);
+        terminal_writestring("\n");
+        return;
+    }
+    log_set_mask((uint8_t)module, (uint8_t)mask);
+}
+
+static void shutdown_cmd(char* args) {
+    extern void acpi_power_off(void);
+    (void)args;
+    terminal_setcolor(0x0C);
+    terminal_writestring("Shutting down...\n");
+    acpi_power_off();
+}
+
+static void reboot_cmd(char* args) {
+    extern void reboot(void);
+    (void)args;
+    terminal_setcolor(0x0C);
+    terminal_writestring("Rebooting...\n");
+    reboot();
+}
+
+static const shell_command_t builtin_commands[] = {
+    { "help",     "Show this message", help_cmd },
+    { "clear",    "Clear screen", clear_screen_cmd },
+    { "version",  "Show OS version", version_cmd },
+    { "meminfo",  "Display memory stats", meminfo_cmd },
+    { "time",     "Show system uptime", time_cmd },
+    { "echo",     "Echo arguments", echo_cmd },
+    { "trace",    "Show recent trace records [serial|clear]", trace_cmd },
+    { "log",      "Show or set log masks [module|all] [mask]", log_cmd },
+    { "shutdown", "Power off", shutdown_cmd },
+    { "reboot",   "Restart system", reboot_cmd },
+};
+
+#define BUILTIN_COUNT (sizeof(builtin_commands) / sizeof(builtin_commands[0]))
+
+/* Commands added at run time by other subsystems; pointers are kept, so
+   entries must stay valid for the life of the kernel. */
+static const shell_command_t* extra_commands[SHELL_MAX_COMMANDS];
+static uint32_t extra_count = 0;
+
+static const shell_command_t* find_command(const char* name) {
+    for (uint32_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (strcmp(name, builtin_commands[i].name) == 0) {
+            return &builtin_commands[i];
+        }
+    }
+    for (uint32_t i = 0; i < extra_count; i++) {
+        if (strcmp(name, extra_commands[i]->name) == 0) {
+            return extra_commands[i];
+        }
+    }
+    return NULL;
+}
+
+bool shell_register_command(const shell_command_t* command) {
+    if (extra_count >= SHELL_MAX_COMMANDS || find_command(command->name)) {
+        return false;
+    }
+    extra_commands[extra_count++] = command;
+    return true;
+}
+
+static void help_line(const shell_command_t* command) {
+    uint32_t len = strlen(command->name);
+    terminal_writestring("  ");
+    terminal_writestring(command->name);
+    while (len++ < 9) {
+        terminal_putchar(' ');
+    }
+    terminal_writestring("- ");
+    terminal_writestring(command->usage);
+    terminal_writestring("\n");
+}
+
+static void help_cmd(char* args) {
+    (void)args;
+    terminal_writestring("Available commands:\n");
+    for (uint32_t i = 0; i < BUILTIN_COUNT; i++) {
+        help_line(&builtin_commands[i]);
+    }
+    for (uint32_t i = 0; i < extra_count; i++) {
+        help_line(extra_commands[i]);
+    }
+}
+
 static void parse_and_execute(void) {
     if (buffer_pos == 0) return;
     command_buffer[buffer_pos] = '\0';
@@ -88,39 +267,79 @@ static void parse_and_execute(void) {
         args++;
         while (*args == ' ') args++;
     }
-    
-    if (strcmp(cmd, "help") == 0) {
-        help_cmd();
-    } else if (strcmp(cmd, "clear") == 0) {
-        clear_screen_cmd();
-        return;
-    } else if (strcmp(cmd, "version") == 0) {
-        version_cmd();
-    } else if (strcmp(cmd, "meminfo") == 0) {
-        meminfo_cmd();
-    } else if (strcmp(cmd, "time") == 0) {
-        time_cmd();
-    } else if (strcmp(cmd, "echo") == 0) {
-        echo_cmd(args);
-    } else if (strcmp(cmd, "shutdown") == 0) {
-        terminal_setcolor(0x0C);
-        terminal_writestring("Shutting down...\n");
-        extern void acpi_power_off(void);
-        acpi_power_off();
-    } else if (strcmp(cmd, "reboot") == 0) {
-        terminal_setcolor(0x0C);
-        terminal_writestring("Rebooting...\n");
-        extern void reboot(void);
-        reboot();
-    } else if (*cmd != '\0') {
+    if (*cmd == '\0') return;
+
+    const shell_command_t* command = find_command(cmd);
+    if (command) {
+        command->handler(args);
+    } else {
         terminal_writestring("Unknown command: ");
         terminal_writestring(cmd);
         terminal_writestring("\nType 'help' for available commands.\n");
     }
 }
 
+void shell_poll(void) {
+    extern bool keyboard_read_char(char* c);
+    extern bool serial_read_char(char* c);
+    char c;
+    while (keyboard_read_char(&c)) {
+        shell_handle_input(c);
+    }
+    /* Serial terminals send CR for Enter and DEL for Backspace */
+    while (serial_read_char(&c)) {
+        if (c == '\r') {
+            c = '\n';
+        } else if (c == 0x7F) {
+            c = '\b';
+        }
+        shell_handle_input(c);
+    }
+}
+
+/* Commands run here with interrupts enabled, so a slow command never
+   holds off the timer or other IRQs. The task sleeps while both input
+   rings are empty; the check and task_block() happen with interrupts
+   off so a keystroke between them still wakes it. */
+static void shell_task(void) {
+    extern bool keyboard_has_input(void);
+    extern bool serial_has_input(void);
+
+    for (;;) {
+        shell_poll();
+        uint32_t flags = irq_save();
+        if (!keyboard_has_input() && !serial_has_input()) {
+            task_block();
+        }
+        irq_restore(flags);
+    }
+}
+
+void shell_wake(void) {
+    if (shell_tid != (uint32_t)-1) {
+        task_unblock(shell_tid);
+    }
+}
+
+/* Shares IRQ1 and IRQ4 with the drivers and runs after them */
+static void shell_irq(void* ctx) {
+    extern bool keyboard_has_input(void);
+    extern bool serial_has_input(void);
+    (void)ctx;
+    if (keyboard_has_input() || serial_has_input()) {
+        shell_wake();
+    }
+}
+
 void shell_init(void) {
     buffer_pos = 0;
+    shell_stats_register();
+    shell_tid = task_create(shell_task);
+    irq_register(1, shell_irq, NULL);
+    irq_register(4, shell_irq, NULL);
+}
+
+void shell_banner(void) {
     terminal_writestring("\nWelcome to ToyOS Shell!\n");
     terminal_writestring("Type 'help' for available commands.\n\n");
     shell_prompt();
@@ -1,7 +1,28 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#include <stdbool.h>
+
+/* args points at the rest of the line with leading spaces stripped; the
+   handler may modify it in place. */
+typedef void (*shell_handler_t)(char* args);
+
+typedef struct {
+    const char* name;
+    const char* usage;
+    shell_handler_t handler;
+} shell_command_t;
+
+/* Starts the shell task and takes keyboard and serial input. The
+   welcome text and first prompt wait for shell_banner(). */
 void shell_init(void);
+void shell_banner(void);
 void shell_handle_input(char c);
+void shell_poll(void);
+void shell_wake(void);
+bool shell_register_command(const shell_command_t* command);
+
+/* shell_stats.c */
+void shell_stats_register(void);
 
 #endif
@@ -0,0 +1,370 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "terminal.h"
+#include "shell.h"
+#include "task.h"
+#include "irq.h"
+#include "apic.h"
+#include "heap.h"
+#include "string.h"
+#include "profile.h"
+#include "percpu.h"
+#include "lock.h"
+#include "format.h"
+
+extern uint32_t timer_ticks;
+
+#define TIMER_HZ 100
+#define PROFILE_SHOW 10
+
+static void write_hex(uint32_t value) {
+    const char hex[] = "0123456789abcdef";
+    terminal_writestring("0x");
+    for (int i = 7; i >= 0; i--) {
+        terminal_putchar(hex[(value >> (i * 4)) & 0xF]);
+    }
+}
+
+static bool starts_with_word(const char* s, const char* prefix) {
+    while (*prefix) {
+        if (*s++ != *prefix++) return false;
+    }
+    return *s == '\0' || *s == ' ';
+}
+
+static const char* state_name(task_state_t state) {
+    switch (state) {
+        case TASK_READY: return "ready  ";
+        case TASK_RUNNING: return "run    ";
+        case TASK_BLOCKED: return "blocked";
+        case TASK_TERMINATED: return "exited ";
+    }
+    return "?      ";
+}
+
+/* CPU share is measured since the previous "top", or since boot the first
+   time it runs. */
+static uint64_t top_last_cycles[MAX_TASKS];
+
+static void top_cmd(char* args) {
+    task_stats_t stats[MAX_TASKS];
+    uint64_t delta[MAX_TASKS];
+    uint64_t total = 0;
+    uint32_t count = task_get_count();
+    (void)args;
+
+    for (uint32_t tid = 0; tid < count; tid++) {
+        task_get_stats(tid, &stats[tid]);
+        delta[tid] = stats[tid].cpu_cycles - top_last_cycles[tid];
+        top_last_cycles[tid] = stats[tid].cpu_cycles;
+        total += delta[tid];
+    }
+
+    terminal_writestring(" TID CPU STATE        %CPU        CYCLES  SWITCHES\n");
+    for (uint32_t tid = 0; tid < count; tid++) {
+        terminal_write_dec(tid, 4);
+        terminal_write_dec(stats[tid].cpu, 4);
+        terminal_writestring(" ");
+        terminal_writestring(state_name(stats[tid].state));
+        terminal_write_dec(percent(delta[tid], total), 9);
+        terminal_write_dec(stats[tid].cpu_cycles, 14);
+        terminal_write_dec(stats[tid].switches, 10);
+        terminal_writestring(stats[tid].idle ? "  idle\n" : "\n");
+    }
+}
+
+static void cpus_cmd(char* args) {
+    task_cpu_stats_t stats;
+    (void)args;
+
+    terminal_writestring(" CPU  APIC  CURRENT  QUEUED  SWITCHES  STEALS     TICKS\n");
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!task_get_cpu_stats(cpu, &stats)) continue;
+        terminal_write_dec(cpu, 4);
+        terminal_write_dec(cpus[cpu].apic_id, 6);
+        terminal_write_dec(stats.current, 9);
+        terminal_write_dec(stats.queued, 8);
+        terminal_write_dec(stats.switches, 10);
+        terminal_write_dec(stats.steals, 8);
+        terminal_write_dec(cpus[cpu].ticks, 10);
+        terminal_writestring("\n");
+    }
+}
+
+/* irqstat names the local APIC slots by their vector numbers */
+static const uint8_t apic_slot_vectors[IRQ_STAT_SLOTS - IRQ_LINES] = {
+    APIC_VECTOR_TIMER, APIC_VECTOR_RESCHED, APIC_VECTOR_SPURIOUS,
+};
+
+static uint32_t irq_label(uint8_t slot) {
+    return slot < IRQ_LINES ? slot : apic_slot_vectors[slot - IRQ_LINES];
+}
+
+static bool irq_slot(uint32_t number, uint8_t* slot) {
+    for (uint8_t i = 0; i < IRQ_STAT_SLOTS; i++) {
+        if (irq_label(i) == number) {
+            *slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void irq_histogram(uint8_t irq) {
+    irq_stats_t stats;
+    irq_get_stats(irq, &stats);
+
+    terminal_writestring(irq < IRQ_LINES ? "IRQ " : "Vector ");
+    terminal_write_dec(irq_label(irq), 0);
+    terminal_writestring(" handler cycles:\n");
+    for (uint32_t b = 0; b < IRQ_HIST_BUCKETS; b++) {
+        if (stats.histogram[b] == 0) continue;
+        if (b == IRQ_HIST_BUCKETS - 1) {
+            terminal_writestring("   >= ");
+            terminal_write_dec((uint64_t)1 << (b + IRQ_HIST_SHIFT), 8);
+        } else {
+            terminal_writestring("    < ");
+            terminal_write_dec((uint64_t)1 << (b + IRQ_HIST_SHIFT + 1), 8);
+        }
+        terminal_write_dec(stats.histogram[b], 11);
+        terminal_writestring("  ");
+        uint32_t bar = percent(stats.histogram[b], stats.count) / 4;
+        while (bar--) {
+            terminal_putchar('#');
+        }
+        terminal_writestring("\n");
+    }
+}
+
+static void irqstat_cmd(char* args) {
+    irq_stats_t stats;
+
+    if (strcmp(args, "reset") == 0) {
+        irq_reset_stats();
+        return;
+    }
+    if (*args >= '0' && *args <= '9') {
+        uint32_t number = 0;
+        uint8_t irq;
+        while (*args >= '0' && *args <= '9') {
+            number = number * 10 + (*args++ - '0');
+        }
+        if (*args != '\0' || !irq_slot(number, &irq)) {
+            terminal_writestring("Usage: irqstat [reset|0-15|48|49|63]\n");
+            return;
+        }
+        irq_histogram(irq);
+        return;
+    }
+
+    terminal_writestring(" IRQ      COUNT       MIN       AVG       MAX  SPURIOUS\n");
+    for (uint8_t irq = 0; irq < IRQ_STAT_SLOTS; irq++) {
+        irq_get_stats(irq, &stats);
+        if (stats.count == 0 && stats.spurious == 0) continue;
+        terminal_write_dec(irq_label(irq), 4);
+        terminal_write_dec(stats.count, 11);
+        terminal_write_dec(stats.min_cycles, 10);
+        terminal_write_dec(div64(stats.cycles, stats.count), 10);
+        terminal_write_dec(stats.max_cycles, 10);
+        terminal_write_dec(stats.spurious, 10);
+        terminal_writestring("\n");
+    }
+}
+
+static const char* const lock_kind_names[] = { "spin", "rw", "mutex" };
+
+/* Name left-aligned in a column of width characters */
+static void write_padded(const char* s, uint32_t width) {
+    uint32_t len = strlen(s);
+    terminal_writestring(s);
+    while (len++ < width) {
+        terminal_putchar(' ');
+    }
+}
+
+static void lockstat_cmd(char* args) {
+    lock_info_t info;
+
+    if (strcmp(args, "reset") == 0) {
+        lock_reset_stats();
+        return;
+    }
+
+    terminal_writestring("LOCK          KIND    ACQUIRED  CONTENDED  CONT%   AVG-WAIT\n");
+    for (uint32_t i = 0; lock_get_info(i, &info); i++) {
+        if (info.stats.acquired == 0) continue;
+        write_padded(info.name, 14);
+        write_padded(lock_kind_names[info.kind], 5);
+        terminal_write_dec(info.stats.acquired, 11);
+        terminal_write_dec(info.stats.contended, 11);
+        terminal_write_dec(percent(info.stats.contended, info.stats.acquired), 7);
+        terminal_write_dec(div64(info.stats.wait_cycles, info.stats.contended), 11);
+        terminal_writestring("\n");
+    }
+}
+
+static void slabinfo_cmd(char* args) {
+    extern void rust_pool_stats(void);
+    heap_stats_t stats;
+    (void)args;
+
+    heap_get_stats(&stats);
+    terminal_writestring("Kernel heap:\n  Used blocks: ");
+    terminal_write_dec(stats.used_blocks, 0);
+    terminal_writestring("\n  Free blocks: ");
+    terminal_write_dec(stats.free_blocks, 0);
+    terminal_writestring("\n  Free bytes: ");
+    terminal_write_dec(stats.free_bytes, 0);
+    terminal_writestring("\n  Largest free: ");
+    terminal_write_dec(stats.largest_free, 0);
+    terminal_writestring("\n  Fragmentation: ");
+    terminal_write_dec(stats.free_bytes ? 100 - percent(stats.largest_free, stats.free_bytes) : 0, 0);
+    terminal_writestring("%\n  Cached blocks: ");
+    terminal_write_dec(stats.cached_blocks, 0);
+    terminal_writestring("\n  Magazine refills/flushes: ");
+    terminal_write_dec(stats.refills, 0);
+    terminal_writestring("/");
+    terminal_write_dec(stats.flushes, 0);
+    terminal_writestring("\nBlock pool:\n");
+    rust_pool_stats();
+}
+
+static uint32_t vmstat_last_ticks;
+static uint32_t vmstat_last_switches;
+static uint32_t vmstat_last_irqs;
+
+static void vmstat_cmd(char* args) {
+    extern uint32_t rust_get_total_memory(void);
+    extern uint32_t rust_get_free_memory(void);
+    extern uint32_t rust_get_allocated_memory(void);
+    irq_stats_t stats;
+    uint32_t irqs = 0;
+    (void)args;
+
+    for (uint8_t irq = 0; irq < IRQ_STAT_SLOTS; irq++) {
+        irq_get_stats(irq, &stats);
+        irqs += stats.count;
+    }
+    uint32_t switches = task_get_switch_count();
+    uint32_t ticks = timer_ticks;
+    uint32_t elapsed = ticks - vmstat_last_ticks;
+
+    terminal_writestring("Memory (KB): total ");
+    terminal_write_dec(rust_get_total_memory() / 1024, 0);
+    terminal_writestring(", free ");
+    terminal_write_dec(rust_get_free_memory() / 1024, 0);
+    terminal_writestring(", allocated ");
+    terminal_write_dec(rust_get_allocated_memory() / 1024, 0);
+    terminal_writestring("\nContext switches: ");
+    terminal_write_dec(switches, 0);
+    terminal_writestring("\nInterrupts: ");
+    terminal_write_dec(irqs, 0);
+    if (elapsed != 0) {
+        terminal_writestring("\nRates since last vmstat: ");
+        terminal_write_dec(div64((uint64_t)(switches - vmstat_last_switches) * TIMER_HZ, elapsed), 0);
+        terminal_writestring(" switches/s, ");
+        terminal_write_dec(div64((uint64_t)(irqs - vmstat_last_irqs) * TIMER_HZ, elapsed), 0);
+        terminal_writestring(" irqs/s");
+    }
+    terminal_writestring("\n");
+
+    vmstat_last_ticks = ticks;
+    vmstat_last_switches = switches;
+    vmstat_last_irqs = irqs;
+}
+
+static uint32_t parse_dec(const char* s, uint32_t fallback) {
+    uint32_t value = 0;
+    if (*s < '0' || *s > '9') return fallback;
+    while (*s >= '0' && *s <= '9') {
+        value = value * 10 + (*s++ - '0');
+    }
+    return value;
+}
+
+static void profile_start_cmd(char* args) {
+    uint32_t flags = 0;
+    uint32_t oversample = 1;
+    while (*args) {
+        char* word = args;
+        while (*args && *args != ' ') args++;
+        if (*args) {
+            *args++ = '\0';
+            while (*args == ' ') args++;
+        }
+        if (strcmp(word, "bt") == 0) {
+            flags |= PROFILE_BACKTRACE;
+        } else {
+            oversample = parse_dec(word, 1);
+        }
+    }
+    profile_start(flags, oversample);
+}
+
+static void profile_cmd(char* args) {
+    if (strcmp(args, "stop") == 0) {
+        profile_stop();
+        return;
+    }
+    if (strcmp(args, "clear") == 0) {
+        profile_clear();
+        return;
+    }
+    if (strcmp(args, "serial") == 0) {
+        profile_dump_serial();
+        terminal_writestring("Profile written to COM1\n");
+        return;
+    }
+    if (starts_with_word(args, "start")) {
+        args += 5;
+        while (*args == ' ') args++;
+        profile_start_cmd(args);
+        return;
+    }
+    if (*args != '\0') {
+        terminal_writestring("Usage: profile [start [bt] [N]|stop|clear|serial]\n");
+        return;
+    }
+
+    profile_stats_t stats;
+    profile_func_t top[PROFILE_SHOW];
+    profile_get_stats(&stats);
+    terminal_writestring(stats.running ? "Running at " : "Stopped, ");
+    terminal_write_dec(stats.rate, 0);
+    terminal_writestring(" Hz; samples ");
+    terminal_write_dec(stats.samples, 0);
+    terminal_writestring(", stacks ");
+    terminal_write_dec(stats.stacks, 0);
+    terminal_writestring(", dropped ");
+    terminal_write_dec(stats.dropped, 0);
+    terminal_writestring("\n");
+
+    uint32_t count = profile_top(top, PROFILE_SHOW);
+    for (uint32_t i = 0; i < count; i++) {
+        terminal_write_dec(top[i].samples, 8);
+        terminal_write_dec(percent(top[i].samples, stats.samples), 4);
+        terminal_writestring("%  ");
+        if (top[i].name) {
+            terminal_writestring(top[i].name);
+        } else {
+            write_hex(top[i].addr);
+        }
+        terminal_writestring("\n");
+    }
+}
+
+static const shell_command_t stats_commands[] = {
+    { "top",      "Show per-task CPU usage", top_cmd },
+    { "cpus",     "Show online CPUs and their run queues", cpus_cmd },
+    { "irqstat",  "Show IRQ counts and handler cycles [reset|irq]", irqstat_cmd },
+    { "lockstat", "Show lock acquisitions and contention [reset]", lockstat_cmd },
+    { "slabinfo", "Show heap and block pool usage", slabinfo_cmd },
+    { "vmstat",   "Show memory, switch and interrupt rates", vmstat_cmd },
+    { "profile",  "Sampling profiler [start [bt] [N]|stop|clear|serial]", profile_cmd },
+};
+
+void shell_stats_register(void) {
+    for (uint32_t i = 0; i < sizeof(stats_commands) / sizeof(stats_commands[0]); i++) {
+        shell_register_command(&stats_commands[i]);
+    }
+}
@@ -0,0 +1,211 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include "shm.h"
+#include "paging.h"
+#include "string.h"
+#include "lock.h"
+#include "user.h"
+
+extern uint32_t rust_allocate_page(void);
+extern void rust_free_page(uint32_t page);
+
+typedef struct {
+    char name[SHM_NAME_LEN];
+    uint32_t frames[SHM_MAX_PAGES];
+    uint32_t page_count;
+    uint32_t attach_count;
+    bool used;
+} shm_region_t;
+
+/* One per shm_attach(), so a process can only detach what it attached
+   and its mappings can be dropped when it exits */
+typedef struct {
+    uint32_t pid;
+    int32_t region;
+    uint32_t vaddr;
+    bool used;
+} shm_mapping_t;
+
+static shm_region_t regions[SHM_MAX_REGIONS];
+static shm_mapping_t mappings[SHM_MAX_MAPPINGS];
+
+/* Sleeping lock: shm_open() zeroes every page it allocates */
+static mutex_t shm_lock = MUTEX_INIT;
+
+static bool paging_active(void) {
+    return paging_get_current_directory() != NULL;
+}
+
+/* Freed last to first: the page allocator hands recently freed frames
+   back in reverse, so the next region gets them in ascending order and
+   stays contiguous when paging is off */
+static void release_region(shm_region_t* region) {
+    for (uint32_t i = region->page_count; i-- > 0; ) {
+        rust_free_page(region->frames[i]);
+    }
+    region->used = false;
+}
+
+static bool allocate_frames(shm_region_t* region, uint32_t page_count) {
+    region->page_count = 0;
+    for (uint32_t i = 0; i < page_count; i++) {
+        uint32_t frame = rust_allocate_page();
+        /* Without paging the region is used in place and must be contiguous */
+        bool contiguous = i == 0 || frame == region->frames[i - 1] + PAGE_SIZE;
+        if (frame == 0 || (!paging_active() && !contiguous)) {
+            if (frame != 0) rust_free_page(frame);
+            release_region(region);
+            return false;
+        }
+        region->frames[i] = frame;
+        region->page_count++;
+        memset((void*)frame, 0, PAGE_SIZE);
+    }
+    return true;
+}
+
+/* Returns the id of the region called name, creating it with size bytes
+   if it does not exist yet. */
+int32_t shm_open(const char* name, uint32_t size) {
+    uint32_t page_count = PAGE_ALIGN_UP(size) / PAGE_SIZE;
+    int32_t free_slot = -1;
+
+    if (!name || strlen(name) >= SHM_NAME_LEN) return -1;
+
+    mutex_lock(&shm_lock);
+    for (int32_t i = 0; i < SHM_MAX_REGIONS; i++) {
+        if (regions[i].used && strcmp(regions[i].name, name) == 0) {
+            mutex_unlock(&shm_lock);
+            return regions[i].page_count >= page_count ? i : -1;
+        }
+        if (!regions[i].used && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot < 0 || page_count == 0 || page_count > SHM_MAX_PAGES) {
+        mutex_unlock(&shm_lock);
+        return -1;
+    }
+
+    shm_region_t* region = &regions[free_slot];
+    region->used = true;
+    region->attach_count = 0;
+    strcpy(region->name, name);
+    if (!allocate_frames(region, page_count)) {
+        mutex_unlock(&shm_lock);
+        return -1;
+    }
+    mutex_unlock(&shm_lock);
+    return free_slot;
+}
+
+static shm_mapping_t* find_mapping(uint32_t pid, int32_t region, uint32_t vaddr) {
+    for (uint32_t i = 0; i < SHM_MAX_MAPPINGS; i++) {
+        shm_mapping_t* mapping = &mappings[i];
+        if (mapping->used && mapping->pid == pid && mapping->region == region &&
+            mapping->vaddr == vaddr) {
+            return mapping;
+        }
+    }
+    return NULL;
+}
+
+static shm_mapping_t* free_mapping(void) {
+    for (uint32_t i = 0; i < SHM_MAX_MAPPINGS; i++) {
+        if (!mappings[i].used) return &mappings[i];
+    }
+    return NULL;
+}
+
+static void unmap_pages(uint32_t virtual_addr, uint32_t page_count) {
+    for (uint32_t i = 0; i < page_count; i++) {
+        paging_unmap_page(virtual_addr + i * PAGE_SIZE);
+    }
+}
+
+/* Refuses to cover a page that is already mapped: its frame would be
+   lost from the directory and never freed */
+static bool map_region(const shm_region_t* region, uint32_t virtual_addr) {
+    for (uint32_t i = 0; i < region->page_count; i++) {
+        uint32_t page = virtual_addr + i * PAGE_SIZE;
+        if (paging_get_physical_address(page) != 0 ||
+            !paging_map_page(page, region->frames[i], PAGE_PRESENT | PAGE_WRITE | PAGE_USER)) {
+            unmap_pages(virtual_addr, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Drops one mapping; the last one frees the frames and the name */
+static void detach_mapping(shm_mapping_t* mapping) {
+    shm_region_t* region = &regions[mapping->region];
+    if (paging_active()) {
+        unmap_pages(mapping->vaddr, region->page_count);
+    }
+    mapping->used = false;
+    if (--region->attach_count == 0) {
+        release_region(region);
+    }
+}
+
+void* shm_attach(int32_t id, uint32_t virtual_addr) {
+    if (id < 0 || id >= SHM_MAX_REGIONS) return NULL;
+    if (paging_active() && (virtual_addr & (PAGE_SIZE - 1))) return NULL;
+
+    mutex_lock(&shm_lock);
+    shm_region_t* region = &regions[id];
+    shm_mapping_t* mapping = free_mapping();
+    void* base = NULL;
+    if (region->used && mapping) {
+        if (!paging_active()) {
+            base = (void*)region->frames[0];
+        } else if (map_region(region, virtual_addr)) {
+            base = (void*)virtual_addr;
+        }
+    }
+    if (base) {
+        mapping->pid = user_current_pid();
+        mapping->region = id;
+        mapping->vaddr = (uint32_t)base;
+        mapping->used = true;
+        region->attach_count++;
+    }
+    mutex_unlock(&shm_lock);
+    return base;
+}
+
+/* virtual_addr is the address shm_attach() returned to the caller */
+int32_t shm_detach(int32_t id, uint32_t virtual_addr) {
+    if (id < 0 || id >= SHM_MAX_REGIONS) return -1;
+
+    mutex_lock(&shm_lock);
+    shm_mapping_t* mapping = find_mapping(user_current_pid(), id, virtual_addr);
+    if (mapping) {
+        detach_mapping(mapping);
+    }
+    mutex_unlock(&shm_lock);
+    return mapping ? 0 : -1;
+}
+
+/* Called while the exiting process's directory is still loaded */
+void shm_detach_all(uint32_t pid) {
+    mutex_lock(&shm_lock);
+    for (uint32_t i = 0; i < SHM_MAX_MAPPINGS; i++) {
+        if (mappings[i].used && mappings[i].pid == pid) {
+            detach_mapping(&mappings[i]);
+        }
+    }
+    mutex_unlock(&shm_lock);
+}
+
+/* Bytes an attach of region id maps, 0 if there is no such region */
+uint32_t shm_size(int32_t id) {
+    if (id < 0 || id >= SHM_MAX_REGIONS) return 0;
+
+    mutex_lock(&shm_lock);
+    uint32_t size = regions[id].used ? regions[id].page_count * PAGE_SIZE : 0;
+    mutex_unlock(&shm_lock);
+    return size;
+}
@@ -0,0 +1,17 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+
+#define SHM_MAX_REGIONS 8
+#define SHM_MAX_PAGES   16
+#define SHM_NAME_LEN    16
+#define SHM_MAX_MAPPINGS 32
+
+int32_t shm_open(const char* name, uint32_t size);
+void* shm_attach(int32_t id, uint32_t virtual_addr);
+int32_t shm_detach(int32_t id, uint32_t virtual_addr);
+void shm_detach_all(uint32_t pid);
+uint32_t shm_size(int32_t id);
+
+#endif
@@ -0,0 +1,139 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "timer.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "task.h"
+#include "paging.h"
+#include "string.h"
+
+/* 8 KB boot stack per AP; it becomes that CPU's idle task stack */
+#define AP_STACK_WORDS 2048
+
+#define AP_INIT_DELAY_US    10000
+#define AP_SIPI_DELAY_US    200
+#define AP_ONLINE_TIMEOUT_MS 100
+
+typedef struct {
+    uint32_t stack;
+    uint32_t entry;
+} trampoline_params_t;
+
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_end[];
+extern uint8_t smp_trampoline_params[];
+
+cpu_t cpus[MAX_CPUS];
+static uint32_t cpu_count = 1;
+static uint32_t ap_stacks[MAX_CPUS][AP_STACK_WORDS] __attribute__((aligned(16)));
+static volatile uint32_t ap_booting;    /* cpus[] slot of the AP being started */
+static volatile bool ap_answered[MAX_CPUS];
+
+void percpu_init(void) {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpus[i].self = &cpus[i];
+        cpus[i].id = i;
+        gdt_set_gate(GDT_PERCPU_FIRST + i, (uint32_t)&cpus[i], sizeof(cpu_t) - 1, 0x92, 0x40);
+    }
+    percpu_load(0);
+    cpus[0].online = true;
+}
+
+void percpu_load(uint32_t id) {
+    uint16_t selector = GDT_PERCPU_SELECTOR(id);
+    __asm__ volatile("mov %0, %%gs" : : "r"(selector) : "memory");
+    tss_load(id);
+}
+
+uint32_t percpu_id(void) {
+    return cpu_id();
+}
+
+/* First C code on an AP, on its own stack with interrupts off */
+static void ap_main(void) {
+    uint32_t id = ap_booting;
+
+    gdt_load();
+    idt_reload();
+    percpu_load(id);
+    paging_init_cpu();
+    fpu_cpu_init();
+    lapic_init();
+    if (!task_init_cpu()) {
+        for (;;) __asm__ volatile("cli\n\thlt");
+    }
+    __atomic_store_n(&cpus[id].online, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&ap_answered[id], true, __ATOMIC_RELEASE);
+
+    for (;;) {
+        task_idle();
+    }
+}
+
+static bool ap_has_answered(uint32_t id) {
+    return __atomic_load_n(&ap_answered[id], __ATOMIC_ACQUIRE);
+}
+
+/* INIT, 10 ms, SIPI, 200 us, and a second SIPI if the AP has not
+   answered, as in the Intel MP startup sequence */
+static bool start_ap(uint32_t id) {
+    trampoline_params_t* params = (trampoline_params_t*)
+        (SMP_TRAMPOLINE_BASE + (uint32_t)(smp_trampoline_params - smp_trampoline_start));
+    params->stack = (uint32_t)&ap_stacks[id][AP_STACK_WORDS];
+    params->entry = (uint32_t)ap_main;
+    ap_booting = id;
+
+    uint32_t apic_id = cpus[id].apic_id;
+    lapic_send_init(apic_id);
+    timer_udelay(AP_INIT_DELAY_US);
+    for (int attempt = 0; attempt < 2 && !ap_has_answered(id); attempt++) {
+        lapic_send_startup(apic_id, SMP_TRAMPOLINE_BASE >> 12);
+        timer_udelay(AP_SIPI_DELAY_US);
+    }
+    for (int ms = 0; ms < AP_ONLINE_TIMEOUT_MS && !ap_has_answered(id); ms++) {
+        timer_udelay(1000);
+    }
+    return ap_has_answered(id);
+}
+
+uint32_t smp_init(void) {
+    acpi_madt_info_t madt;
+
+    if (!cpu_has(CPU_FEATURE_APIC)) {
+        return cpu_count;
+    }
+    bool have_madt = acpi_parse_madt(&madt);
+    lapic_setup(madt.lapic_base);
+    cpus[0].apic_id = lapic_id();
+    lapic_init();
+    if (!have_madt) {
+        return cpu_count;
+    }
+
+    memcpy((void*)SMP_TRAMPOLINE_BASE, smp_trampoline_start,
+           (size_t)(smp_trampoline_end - smp_trampoline_start));
+
+    /* A slot whose AP did not answer is not reused: the AP may still
+       come up late and would then share it. */
+    uint32_t slot = 1;
+    for (uint32_t i = 0; i < madt.cpu_count && slot < MAX_CPUS; i++) {
+        if (madt.apic_ids[i] == cpus[0].apic_id) {
+            continue;
+        }
+        cpus[slot].apic_id = madt.apic_ids[i];
+        if (start_ap(slot) && cpu_online(slot)) {
+            cpu_count++;
+        }
+        slot++;
+    }
+    return cpu_count;
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
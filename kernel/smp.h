@@ -0,0 +1,18 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "percpu.h"
+
+#define SMP_TRAMPOLINE_BASE 0x8000
+
+/* Finds the processors in the ACPI MADT, enables the BSP's local APIC
+   and starts every AP with INIT-SIPI-SIPI. An AP sets up its GDT, IDT,
+   per-CPU segment, FPU and local APIC, then runs its own idle loop and
+   takes tasks from its run queue. Falls back to the BSP alone (PIT
+   only) when there is no local APIC or MADT. Returns the number of CPUs
+   online. */
+uint32_t smp_init(void);
+uint32_t smp_cpu_count(void);
+
+#endif
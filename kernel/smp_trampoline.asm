@@ -0,0 +1,68 @@
+; Application processor entry. smp_init() copies smp_trampoline_start ..
+; smp_trampoline_end to SMP_TRAMPOLINE_BASE and points the startup IPI at
+; it, so the AP begins here in real mode at CS:IP = 0800:0000. Addresses
+; are computed relative to the copy, not to where this was linked.
+
+SMP_TRAMPOLINE_BASE equ 0x8000
+
+%define TRAMPOLINE(label) ((label) - smp_trampoline_start + SMP_TRAMPOLINE_BASE)
+
+section .text
+
+global smp_trampoline_start
+global smp_trampoline_end
+global smp_trampoline_params
+
+BITS 16
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMPOLINE(trampoline_gdt_ptr)]
+
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(trampoline_pm)
+
+BITS 32
+trampoline_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Stack and entry point were filled in by smp_init() for this AP
+    mov esp, [TRAMPOLINE(trampoline_stack)]
+    mov eax, [TRAMPOLINE(trampoline_entry)]
+    call eax
+
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; Flat code and data, same layout as the kernel GDT so the selectors
+; stay valid until the AP loads the real table
+align 8
+trampoline_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF
+    dq 0x00CF92000000FFFF
+trampoline_gdt_ptr:
+    dw trampoline_gdt_ptr - trampoline_gdt - 1
+    dd TRAMPOLINE(trampoline_gdt)
+
+align 4
+smp_trampoline_params:
+trampoline_stack:
+    dd 0
+trampoline_entry:
+    dd 0
+
+smp_trampoline_end:
+
+section .note.GNU-stack noalloc noexec nowrite progbits
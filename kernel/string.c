@@ -1,34 +1,185 @@
+#include <stdbool.h>
 #include "string.h"
+#include "cpu.h"
 
-void* memset(void* ptr, int value, size_t num) {
-    if (!ptr || num == 0) {
-        return ptr;
+/* Size classes for the mem* routines:
+     n < MEM_SMALL_MAX            unrolled 32-bit loads and stores
+     n < mem_nt_threshold         rep movsd/stosd (rep movsb/stosb with ERMS)
+     larger                       MOVNTI non-temporal stores, bypassing the cache
+   MOVNTI works on general registers, so the large path needs SSE2 in
+   CPUID but never touches FPU/SSE state. */
+#define MEM_SMALL_MAX      64
+#define MEM_NT_THRESHOLD   (64 * 1024)
+#define MEM_LINE           64
+#define MEM_PREFETCH       256
+
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32;
+
+static size_t mem_nt_threshold = (size_t)-1;
+static bool mem_erms = false;
+
+void mem_init(void) {
+    mem_erms = cpu_has(CPU_FEATURE_ERMS);
+    mem_nt_threshold = cpu_has(CPU_FEATURE_SSE2) ? MEM_NT_THRESHOLD : (size_t)-1;
+}
+
+static inline void copy_small(uint8_t* d, const uint8_t* s, size_t n) {
+    while (n >= 16) {
+        uint32_t a = ((const unaligned_u32*)s)[0];
+        uint32_t b = ((const unaligned_u32*)s)[1];
+        uint32_t c = ((const unaligned_u32*)s)[2];
+        uint32_t e = ((const unaligned_u32*)s)[3];
+        ((unaligned_u32*)d)[0] = a;
+        ((unaligned_u32*)d)[1] = b;
+        ((unaligned_u32*)d)[2] = c;
+        ((unaligned_u32*)d)[3] = e;
+        d += 16;
+        s += 16;
+        n -= 16;
     }
-    unsigned char* p = ptr;
-    while (num--) {
-        *p++ = (unsigned char)value;
+    while (n >= 4) {
+        *(unaligned_u32*)d = *(const unaligned_u32*)s;
+        d += 4;
+        s += 4;
+        n -= 4;
     }
-    return ptr;
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+static inline void copy_rep(uint8_t* d, const uint8_t* s, size_t n) {
+    if (mem_erms) {
+        __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+        return;
+    }
+    size_t words = n >> 2;
+    n &= 3;
+    __asm__ volatile("rep movsl\n\t"
+                     "mov %3, %2\n\t"
+                     "rep movsb"
+                     : "+D"(d), "+S"(s), "+c"(words)
+                     : "r"(n)
+                     : "memory");
+}
+
+static void copy_nt(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t head = -(uintptr_t)d & (MEM_LINE - 1);
+    copy_rep(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    for (size_t lines = n / MEM_LINE; lines > 0; lines--) {
+        __asm__ volatile("prefetchnta %0" : : "m"(s[MEM_PREFETCH]));
+        for (int i = 0; i < MEM_LINE / 4; i++) {
+            uint32_t v = ((const unaligned_u32*)s)[i];
+            __asm__ volatile("movnti %1, %0" : "=m"(((uint32_t*)d)[i]) : "r"(v));
+        }
+        d += MEM_LINE;
+        s += MEM_LINE;
+    }
+    __asm__ volatile("sfence" : : : "memory");
+    copy_rep(d, s, n & (MEM_LINE - 1));
 }
 
 void* memcpy(void* dest, const void* src, size_t n) {
-    if (!dest || !src || n == 0) {
-        return dest;
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    if (n < MEM_SMALL_MAX) {
+        copy_small(d, s, n);
+    } else if (n < mem_nt_threshold) {
+        copy_rep(d, s, n);
+    } else {
+        copy_nt(d, s, n);
     }
-    unsigned char* d = dest;
-    const unsigned char* s = src;
-    while (n--) {
-        *d++ = *s++;
+    return dest;
+}
+
+/* Forward copies are safe whenever dest is below src, so only the
+   overlapping dest > src case needs a backward copy. */
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+
+    d += n;
+    s += n;
+    for (size_t tail = n & 3; tail > 0; tail--) {
+        *--d = *--s;
+    }
+    size_t words = n >> 2;
+    if (words) {
+        d -= 4;
+        s -= 4;
+        __asm__ volatile("std\n\t"
+                         "rep movsl\n\t"
+                         "cld"
+                         : "+D"(d), "+S"(s), "+c"(words)
+                         :
+                         : "memory");
     }
     return dest;
 }
 
+void* memset(void* ptr, int value, size_t num) {
+    uint8_t* p = ptr;
+    uint32_t pattern = (uint8_t)value * 0x01010101u;
+
+    if (num < MEM_SMALL_MAX) {
+        while (num >= 4) {
+            *(unaligned_u32*)p = pattern;
+            p += 4;
+            num -= 4;
+        }
+        while (num--) {
+            *p++ = (uint8_t)value;
+        }
+        return ptr;
+    }
+
+    if (num >= mem_nt_threshold) {
+        size_t head = -(uintptr_t)p & (MEM_LINE - 1);
+        num -= head;
+        __asm__ volatile("rep stosb" : "+D"(p), "+c"(head) : "a"(pattern) : "memory");
+        for (size_t lines = num / MEM_LINE; lines > 0; lines--) {
+            for (int i = 0; i < MEM_LINE / 4; i++) {
+                __asm__ volatile("movnti %1, %0" : "=m"(((uint32_t*)p)[i]) : "r"(pattern));
+            }
+            p += MEM_LINE;
+        }
+        __asm__ volatile("sfence" : : : "memory");
+        num &= MEM_LINE - 1;
+    }
+
+    if (mem_erms) {
+        __asm__ volatile("rep stosb" : "+D"(p), "+c"(num) : "a"(pattern) : "memory");
+    } else {
+        size_t words = num >> 2;
+        num &= 3;
+        __asm__ volatile("rep stosl\n\t"
+                         "mov %3, %1\n\t"
+                         "rep stosb"
+                         : "+D"(p), "+c"(words)
+                         : "a"(pattern), "r"(num)
+                         : "memory");
+    }
+    return ptr;
+}
+
 int memcmp(const void* s1, const void* s2, size_t n) {
-    if (!s1 || !s2) {
-        return 0;
+    const uint8_t* p1 = s1;
+    const uint8_t* p2 = s2;
+
+    while (n >= 4 && *(const unaligned_u32*)p1 == *(const unaligned_u32*)p2) {
+        p1 += 4;
+        p2 += 4;
+        n -= 4;
     }
-    const unsigned char* p1 = s1;
-    const unsigned char* p2 = s2;
     while (n--) {
         if (*p1 != *p2) {
             return *p1 - *p2;
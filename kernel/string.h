@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+void mem_init(void);
 void* memset(void* ptr, int value, size_t num);
 void* memcpy(void* dest, const void* src, size_t n);
 void* memmove(void* dest, const void* src, size_t n);
@@ -22,7 +22,16 @@ syscall_handler:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    
+    ; A call from ring 3 arrives with the user GS; the per-CPU selector
+    ; is 64 bytes below this CPU's TSS selector (kernel/gdt.h)
+    test byte [esp + 56], 3
+    jz .kernel_gs
+    str ax
+    sub ax, 64
     mov gs, ax
+.kernel_gs:
+    cld
     
     ; System call arguments from registers
     ; EAX = syscall number
@@ -32,6 +41,9 @@ syscall_handler:
     ; ESI = arg4
     ; EDI = arg5
     
+    ; AX was used for the selectors; take the number back from the frame
+    mov eax, [esp + 44]
+    
     push edi
     push esi
     push edx
@@ -45,8 +57,9 @@ syscall_handler:
     ; Clean up arguments
     add esp, 24
     
-    ; Save return value
-    mov [esp + 28], eax
+    ; Save return value into the EAX slot of the PUSHAD frame
+    ; (above the four segment registers)
+    mov [esp + 44], eax
     
     ; Restore registers
     pop gs
@@ -2,13 +2,20 @@
 #include "idt.h"
 #include "terminal.h"
 #include "string.h"
+#include "futex.h"
+#include "shm.h"
+#include "user.h"
 
 extern void syscall_handler(void);
 
 static syscall_handler_t syscall_table[MAX_SYSCALLS];
 static uint32_t next_pid = 1;
 
+/* Ends a user process; a kernel caller only gets the message */
 static int32_t sys_exit(uint32_t code) {
+    if (user_current_pid() != 0) {
+        user_exit((int32_t)code);
+    }
     terminal_writestring("[SYSCALL] Process exit with code: ");
     char buf[16];
     itoa_simple((int32_t)code, buf);
@@ -18,6 +25,7 @@ static int32_t sys_exit(uint32_t code) {
 }
 
 static int32_t sys_write(uint32_t fd, uint32_t buf, uint32_t count) {
+    if (!user_access_ok(buf, count)) return -1;
     if (fd == 1 || fd == 2) {
         const char* str = (const char*)buf;
         for (uint32_t i = 0; i < count; i++) {
@@ -47,7 +55,8 @@ static int32_t sys_close(uint32_t fd) {
 }
 
 static int32_t sys_getpid(void) {
-    return (int32_t)next_pid;
+    uint32_t pid = user_current_pid();
+    return (int32_t)(pid ? pid : next_pid);
 }
 
 static int32_t sys_sleep(uint32_t milliseconds) {
@@ -56,6 +65,7 @@ static int32_t sys_sleep(uint32_t milliseconds) {
 }
 
 static int32_t sys_gettime(uint32_t time_ptr) {
+    if (!user_access_ok(time_ptr, sizeof(uint32_t))) return -1;
     if (time_ptr) {
         uint32_t* ptr = (uint32_t*)time_ptr;
         *ptr = 0;
@@ -74,6 +84,33 @@ static int32_t sys_mmap(uint32_t addr, uint32_t length) {
     return -1;
 }
 
+static int32_t sys_futex_wait(uint32_t addr, uint32_t expected) {
+    if (addr == 0 || (addr & 3) || !user_access_ok(addr, sizeof(uint32_t))) return -1;
+    return futex_wait((volatile uint32_t*)addr, expected);
+}
+
+static int32_t sys_futex_wake(uint32_t addr, uint32_t count) {
+    if (addr == 0 || (addr & 3) || !user_access_ok(addr, sizeof(uint32_t))) return -1;
+    return futex_wake((volatile uint32_t*)addr, count);
+}
+
+static int32_t sys_shm_open(uint32_t name, uint32_t size) {
+    if (!user_access_ok(name, SHM_NAME_LEN)) return -1;
+    return shm_open((const char*)name, size);
+}
+
+/* The whole region must land in the user window, not just its first page */
+static int32_t sys_shm_attach(uint32_t id, uint32_t virtual_addr) {
+    uint32_t size = shm_size((int32_t)id);
+    if (size == 0 || !user_access_ok(virtual_addr, size)) return -1;
+    void* addr = shm_attach((int32_t)id, virtual_addr);
+    return addr ? (int32_t)addr : -1;
+}
+
+static int32_t sys_shm_detach(uint32_t id, uint32_t virtual_addr) {
+    return shm_detach((int32_t)id, virtual_addr);
+}
+
 int32_t syscall_dispatch(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t arg5) {
     (void)arg4;
     (void)arg5;
@@ -81,6 +118,7 @@ int32_t syscall_dispatch(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t ar
     if (num >= MAX_SYSCALLS || syscall_table[num] == NULL) {
         return -1;
     }
+    user_account_syscall();
 
     return syscall_table[num](arg1, arg2, arg3, arg4, arg5);
 }
@@ -96,6 +134,11 @@ void syscall_init(void) {
     syscall_table[SYS_GETTIME] = (syscall_handler_t)sys_gettime;
     syscall_table[SYS_SBRK] = (syscall_handler_t)sys_sbrk;
     syscall_table[SYS_MMAP] = (syscall_handler_t)sys_mmap;
+    syscall_table[SYS_FUTEX_WAIT] = (syscall_handler_t)sys_futex_wait;
+    syscall_table[SYS_FUTEX_WAKE] = (syscall_handler_t)sys_futex_wake;
+    syscall_table[SYS_SHM_OPEN] = (syscall_handler_t)sys_shm_open;
+    syscall_table[SYS_SHM_ATTACH] = (syscall_handler_t)sys_shm_attach;
+    syscall_table[SYS_SHM_DETACH] = (syscall_handler_t)sys_shm_detach;
 
     idt_set_gate(SYSCALL_INT, (uint32_t)syscall_handler, 0x08, 0xEE);
 }
@@ -15,12 +15,18 @@
 #define SYS_GETTIME   7
 #define SYS_SBRK      8
 #define SYS_MMAP      9
+#define SYS_FUTEX_WAIT 10
+#define SYS_FUTEX_WAKE 11
+#define SYS_SHM_OPEN   12
+#define SYS_SHM_ATTACH 13
+#define SYS_SHM_DETACH 14
 
-#define MAX_SYSCALLS  10
+#define MAX_SYSCALLS  15
 
 typedef int32_t (*syscall_handler_t)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 
 void syscall_init(void);
 int32_t syscall_dispatch(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t arg5);
+void itoa_simple(int32_t val, char* buf);
 
 #endif
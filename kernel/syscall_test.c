@@ -1,3 +1,4 @@
+#include "syscall.h"
 #include "syscall_wrapper.h"
 #include "terminal.h"
 
@@ -60,5 +61,3 @@ void syscall_test(void) {
 
     terminal_writestring("\n=== All syscall tests completed ===\n");
 }
-
-void itoa_simple(int32_t val, char* buf);
@@ -57,5 +57,10 @@ static inline int32_t syscall3(uint32_t num, uint32_t arg1, uint32_t arg2, uint3
 #define gettime(ptr) syscall1(7, (uint32_t)(ptr))
 #define sbrk(inc) syscall1(8, inc)
 #define mmap(addr, len) syscall2(9, addr, len)
+#define futex_wait(addr, expected) syscall2(10, (uint32_t)(addr), expected)
+#define futex_wake(addr, count) syscall2(11, (uint32_t)(addr), count)
+#define shm_open(name, size) syscall2(12, (uint32_t)(name), size)
+#define shm_attach(id, addr) syscall2(13, id, addr)
+#define shm_detach(id, addr) syscall2(14, id, addr)
 
 #endif
@@ -2,67 +2,495 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "task.h"
+#include "cpu.h"
+#include "trace.h"
+#include "fpu.h"
+#include "percpu.h"
+#include "lock.h"
+#include "apic.h"
+#include "paging.h"
+#include "gdt.h"
 
-#define MAX_TASKS 8
+/* 8 KB: the shell task runs commands that call into Rust */
+#define TASK_STACK_WORDS 2048
+
+_Static_assert(MAX_TASKS > MAX_CPUS, "every CPU needs an idle task");
+_Static_assert((MAX_TASKS & (MAX_TASKS - 1)) == 0, "run queue index wraps with a mask");
 
 typedef struct {
-    uint32_t eax, ebx, ecx, edx;
-    uint32_t esi, edi, ebp;
     uint32_t eip, esp;
     uint32_t eflags;
 } task_context_t;
 
 typedef struct {
+    fpu_state_t fpu;
     uint32_t id;
     task_context_t context;
     uint32_t* stack;
-    task_state_t state;
+    void (*entry)(void);
+    page_directory_t* directory;    /* user address space, or NULL */
+    volatile task_state_t state;
+    uint32_t cpu;               /* runs on, last ran on, or is queued on */
+    volatile bool on_cpu;       /* context_switch has not saved it yet */
+    bool wake_pending;          /* woken while not blocked */
+    bool idle;
+    spinlock_t lock;            /* block/unblock state changes */
+    uint64_t cpu_cycles;
+    uint32_t switches;
 } task_t;
 
+/* Each CPU has a FIFO of READY tasks and an idle task that is never
+   queued. A task is in at most one queue. A CPU with nothing queued
+   steals from the others before it idles. */
+typedef struct {
+    spinlock_t lock;
+    uint8_t tids[MAX_TASKS];
+    uint32_t head;
+    uint32_t count;
+    uint32_t idle_task;
+    uint32_t prev;              /* task this CPU last switched away from */
+    bool requeue_prev;
+    uint64_t slice_start;
+    uint32_t switches;
+    uint32_t steals;
+} runqueue_t;
+
 static task_t tasks[MAX_TASKS];
-static uint32_t current_task = 0;
 static uint32_t task_count = 0;
-static uint32_t task_stacks[MAX_TASKS][1024] __attribute__((aligned(16)));
+static spinlock_t task_alloc_lock = SPINLOCK_INIT;
+static runqueue_t runqueues[MAX_CPUS];
+static uint32_t task_stacks[MAX_TASKS][TASK_STACK_WORDS] __attribute__((aligned(16)));
 
-uint32_t task_create(void (*entry)(void)) {
-    if (task_count >= MAX_TASKS) return (uint32_t)-1;
-    uint32_t tid = task_count++;
-    tasks[tid].id = tid;
-    tasks[tid].state = TASK_READY;
-    tasks[tid].stack = task_stacks[tid];
-    uint32_t* stack_top = &task_stacks[tid][1024];
-    stack_top--; *stack_top = 0x00000202;
-    stack_top--; *stack_top = 0x08;
-    stack_top--; *stack_top = (uint32_t)entry;
-    for (int i = 0; i < 8; i++) { stack_top--; *stack_top = 0; }
-    tasks[tid].context.esp = (uint32_t)stack_top;
-    tasks[tid].context.eip = (uint32_t)entry;
-    tasks[tid].context.eflags = 0x202;
+extern void context_switch(uint32_t* old_esp, uint32_t new_esp);
+
+static void rq_push(runqueue_t* rq, uint32_t tid) {
+    spin_lock(&rq->lock);
+    rq->tids[(rq->head + rq->count) & (MAX_TASKS - 1)] = (uint8_t)tid;
+    __atomic_store_n(&rq->count, rq->count + 1, __ATOMIC_RELAXED);
+    spin_unlock(&rq->lock);
+}
+
+/* count is read unlocked first so empty queues cost no lock traffic */
+static int32_t rq_pop(runqueue_t* rq) {
+    if (__atomic_load_n(&rq->count, __ATOMIC_RELAXED) == 0) {
+        return -1;
+    }
+    int32_t tid = -1;
+    spin_lock(&rq->lock);
+    if (rq->count > 0) {
+        tid = rq->tids[rq->head];
+        rq->head = (rq->head + 1) & (MAX_TASKS - 1);
+        __atomic_store_n(&rq->count, rq->count - 1, __ATOMIC_RELAXED);
+    }
+    spin_unlock(&rq->lock);
+    return tid;
+}
+
+static bool rq_remove(runqueue_t* rq, uint32_t tid) {
+    bool found = false;
+    spin_lock(&rq->lock);
+    for (uint32_t i = 0; i < rq->count; i++) {
+        if (rq->tids[(rq->head + i) & (MAX_TASKS - 1)] != tid) {
+            continue;
+        }
+        for (uint32_t j = i; j + 1 < rq->count; j++) {
+            rq->tids[(rq->head + j) & (MAX_TASKS - 1)] = rq->tids[(rq->head + j + 1) & (MAX_TASKS - 1)];
+        }
+        __atomic_store_n(&rq->count, rq->count - 1, __ATOMIC_RELAXED);
+        found = true;
+        break;
+    }
+    spin_unlock(&rq->lock);
+    return found;
+}
+
+static bool cpu_is_idle(uint32_t cpu) {
+    return cpus[cpu].current == runqueues[cpu].idle_task &&
+           __atomic_load_n(&runqueues[cpu].count, __ATOMIC_RELAXED) == 0;
+}
+
+/* Prefer the CPU the task last ran on. If that one is busy, hand the
+   task to an idle CPU rather than leave it waiting to be stolen. */
+static uint32_t select_cpu(uint32_t preferred) {
+    if (cpu_online(preferred) && cpu_is_idle(preferred)) {
+        return preferred;
+    }
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_online(cpu) && cpu_is_idle(cpu)) {
+            return cpu;
+        }
+    }
+    return cpu_online(preferred) ? preferred : cpu_id();
+}
+
+/* A remote CPU sitting in its idle hlt is kicked with an IPI */
+static void enqueue(uint32_t tid, uint32_t cpu) {
+    tasks[tid].cpu = cpu;
+    rq_push(&runqueues[cpu], tid);
+    if (cpu != cpu_id() && lapic_present() && cpus[cpu].current == runqueues[cpu].idle_task) {
+        lapic_send_ipi(cpus[cpu].apic_id, APIC_VECTOR_RESCHED);
+    }
+}
+
+/* Runs on the new task's stack right after context_switch. The task
+   switched away from is only requeued now, with its registers saved,
+   so no other CPU can pick it up half-switched. */
+static void finish_switch(void) {
+    runqueue_t* rq = &runqueues[cpu_id()];
+    uint32_t prev = rq->prev;
+    bool requeue = rq->requeue_prev;
+
+    __atomic_store_n(&tasks[prev].on_cpu, false, __ATOMIC_RELEASE);
+    if (requeue) {
+        rq_push(rq, prev);
+    }
+}
+
+void task_exit(void) {
+    uint32_t flags = irq_save();
+    task_t* task = &tasks[this_cpu()->current];
+    spin_lock(&task->lock);
+    task->state = TASK_TERMINATED;
+    spin_unlock(&task->lock);
+    fpu_release(&task->fpu);
+    task_switch();
+    irq_restore(flags);
+    for (;;) __asm__ volatile("hlt");
+}
+
+static void task_start(void) {
+    finish_switch();
+    __asm__ volatile("sti");
+    tasks[this_cpu()->current].entry();
+    task_exit();
+}
+
+/* A terminated task's slot is used again once no CPU is still on its
+   stack; task_alloc_lock held */
+static int32_t alloc_slot(void) {
+    for (uint32_t tid = 0; tid < task_count; tid++) {
+        if (tasks[tid].state == TASK_TERMINATED &&
+            !__atomic_load_n(&tasks[tid].on_cpu, __ATOMIC_ACQUIRE)) {
+            return (int32_t)tid;
+        }
+    }
+    return task_count < MAX_TASKS ? (int32_t)task_count : -1;
+}
+
+static uint32_t create_task(void (*entry)(void), page_directory_t* directory) {
+    uint32_t flags = irq_save();
+    spin_lock(&task_alloc_lock);
+    int32_t slot = alloc_slot();
+    if (slot < 0) {
+        spin_unlock(&task_alloc_lock);
+        irq_restore(flags);
+        return (uint32_t)-1;
+    }
+    uint32_t tid = (uint32_t)slot;
+    task_t* task = &tasks[tid];
+    task->id = tid;
+    task->stack = task_stacks[tid];
+    task->entry = entry;
+    task->directory = directory;
+
+    /* Initial frame consumed by context_switch: EFLAGS, EDI, ESI, EBX, EBP,
+       then task_start as return address. Interrupts stay off until
+       task_start has finished the switch. */
+    uint32_t* stack_top = &task_stacks[tid][TASK_STACK_WORDS];
+    stack_top--; *stack_top = 0;
+    stack_top--; *stack_top = (uint32_t)task_start;
+    for (int i = 0; i < 4; i++) { stack_top--; *stack_top = 0; }
+    stack_top--; *stack_top = 0x00000002;
+    task->context.esp = (uint32_t)stack_top;
+    task->context.eip = (uint32_t)entry;
+    task->context.eflags = 0x202;
+    task->on_cpu = false;
+    task->wake_pending = false;
+    task->idle = false;
+    spin_init(&task->lock);
+    task->cpu_cycles = 0;
+    task->switches = 0;
+    fpu_task_init(&task->fpu);
+    task->state = TASK_READY;
+    if (tid == task_count) {
+        __atomic_store_n(&task_count, tid + 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock(&task_alloc_lock);
+
+    enqueue(tid, select_cpu(cpu_id()));
+    irq_restore(flags);
     return tid;
 }
 
+uint32_t task_create(void (*entry)(void)) {
+    return create_task(entry, NULL);
+}
+
+/* The task runs entry in ring 0 with directory loaded; entry is expected
+   to drop to ring 3 from there */
+uint32_t task_create_user(void (*entry)(void), page_directory_t* directory) {
+    return create_task(entry, directory);
+}
+
+page_directory_t* task_release_directory(void) {
+    uint32_t flags = irq_save();
+    task_t* task = &tasks[this_cpu()->current];
+    page_directory_t* directory = task->directory;
+    task->directory = NULL;
+    paging_switch_directory(NULL);
+    irq_restore(flags);
+    return directory;
+}
+
+/* Must be called with interrupts disabled. */
+static void switch_to(uint32_t next) {
+    cpu_t* cpu = this_cpu();
+    runqueue_t* rq = &runqueues[cpu->id];
+    uint32_t prev = cpu->current;
+    if (next == prev) {
+        tasks[prev].state = TASK_RUNNING;
+        return;
+    }
+
+    rq->requeue_prev = false;
+    if (tasks[prev].state == TASK_RUNNING) {
+        tasks[prev].state = TASK_READY;
+        rq->requeue_prev = !tasks[prev].idle;
+    }
+
+    /* A task woken while its old CPU was still switching away from it
+       can be queued before its registers are saved */
+    while (__atomic_load_n(&tasks[next].on_cpu, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+    tasks[next].on_cpu = true;
+    tasks[next].state = TASK_RUNNING;
+    tasks[next].cpu = cpu->id;
+    cpu->current = next;
+    rq->prev = prev;
+
+    uint64_t now = rdtsc();
+    tasks[prev].cpu_cycles += now - rq->slice_start;
+    rq->slice_start = now;
+    tasks[next].switches++;
+    rq->switches++;
+
+    TRACE3(TRACE_DEBUG, TRACE_MOD_SCHED, "cpu %u switch %u -> %u", cpu->id, prev, next);
+    fpu_switch(&tasks[prev].fpu, &tasks[next].fpu);
+    if (tasks[next].directory) {
+        tss_set_kernel_stack((uint32_t)&tasks[next].stack[TASK_STACK_WORDS]);
+    }
+    paging_switch_directory(tasks[next].directory);
+    context_switch(&tasks[prev].context.esp, tasks[next].context.esp);
+    finish_switch();
+}
+
+/* Only a CPU about to go idle steals, from the head of the first
+   non-empty queue after its own */
+static int32_t steal_task(uint32_t self) {
+    for (uint32_t i = 1; i < MAX_CPUS; i++) {
+        uint32_t victim = (self + i) % MAX_CPUS;
+        if (!cpu_online(victim)) {
+            continue;
+        }
+        int32_t tid = rq_pop(&runqueues[victim]);
+        if (tid >= 0) {
+            runqueues[self].steals++;
+            return tid;
+        }
+    }
+    return -1;
+}
+
 void task_switch(void) {
-    uint32_t old_task = current_task;
-    do {
-        current_task = (current_task + 1) % task_count;
-    } while (tasks[current_task].state != TASK_READY && current_task != old_task);
-    if (current_task == old_task) return;
-    __asm__ volatile(
-        "cli\n\t" "pusha\n\t" "pushf\n\t"
-        "mov %%esp, %0\n\t" "mov %1, %%esp\n\t"
-        "popf\n\t" "popa\n\t" "sti\n\t"
-        : "=m"(tasks[old_task].context.esp)
-        : "m"(tasks[current_task].context.esp)
-    );
+    uint32_t flags = irq_save();
+    cpu_t* cpu = this_cpu();
+    runqueue_t* rq = &runqueues[cpu->id];
+    uint32_t current = cpu->current;
+    bool runnable = tasks[current].state == TASK_RUNNING;
+
+    int32_t next = rq_pop(rq);
+    if (next < 0 && (!runnable || current == rq->idle_task)) {
+        next = steal_task(cpu->id);
+    }
+    /* Nothing else can run and we cannot continue: the idle task halts
+       until an interrupt or IPI makes some task ready. */
+    if (next < 0 && !runnable) {
+        next = (int32_t)rq->idle_task;
+    }
+
+    if (next >= 0) {
+        switch_to((uint32_t)next);
+    }
+    irq_restore(flags);
 }
 
 void task_yield(void) { task_switch(); }
-uint32_t task_get_current(void) { return current_task; }
+
+/* True if this CPU has queued work or could steal some */
+bool task_has_ready(void) {
+    uint32_t self = cpu_id();
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        uint32_t cpu = (self + i) % MAX_CPUS;
+        if (cpu_online(cpu) && __atomic_load_n(&runqueues[cpu].count, __ATOMIC_RELAXED) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* sti;hlt is atomic, so a wake-up or IPI that lands after the check
+   still ends the halt */
+void task_idle(void) {
+    __asm__ volatile("cli");
+    if (task_has_ready()) {
+        __asm__ volatile("sti");
+        task_yield();
+    } else {
+        __asm__ volatile("sti\n\thlt");
+    }
+}
+
+uint32_t task_get_current(void) { return this_cpu()->current; }
+
+bool task_current_is_idle(void) { return tasks[this_cpu()->current].idle; }
+
+/* A wake-up that arrives before the task blocks is kept in wake_pending,
+   so the block returns at once instead of sleeping through it. */
+void task_block(void) {
+    uint32_t flags = irq_save();
+    task_t* task = &tasks[this_cpu()->current];
+    spin_lock(&task->lock);
+    if (task->wake_pending) {
+        task->wake_pending = false;
+        spin_unlock(&task->lock);
+        irq_restore(flags);
+        return;
+    }
+    task->state = TASK_BLOCKED;
+    spin_unlock(&task->lock);
+    task_switch();
+    irq_restore(flags);
+}
+
+bool task_unblock(uint32_t tid) {
+    if (tid >= task_count) return false;
+    uint32_t flags = irq_save();
+    task_t* task = &tasks[tid];
+    spin_lock(&task->lock);
+    bool woken = task->state == TASK_BLOCKED;
+    if (woken) {
+        task->state = TASK_READY;
+        task->wake_pending = false;
+    } else if (task->state != TASK_TERMINATED) {
+        task->wake_pending = true;
+    }
+    spin_unlock(&task->lock);
+    if (woken) {
+        enqueue(tid, select_cpu(task->cpu));
+    }
+    irq_restore(flags);
+    return woken;
+}
+
+/* Runs tid here and now if it is still queued anywhere */
+void task_switch_to(uint32_t tid) {
+    if (tid >= task_count) return;
+    uint32_t flags = irq_save();
+    if (tasks[tid].state == TASK_READY && rq_remove(&runqueues[tasks[tid].cpu], tid)) {
+        switch_to(tid);
+    }
+    irq_restore(flags);
+}
+
+task_state_t task_get_state(uint32_t tid) {
+    if (tid >= task_count) return TASK_TERMINATED;
+    return tasks[tid].state;
+}
+
+uint32_t task_get_count(void) { return task_count; }
+
+uint32_t task_get_switch_count(void) {
+    uint32_t switches = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        switches += runqueues[cpu].switches;
+    }
+    return switches;
+}
+
+bool task_get_stats(uint32_t tid, task_stats_t* stats) {
+    if (tid >= task_count) return false;
+    uint32_t flags = irq_save();
+    stats->state = tasks[tid].state;
+    stats->cpu_cycles = tasks[tid].cpu_cycles;
+    stats->switches = tasks[tid].switches;
+    stats->cpu = tasks[tid].cpu;
+    stats->idle = tasks[tid].idle;
+    if (stats->state == TASK_RUNNING) {
+        stats->cpu_cycles += rdtsc() - runqueues[stats->cpu].slice_start;
+    }
+    irq_restore(flags);
+    return true;
+}
+
+bool task_get_cpu_stats(uint32_t cpu, task_cpu_stats_t* stats) {
+    if (!cpu_online(cpu)) return false;
+    runqueue_t* rq = &runqueues[cpu];
+    stats->current = cpus[cpu].current;
+    stats->queued = rq->count;
+    stats->switches = rq->switches;
+    stats->steals = rq->steals;
+    return true;
+}
+
+/* The calling context becomes this CPU's idle task: the boot stack on
+   the BSP, the trampoline-given stack on an AP. */
+bool task_init_cpu(void) {
+    cpu_t* cpu = this_cpu();
+    runqueue_t* rq = &runqueues[cpu->id];
+
+    spin_lock(&task_alloc_lock);
+    if (task_count >= MAX_TASKS) {
+        spin_unlock(&task_alloc_lock);
+        return false;
+    }
+    uint32_t tid = task_count;
+    task_t* task = &tasks[tid];
+    task->id = tid;
+    task->stack = NULL;
+    task->entry = NULL;
+    task->directory = NULL;
+    task->state = TASK_RUNNING;
+    task->cpu = cpu->id;
+    task->on_cpu = true;
+    task->wake_pending = false;
+    task->idle = true;
+    spin_init(&task->lock);
+    task->cpu_cycles = 0;
+    task->switches = 0;
+    fpu_task_init(&task->fpu);
+    __atomic_store_n(&task_count, tid + 1, __ATOMIC_RELEASE);
+    spin_unlock(&task_alloc_lock);
+
+    rq->idle_task = tid;
+    rq->prev = tid;
+    cpu->current = tid;
+    fpu_switch(NULL, &task->fpu);
+    rq->slice_start = rdtsc();
+    return true;
+}
+
+static const char* const runqueue_names[MAX_CPUS] = {
+    "runqueue0", "runqueue1", "runqueue2", "runqueue3",
+    "runqueue4", "runqueue5", "runqueue6", "runqueue7",
+};
+_Static_assert(MAX_CPUS == 8, "one run queue name per CPU");
 
 void task_init(void) {
-    task_count = 1;
-    current_task = 0;
-    tasks[0].id = 0;
-    tasks[0].state = TASK_RUNNING;
-    tasks[0].stack = NULL;
+    task_count = 0;
+    spin_register(&task_alloc_lock, "task_alloc");
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        spin_register(&runqueues[cpu].lock, runqueue_names[cpu]);
+    }
+    task_init_cpu();
 }
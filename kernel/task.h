@@ -2,6 +2,10 @@
 #define TASK_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+
+#define MAX_TASKS 16
 
 typedef enum {
     TASK_READY,
@@ -10,10 +14,49 @@ typedef enum {
     TASK_TERMINATED
 } task_state_t;
 
+typedef struct {
+    task_state_t state;
+    uint64_t cpu_cycles;    /* TSC cycles spent running */
+    uint32_t switches;      /* times switched in */
+    uint32_t cpu;           /* CPU it runs or last ran on */
+    bool idle;              /* a CPU's idle task */
+} task_stats_t;
+
+typedef struct {
+    uint32_t current;       /* running task */
+    uint32_t queued;        /* tasks waiting in its run queue */
+    uint32_t switches;
+    uint32_t steals;        /* tasks taken from other CPUs' queues */
+} task_cpu_stats_t;
+
+/* task_init() makes the boot context the BSP's idle task; each AP calls
+   task_init_cpu() from its boot stack (false if the task table is
+   full). task_idle() is one pass of a CPU's idle loop: run something or
+   halt until an interrupt. */
 void task_init(void);
+bool task_init_cpu(void);
+void task_idle(void);
 uint32_t task_create(void (*entry)(void));
+void task_exit(void) __attribute__((noreturn));
 void task_switch(void);
 void task_yield(void);
+bool task_has_ready(void);
 uint32_t task_get_current(void);
+bool task_current_is_idle(void);
+void task_block(void);
+bool task_unblock(uint32_t tid);
+void task_switch_to(uint32_t tid);
+task_state_t task_get_state(uint32_t tid);
+uint32_t task_get_count(void);
+uint32_t task_get_switch_count(void);
+bool task_get_stats(uint32_t tid, task_stats_t* stats);
+bool task_get_cpu_stats(uint32_t cpu, task_cpu_stats_t* stats);
+
+/* User tasks run with their own page directory loaded and enter the
+   kernel on their own stack through the TSS. task_release_directory()
+   detaches the running task from its directory and loads the kernel's,
+   so the directory can be destroyed. */
+uint32_t task_create_user(void (*entry)(void), page_directory_t* directory);
+page_directory_t* task_release_directory(void);
 
 #endif
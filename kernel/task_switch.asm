@@ -0,0 +1,29 @@
+BITS 32
+
+section .text
+global context_switch
+
+; void context_switch(uint32_t* old_esp, uint32_t new_esp)
+; Saves callee-saved registers and EFLAGS on the current stack, stores ESP
+; in *old_esp, then resumes the task whose stack pointer is new_esp.
+context_switch:
+    mov eax, [esp + 4]
+    mov edx, [esp + 8]
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushf
+
+    mov [eax], esp
+    mov esp, edx
+
+    popf
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -3,10 +3,20 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 void terminal_initialize(void);
 void terminal_putchar(char c);
+void terminal_write(const char* data, size_t size);
 void terminal_writestring(const char* data);
 void terminal_setcolor(uint8_t color);
+void terminal_flush(void);
+
+/* While quiet, writes are dropped before they reach the shadow buffer.
+   Set for a "quiet" boot until the shell comes up. */
+void terminal_set_quiet(bool quiet);
+
+/* Timer ticks between background flushes of the shadow buffer */
+#define TERMINAL_FLUSH_TICKS 2
 
 #endif
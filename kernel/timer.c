@@ -1,12 +1,28 @@
 #include "timer.h"
 #include "port.h"
+#include "terminal.h"
+#include "cpu.h"
+#include "irq.h"
 
 static uint32_t tick_count = 0;
 uint32_t timer_ticks = 0;
 
+/* With oversampling the PIT fires factor times per tick; the extra
+   interrupts only feed the profiler, so tick_count keeps its rate. */
+static uint32_t tick_frequency = 100;
+static uint32_t oversample = 1;
+static uint32_t subtick = 0;
+
 void timer_handler(void) {
+    if (++subtick < oversample) {
+        return;
+    }
+    subtick = 0;
     tick_count++;
     timer_ticks = tick_count;
+    if (tick_count % TERMINAL_FLUSH_TICKS == 0) {
+        terminal_flush();
+    }
 }
 
 void timer_callback(void) {
@@ -25,9 +41,30 @@ static void timer_set_phase(uint32_t frequency) {
 
 void timer_init(uint32_t frequency) {
     tick_count = 0;
+    tick_frequency = frequency;
+    oversample = 1;
+    subtick = 0;
     timer_set_phase(frequency);
 }
 
+void timer_set_oversample(uint32_t factor) {
+    if (factor == 0) {
+        factor = 1;
+    }
+    if (tick_frequency * factor > PIT_FREQUENCY / 2) {
+        factor = (PIT_FREQUENCY / 2) / tick_frequency;
+    }
+    uint32_t flags = irq_save();
+    oversample = factor;
+    subtick = 0;
+    timer_set_phase(tick_frequency * factor);
+    irq_restore(flags);
+}
+
+uint32_t timer_get_interrupt_rate(void) {
+    return tick_frequency * oversample;
+}
+
 uint32_t timer_get_ticks(void) {
     return tick_count;
 }
@@ -39,7 +76,47 @@ void timer_wait(uint32_t ticks) {
     }
 }
 
+#define PIT_GATE_ENABLE 0x01
+#define PIT_SPEAKER     0x02
+#define PIT_OUT2        0x20
+
+/* Mode 0 counts down once and raises OUT2 at zero. Dropping the gate
+   while loading the count makes the start point exact. */
+void timer_oneshot_start(uint32_t us) {
+    uint32_t count = us * (PIT_FREQUENCY / 1000) / 1000;
+    if (count == 0) count = 1;
+    if (count > 0xFFFF) count = 0xFFFF;
+
+    uint8_t gate = inb(PIT_GATE_PORT) & ~(PIT_GATE_ENABLE | PIT_SPEAKER);
+    outb(PIT_GATE_PORT, gate);
+    outb(PIT_COMMAND_PORT, 0xB0);
+    outb(PIT_CHANNEL2_PORT, count & 0xFF);
+    outb(PIT_CHANNEL2_PORT, (count >> 8) & 0xFF);
+    outb(PIT_GATE_PORT, gate | PIT_GATE_ENABLE);
+}
+
+bool timer_oneshot_expired(void) {
+    return (inb(PIT_GATE_PORT) & PIT_OUT2) != 0;
+}
+
+void timer_udelay(uint32_t us) {
+    while (us > 0) {
+        uint32_t step = us > 50000 ? 50000 : us;
+        timer_oneshot_start(step);
+        while (!timer_oneshot_expired()) {
+            __asm__ volatile("pause");
+        }
+        us -= step;
+    }
+}
+
+static void timer_irq(void* ctx) {
+    (void)ctx;
+    timer_handler();
+}
+
 void timer_install(void) {
     timer_init(100);
+    irq_register(0, timer_irq, NULL);
 }
 
@@ -2,10 +2,13 @@
 #define TIMER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define PIT_FREQUENCY 1193180
 #define PIT_COMMAND_PORT 0x43
 #define PIT_CHANNEL0_PORT 0x40
+#define PIT_CHANNEL2_PORT 0x42
+#define PIT_GATE_PORT 0x61
 
 void timer_init(uint32_t frequency);
 void timer_install(void);
@@ -13,5 +16,13 @@ void timer_handler(void);
 void timer_callback(void);
 uint32_t timer_get_ticks(void);
 void timer_wait(uint32_t ticks);
+void timer_set_oversample(uint32_t factor);
+uint32_t timer_get_interrupt_rate(void);
+
+/* PIT channel 2 as a polled one-shot, for busy-waits that cannot rely on
+   the tick (AP startup, LAPIC calibration). At most about 54 ms. */
+void timer_oneshot_start(uint32_t us);
+bool timer_oneshot_expired(void);
+void timer_udelay(uint32_t us);
 
 #endif
@@ -0,0 +1,208 @@
+#include <stdbool.h>
+#include "trace.h"
+#include "cpu.h"
+#include "serial.h"
+
+#define TRACE_MASK (TRACE_BUFFER_SIZE - 1)
+
+_Static_assert((TRACE_BUFFER_SIZE & TRACE_MASK) == 0, "trace buffer size must be a power of two");
+_Static_assert(TRACE_WIRE_SIZE == 20 + 4 * TRACE_MAX_ARGS, "wire record layout");
+
+/* Writers claim a slot with one atomic add and never wait; once the ring
+   wraps, the oldest records are overwritten. seq is cleared while a record
+   is being filled and set to its position + 1 when complete, so a reader
+   can skip records that are torn or already reused. */
+static trace_record_t trace_buffer[TRACE_BUFFER_SIZE];
+static uint32_t trace_head;
+static uint32_t trace_start;    /* oldest position still reported */
+
+static trace_record_t dump_buffer[TRACE_BUFFER_SIZE];
+
+static const char* const module_names[TRACE_MOD_COUNT] = {
+    "kernel", "sched", "ipc", "irq", "mem", "fs", "driver", "shell",
+};
+
+static const char* const level_names[] = { "INFO", "WARN", "ERR ", "DBG " };
+
+void trace_event(uint8_t level, uint8_t module, const char* fmt, uint32_t nargs,
+                 uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    uint32_t pos = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+    trace_record_t* record = &trace_buffer[pos & TRACE_MASK];
+
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->tsc = rdtsc();
+    record->level = level;
+    record->module = module;
+    record->nargs = (uint8_t)nargs;
+    record->fmt = fmt;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t trace_snapshot(trace_record_t* out, uint32_t max) {
+    uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+    uint32_t available = head - __atomic_load_n(&trace_start, __ATOMIC_RELAXED);
+    if (available > TRACE_BUFFER_SIZE) {
+        available = TRACE_BUFFER_SIZE;
+    }
+    if (available > max) {
+        available = max;
+    }
+
+    uint32_t copied = 0;
+    for (uint32_t pos = head - available; pos != head; pos++) {
+        const trace_record_t* record = &trace_buffer[pos & TRACE_MASK];
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            continue;
+        }
+        out[copied] = *record;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&record->seq, __ATOMIC_RELAXED) != pos + 1) {
+            continue;
+        }
+        copied++;
+    }
+    return copied;
+}
+
+void trace_clear(void) {
+    __atomic_store_n(&trace_start, __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+}
+
+const char* trace_module_name(uint8_t module) {
+    return module < TRACE_MOD_COUNT ? module_names[module] : "?";
+}
+
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t pos;
+} line_t;
+
+static void put_char(line_t* line, char c) {
+    if (line->pos + 1 < line->len) {
+        line->buf[line->pos++] = c;
+    }
+}
+
+static void put_str(line_t* line, const char* s) {
+    while (*s) {
+        put_char(line, *s++);
+    }
+}
+
+static void put_hex(line_t* line, uint32_t value, int digits) {
+    const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--) {
+        put_char(line, hex[(value >> (i * 4)) & 0xF]);
+    }
+}
+
+static void put_dec(line_t* line, uint32_t value, bool is_signed) {
+    char digits[10];
+    int n = 0;
+
+    if (is_signed && (int32_t)value < 0) {
+        put_char(line, '-');
+        value = -value;
+    }
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0) {
+        put_char(line, digits[--n]);
+    }
+}
+
+/* "<tsc> <level> <module>: <message>" with the TSC as 16 hex digits */
+size_t trace_format(const trace_record_t* record, char* buf, size_t len) {
+    line_t line = { buf, len, 0 };
+    if (len == 0) {
+        return 0;
+    }
+
+    put_hex(&line, (uint32_t)(record->tsc >> 32), 8);
+    put_hex(&line, (uint32_t)record->tsc, 8);
+    put_char(&line, ' ');
+    put_str(&line, record->level <= TRACE_DEBUG ? level_names[record->level] : "?   ");
+    put_char(&line, ' ');
+    put_str(&line, trace_module_name(record->module));
+    put_str(&line, ": ");
+
+    uint32_t arg = 0;
+    for (const char* p = record->fmt; *p; p++) {
+        if (*p != '%' || p[1] == '\0') {
+            put_char(&line, *p);
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            put_char(&line, '%');
+            continue;
+        }
+        uint32_t value = arg < record->nargs ? record->args[arg] : 0;
+        arg++;
+        switch (*p) {
+            case 'd': put_dec(&line, value, true); break;
+            case 'u': put_dec(&line, value, false); break;
+            case 'x': put_hex(&line, value, 8); break;
+            case 'c': put_char(&line, (char)value); break;
+            default:
+                put_char(&line, '%');
+                put_char(&line, *p);
+                break;
+        }
+    }
+
+    buf[line.pos] = '\0';
+    return line.pos;
+}
+
+static uint8_t* put_le(uint8_t* out, uint32_t value, uint32_t bytes) {
+    for (uint32_t i = 0; i < bytes; i++) {
+        *out++ = (uint8_t)(value >> (i * 8));
+    }
+    return out;
+}
+
+/* Little endian: tsc:8 seq:4 level:1 module:1 nargs:1 pad:1 fmt:4
+   args:4x4. fmt is the format string's address in the kernel image. */
+static void encode_record(const trace_record_t* record, uint8_t out[TRACE_WIRE_SIZE]) {
+    uint8_t* p = out;
+    p = put_le(p, (uint32_t)record->tsc, 4);
+    p = put_le(p, (uint32_t)(record->tsc >> 32), 4);
+    p = put_le(p, record->seq, 4);
+    *p++ = record->level;
+    *p++ = record->module;
+    *p++ = record->nargs;
+    *p++ = 0;
+    p = put_le(p, (uint32_t)record->fmt, 4);
+    for (uint32_t i = 0; i < TRACE_MAX_ARGS; i++) {
+        p = put_le(p, record->args[i], 4);
+    }
+}
+
+void trace_dump_serial(void) {
+    uint8_t wire[TRACE_WIRE_SIZE];
+    char count_text[11];
+    uint32_t count = trace_snapshot(dump_buffer, TRACE_BUFFER_SIZE);
+    line_t line = { count_text, sizeof(count_text), 0 };
+
+    put_dec(&line, count, false);
+    count_text[line.pos] = '\0';
+    serial_write("--- trace begin ");
+    serial_write(count_text);
+    serial_write(" ---\n");
+    for (uint32_t i = 0; i < count; i++) {
+        encode_record(&dump_buffer[i], wire);
+        serial_write_bytes(wire, sizeof(wire));
+    }
+    serial_write("--- trace end ---\n");
+}
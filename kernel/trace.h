@@ -0,0 +1,97 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_BUFFER_SIZE 256
+#define TRACE_MAX_ARGS    4
+#define TRACE_LINE_LEN    128
+/* Size of one record in a serial dump; see trace_dump_serial() */
+#define TRACE_WIRE_SIZE   36
+
+/* Same numbering as LogLevel in driver/logger.cpp */
+typedef enum {
+    TRACE_INFO = 0,
+    TRACE_WARNING = 1,
+    TRACE_ERROR = 2,
+    TRACE_DEBUG = 3,
+} trace_level_t;
+
+typedef enum {
+    TRACE_MOD_KERNEL = 0,
+    TRACE_MOD_SCHED,
+    TRACE_MOD_IPC,
+    TRACE_MOD_IRQ,
+    TRACE_MOD_MEMORY,
+    TRACE_MOD_FS,
+    TRACE_MOD_DRIVER,
+    TRACE_MOD_SHELL,
+    TRACE_MOD_COUNT,
+} trace_module_t;
+
+/* fmt must be a string literal (or otherwise live forever): only the
+   pointer is stored and it is formatted when the ring is dumped.
+   Supported conversions: %d %u %x %c %%. */
+typedef struct {
+    uint64_t tsc;
+    uint32_t seq;
+    uint8_t level;
+    uint8_t module;
+    uint8_t nargs;
+    uint8_t reserved;
+    const char* fmt;
+    uint32_t args[TRACE_MAX_ARGS];
+} trace_record_t;
+
+void trace_event(uint8_t level, uint8_t module, const char* fmt, uint32_t nargs,
+                 uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+/* Copies up to max of the most recent records, oldest first. */
+uint32_t trace_snapshot(trace_record_t* out, uint32_t max);
+size_t trace_format(const trace_record_t* record, char* buf, size_t len);
+const char* trace_module_name(uint8_t module);
+/* Writes the ring to COM1 as "--- trace begin <n> ---\n", n binary
+   records of TRACE_WIRE_SIZE bytes and "--- trace end ---\n". Format
+   strings stay in the kernel image; trace_decode.py resolves them. */
+void trace_dump_serial(void);
+void trace_clear(void);
+
+/* Levels compiled into the kernel. Building with -DLOG_NO_DEBUG
+   (make RELEASE=1) drops debug traces and debug log calls entirely,
+   including their format strings. */
+#define LOG_LEVEL_BIT(level) (1u << (level))
+#ifdef LOG_NO_DEBUG
+#define LOG_COMPILED_LEVELS \
+    (LOG_LEVEL_BIT(TRACE_INFO) | LOG_LEVEL_BIT(TRACE_WARNING) | LOG_LEVEL_BIT(TRACE_ERROR))
+#else
+#define LOG_COMPILED_LEVELS 0xFu
+#endif
+#define LOG_LEVEL_COMPILED(level) ((LOG_COMPILED_LEVELS & LOG_LEVEL_BIT(level)) != 0)
+
+#define TRACE_EMIT(level, module, fmt, n, a, b, c, d) \
+    do { \
+        if (LOG_LEVEL_COMPILED(level)) \
+            trace_event(level, module, fmt, n, a, b, c, d); \
+    } while (0)
+
+#define TRACE0(level, module, fmt) \
+    TRACE_EMIT(level, module, fmt, 0, 0, 0, 0, 0)
+#define TRACE1(level, module, fmt, a) \
+    TRACE_EMIT(level, module, fmt, 1, (uint32_t)(a), 0, 0, 0)
+#define TRACE2(level, module, fmt, a, b) \
+    TRACE_EMIT(level, module, fmt, 2, (uint32_t)(a), (uint32_t)(b), 0, 0)
+#define TRACE3(level, module, fmt, a, b, c) \
+    TRACE_EMIT(level, module, fmt, 3, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), 0)
+#define TRACE4(level, module, fmt, a, b, c, d) \
+    TRACE_EMIT(level, module, fmt, 4, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), (uint32_t)(d))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
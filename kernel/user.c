@@ -0,0 +1,430 @@
+#include <stddef.h>
+#include "user.h"
+#include "elf.h"
+#include "gdt.h"
+#include "cpu.h"
+#include "task.h"
+#include "vfs.h"
+#include "shell.h"
+#include "string.h"
+#include "syscall.h"
+#include "terminal.h"
+#include "trace.h"
+#include "ipc.h"
+#include "shm.h"
+
+#define USER_MAX_PHDRS 16
+
+#define PF_PRESENT 0x1          /* page fault error code: protection, not a missing page */
+
+extern uint32_t rust_allocate_page(void);
+extern void rust_free_page(uint32_t page);
+extern uint32_t rust_process_create(uint8_t priority, const char* name);
+extern bool rust_process_terminate(uint32_t pid);
+
+/* An executable is read either straight from a Multiboot module or
+   through the VFS by name */
+typedef struct {
+    char name[USER_NAME_LEN];
+    const uint8_t* data;        /* module contents, or NULL for a VFS file */
+    uint32_t size;
+} user_image_t;
+
+typedef struct {
+    uint32_t vaddr;
+    uint32_t memsz;
+    uint32_t offset;
+    uint32_t filesz;
+    bool writable;
+} user_segment_t;
+
+/* Indexed by page directory ID: a slot belongs to the process from
+   paging_create_directory() until its directory is destroyed */
+typedef struct {
+    volatile bool used;
+    uint32_t pid;
+    uint32_t tid;
+    page_directory_t* directory;
+    uint32_t entry;
+    user_image_t image;
+    user_segment_t segments[USER_MAX_SEGMENTS];
+    uint32_t segment_count;
+    volatile uint32_t syscalls;
+    volatile uint32_t page_faults;
+} user_process_t;
+
+static user_process_t processes[USER_MAX_PROCESSES];
+static user_image_t modules[USER_MAX_MODULES];
+static uint32_t module_count;
+
+static user_process_t* current_process(void) {
+    page_directory_t* directory = paging_get_current_directory();
+    return directory ? &processes[paging_directory_id(directory)] : NULL;
+}
+
+static void copy_name(char* dest, const char* src, uint32_t len) {
+    uint32_t i = 0;
+    for (; i + 1 < USER_NAME_LEN && i < len && src[i]; i++) {
+        dest[i] = src[i];
+    }
+    dest[i] = '\0';
+}
+
+static int32_t image_read(const user_image_t* image, uint32_t offset, void* buf, uint32_t len) {
+    if (image->data) {
+        if (offset >= image->size) return 0;
+        if (len > image->size - offset) len = image->size - offset;
+        memcpy(buf, image->data + offset, len);
+        return (int32_t)len;
+    }
+    return rust_vfs_read_at((const uint8_t*)image->name, strlen(image->name), offset,
+                            (uint8_t*)buf, len);
+}
+
+bool user_register_module(const char* cmdline, const void* image, size_t size) {
+    if (module_count >= USER_MAX_MODULES || size < sizeof(elf32_ehdr_t) ||
+        !elf_check_header((const elf32_ehdr_t*)image)) {
+        return false;
+    }
+
+    /* "/boot/hello arg" is registered as "hello" */
+    const char* name = cmdline ? cmdline : "";
+    uint32_t len = 0;
+    for (const char* p = name; *p && *p != ' '; p++) {
+        if (*p == '/') {
+            name = p + 1;
+            len = 0;
+        } else {
+            len++;
+        }
+    }
+    if (len == 0) return false;
+
+    user_image_t* module = &modules[module_count];
+    copy_name(module->name, name, len);
+    module->data = (const uint8_t*)image;
+    module->size = size;
+    module_count++;
+    return true;
+}
+
+static bool find_image(const char* name, user_image_t* image) {
+    for (uint32_t i = 0; i < module_count; i++) {
+        if (strcmp(modules[i].name, name) == 0) {
+            *image = modules[i];
+            return true;
+        }
+    }
+    if (strlen(name) >= USER_NAME_LEN) return false;
+    copy_name(image->name, name, USER_NAME_LEN);
+    image->data = NULL;
+    image->size = 0;
+    return true;
+}
+
+/* Collects the PT_LOAD segments; the entry point must be in an
+   executable one */
+static uint32_t load_segments(const user_image_t* image, const elf32_ehdr_t* header,
+                              user_segment_t* segments) {
+    elf32_phdr_t phdrs[USER_MAX_PHDRS];
+    if (header->e_phnum > USER_MAX_PHDRS) return 0;
+    uint32_t size = header->e_phnum * sizeof(elf32_phdr_t);
+    if (image_read(image, header->e_phoff, phdrs, size) != (int32_t)size) return 0;
+
+    uint32_t count = 0;
+    bool entry_found = false;
+    for (uint32_t i = 0; i < header->e_phnum; i++) {
+        const elf32_phdr_t* phdr = &phdrs[i];
+        if (phdr->p_type != ELF_PT_LOAD || phdr->p_memsz == 0) continue;
+        if (count == USER_MAX_SEGMENTS ||
+            !elf_check_segment(phdr, PAGING_USER_BASE, USER_STACK_TOP - USER_STACK_SIZE)) {
+            return 0;
+        }
+        segments[count].vaddr = phdr->p_vaddr;
+        segments[count].memsz = phdr->p_memsz;
+        segments[count].offset = phdr->p_offset;
+        segments[count].filesz = phdr->p_filesz;
+        segments[count].writable = (phdr->p_flags & ELF_PF_W) != 0;
+        if ((phdr->p_flags & ELF_PF_X) && header->e_entry >= phdr->p_vaddr &&
+            header->e_entry - phdr->p_vaddr < phdr->p_memsz) {
+            entry_found = true;
+        }
+        count++;
+    }
+    return entry_found ? count : 0;
+}
+
+/* Leaves with IF set and every general register cleared, so nothing of
+   the kernel reaches ring 3 */
+static void __attribute__((noreturn)) enter_user_mode(uint32_t eip, uint32_t esp) {
+    __asm__ volatile(
+        "cli\n\t"
+        "mov %%ax, %%ds\n\t"
+        "mov %%ax, %%es\n\t"
+        "mov %%ax, %%fs\n\t"
+        "mov %%ax, %%gs\n\t"
+        "pushl %%eax\n\t"
+        "pushl %0\n\t"
+        "pushl %2\n\t"
+        "pushl %3\n\t"
+        "pushl %1\n\t"
+        "xor %%eax, %%eax\n\t"
+        "xor %%ebx, %%ebx\n\t"
+        "xor %%ecx, %%ecx\n\t"
+        "xor %%edx, %%edx\n\t"
+        "xor %%esi, %%esi\n\t"
+        "xor %%edi, %%edi\n\t"
+        "xor %%ebp, %%ebp\n\t"
+        "iret"
+        :
+        : "r"(esp), "r"(eip), "i"(EFLAGS_IF | 0x2), "i"(GDT_USER_CODE), "a"(GDT_USER_DATA)
+        : "memory");
+    __builtin_unreachable();
+}
+
+/* First code of a new user task, still in ring 0 with its directory
+   loaded. The stack starts 16 bytes down so argc and argv read as 0. */
+static void user_start(void) {
+    user_process_t* process = current_process();
+    enter_user_mode(process->entry, USER_STACK_TOP - 16);
+}
+
+int32_t user_exec(const char* name) {
+    user_image_t image;
+    elf32_ehdr_t header;
+    user_segment_t segments[USER_MAX_SEGMENTS];
+
+    if (!paging_enabled() || !find_image(name, &image)) return -1;
+    if (image_read(&image, 0, &header, sizeof(header)) != (int32_t)sizeof(header) ||
+        !elf_check_header(&header)) {
+        return -1;
+    }
+    uint32_t segment_count = load_segments(&image, &header, segments);
+    if (segment_count == 0) return -1;
+
+    page_directory_t* directory = paging_create_directory();
+    if (!directory) return -1;
+
+    user_process_t* process = &processes[paging_directory_id(directory)];
+    process->directory = directory;
+    process->entry = header.e_entry;
+    process->image = image;
+    for (uint32_t i = 0; i < segment_count; i++) {
+        process->segments[i] = segments[i];
+    }
+    process->segment_count = segment_count;
+    process->syscalls = 0;
+    process->page_faults = 0;
+    process->pid = rust_process_create(1, image.name);
+    process->tid = (uint32_t)-1;
+    if (process->pid == 0) {
+        paging_destroy_directory(directory);
+        return -1;
+    }
+    process->used = true;
+
+    uint32_t tid = task_create_user(user_start, directory);
+    if (tid == (uint32_t)-1) {
+        process->used = false;
+        ipc_close(process->pid);
+        rust_process_terminate(process->pid);
+        paging_destroy_directory(directory);
+        return -1;
+    }
+    process->tid = tid;
+    TRACE2(TRACE_INFO, TRACE_MOD_SCHED, "exec pid %u task %u", process->pid, tid);
+    return (int32_t)tid;
+}
+
+/* A page shared by two segments gets the file bytes of both and is
+   writable if either is */
+bool user_handle_page_fault(uint32_t addr, uint32_t error_code) {
+    user_process_t* process = current_process();
+    if (!process || (error_code & PF_PRESENT) || !paging_is_user_range(addr, 1)) {
+        return false;
+    }
+
+    uint32_t page = PAGE_ALIGN_DOWN(addr);
+    bool covered = page >= USER_STACK_TOP - USER_STACK_SIZE;
+    bool writable = covered;
+    for (uint32_t i = 0; i < process->segment_count; i++) {
+        const user_segment_t* segment = &process->segments[i];
+        if (page < segment->vaddr + segment->memsz && page + PAGE_SIZE > segment->vaddr) {
+            covered = true;
+            writable |= segment->writable;
+        }
+    }
+    if (!covered) return false;
+
+    uint32_t frame = rust_allocate_page();
+    if (frame == 0) return false;
+    memset((void*)frame, 0, PAGE_SIZE);
+
+    /* What the file does not supply stays zero: .bss, or a short file */
+    for (uint32_t i = 0; i < process->segment_count; i++) {
+        const user_segment_t* segment = &process->segments[i];
+        uint32_t start = page > segment->vaddr ? page : segment->vaddr;
+        uint32_t file_end = segment->vaddr + segment->filesz;
+        uint32_t end = page + PAGE_SIZE < file_end ? page + PAGE_SIZE : file_end;
+        if (start < end) {
+            image_read(&process->image, segment->offset + (start - segment->vaddr),
+                       (uint8_t*)frame + (start - page), end - start);
+        }
+    }
+
+    uint32_t flags = PAGE_PRESENT | PAGE_USER | PAGE_OWNED | (writable ? PAGE_WRITE : 0);
+    if (!paging_map_page(page, frame, flags)) {
+        rust_free_page(frame);
+        return false;
+    }
+    process->page_faults++;
+    return true;
+}
+
+static void write_number(uint32_t value) {
+    char buf[16];
+    itoa_simple((int32_t)value, buf);
+    terminal_writestring(buf);
+}
+
+static void write_hex(uint32_t value) {
+    const char hex[] = "0123456789abcdef";
+    terminal_writestring("0x");
+    for (int i = 7; i >= 0; i--) {
+        terminal_putchar(hex[(value >> (i * 4)) & 0xF]);
+    }
+}
+
+static void report(const user_process_t* process, const char* what) {
+    terminal_writestring("[USER] ");
+    terminal_writestring(process->image.name);
+    terminal_writestring(" (pid ");
+    write_number(process->pid);
+    terminal_writestring(") ");
+    terminal_writestring(what);
+}
+
+/* The directory can only go once this CPU no longer has it loaded */
+static void __attribute__((noreturn)) terminate(user_process_t* process) {
+    uint32_t pid = process->pid;
+    process->used = false;
+    shm_detach_all(pid);
+    paging_destroy_directory(task_release_directory());
+    ipc_close(pid);
+    rust_process_terminate(pid);
+    task_exit();
+}
+
+void user_exit(int32_t code) {
+    user_process_t* process = current_process();
+    char buf[16];
+    itoa_simple(code, buf);
+    report(process, "exited with ");
+    terminal_writestring(buf);
+    terminal_writestring(": ");
+    write_number(process->syscalls);
+    terminal_writestring(" syscalls, ");
+    write_number(process->page_faults);
+    terminal_writestring(" page faults\n");
+    terminate(process);
+}
+
+void user_fault(const char* reason, uint32_t eip) {
+    user_process_t* process = current_process();
+    report(process, "killed: ");
+    terminal_writestring(reason);
+    terminal_writestring(" at ");
+    write_hex(eip);
+    terminal_writestring("\n");
+    terminate(process);
+}
+
+uint32_t user_current_pid(void) {
+    user_process_t* process = current_process();
+    return process ? process->pid : 0;
+}
+
+bool user_access_ok(uint32_t addr, uint32_t size) {
+    if (!current_process()) return true;
+    return size == 0 || paging_is_user_range(addr, size);
+}
+
+bool user_fault_in(uint32_t addr, uint32_t size) {
+    if (!current_process() || size == 0) return true;
+    if (!paging_is_user_range(addr, size)) return false;
+
+    for (uint32_t page = PAGE_ALIGN_DOWN(addr); page < addr + size; page += PAGE_SIZE) {
+        if (paging_get_physical_address(page) == 0 && !user_handle_page_fault(page, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void user_account_syscall(void) {
+    user_process_t* process = current_process();
+    if (process) {
+        process->syscalls++;
+    }
+}
+
+/* A snapshot; the process may exit while it is taken */
+bool user_get_info(uint32_t slot, user_info_t* info) {
+    if (slot >= USER_MAX_PROCESSES || !processes[slot].used) return false;
+    const user_process_t* process = &processes[slot];
+    info->pid = process->pid;
+    info->tid = process->tid;
+    info->syscalls = process->syscalls;
+    info->page_faults = process->page_faults;
+    copy_name(info->name, process->image.name, USER_NAME_LEN);
+    return true;
+}
+
+static void exec_cmd(char* args) {
+    if (*args == '\0') {
+        terminal_writestring("Usage: exec <program>\n");
+        return;
+    }
+    int32_t tid = user_exec(args);
+    if (tid < 0) {
+        terminal_writestring("exec: cannot run ");
+        terminal_writestring(args);
+        terminal_writestring("\n");
+        return;
+    }
+    terminal_writestring("Started ");
+    terminal_writestring(args);
+    terminal_writestring(" as task ");
+    write_number((uint32_t)tid);
+    terminal_writestring("\n");
+}
+
+static void ps_cmd(char* args) {
+    user_info_t info;
+    (void)args;
+    terminal_writestring("PID TASK SYSCALLS FAULTS NAME\n");
+    for (uint32_t slot = 0; slot < USER_MAX_PROCESSES; slot++) {
+        if (!user_get_info(slot, &info)) continue;
+        write_number(info.pid);
+        terminal_writestring(" ");
+        write_number(info.tid);
+        terminal_writestring(" ");
+        write_number(info.syscalls);
+        terminal_writestring(" ");
+        write_number(info.page_faults);
+        terminal_writestring(" ");
+        terminal_writestring(info.name);
+        terminal_writestring("\n");
+    }
+}
+
+static const shell_command_t user_commands[] = {
+    { "exec", "Run an ELF program in ring 3 <name>", exec_cmd },
+    { "ps",   "Show user processes", ps_cmd },
+};
+
+void user_init(void) {
+    for (uint32_t i = 0; i < sizeof(user_commands) / sizeof(user_commands[0]); i++) {
+        shell_register_command(&user_commands[i]);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef USER_H
+#define USER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "paging.h"
+
+#define USER_MAX_PROCESSES PAGING_MAX_DIRECTORIES
+#define USER_MAX_MODULES 4
+#define USER_MAX_SEGMENTS 4
+#define USER_NAME_LEN 32
+
+/* The stack ends at the top of the user window and is mapped a page at
+   a time as it is touched. Segments may not reach into it. */
+#define USER_STACK_TOP PAGING_USER_TOP
+#define USER_STACK_SIZE (64 * 1024)
+
+typedef struct {
+    uint32_t pid;
+    uint32_t tid;
+    uint32_t syscalls;
+    uint32_t page_faults;
+    char name[USER_NAME_LEN];
+} user_info_t;
+
+/* Registers the shell's "exec" and "ps" */
+void user_init(void);
+
+/* Makes an ELF Multiboot module runnable under the last path component
+   of its command line. False if the module is not an ELF executable. */
+bool user_register_module(const char* cmdline, const void* image, size_t size);
+
+/* Starts the ELF32 executable called name, looked up among the
+   registered modules and then in the VFS, as a new ring 3 process.
+   Nothing is read beyond the headers until the program touches its
+   pages. Returns the task ID, or -1. */
+int32_t user_exec(const char* name);
+
+/* Maps the page holding addr if it belongs to a segment or the stack of
+   the running process; false if the fault is not one the process can
+   recover from */
+bool user_handle_page_fault(uint32_t addr, uint32_t error_code);
+
+/* End the running process; only valid while a user task runs */
+void user_exit(int32_t code) __attribute__((noreturn));
+void user_fault(const char* reason, uint32_t eip) __attribute__((noreturn));
+
+/* 0 while a kernel task runs */
+uint32_t user_current_pid(void);
+
+/* Whether a system call may touch [addr, addr + size) on the caller's
+   behalf: always for kernel tasks, only inside the user window for user
+   processes */
+bool user_access_ok(uint32_t addr, uint32_t size);
+
+/* Map the not yet loaded pages of [addr, addr + size) as a fault on them
+   would, so the caller can read them with a spinlock held. False if a
+   page lies outside the process; kernel tasks have nothing to map. */
+bool user_fault_in(uint32_t addr, uint32_t size);
+
+void user_account_syscall(void);
+bool user_get_info(uint32_t slot, user_info_t* info);
+
+#endif
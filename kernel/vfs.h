@@ -9,7 +9,11 @@
 
 void rust_vfs_init(void);
 int32_t rust_vfs_create(const uint8_t* name, size_t name_len, uint8_t file_type);
+int32_t rust_vfs_remove(const uint8_t* name, size_t name_len);
 int32_t rust_vfs_write(const uint8_t* name, size_t name_len, const uint8_t* data, size_t data_len);
 int32_t rust_vfs_read(const uint8_t* name, size_t name_len, uint8_t* buf, size_t buf_len);
+int32_t rust_vfs_read_at(const uint8_t* name, size_t name_len, uint32_t offset, uint8_t* buf, size_t buf_len);
+int32_t rust_vfs_mount_image(const uint8_t* base, size_t len);
+uint32_t rust_vfs_image_file_count(void);
 
 #endif
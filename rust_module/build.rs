@@ -0,0 +1,48 @@
+// With the "host" feature the crate runs as an ordinary host program, so
+// the C it calls into has to come from somewhere: the real ring buffer
+// from kernel/ring.c, and tests/host/kernel_stubs.c for locks, per-CPU
+// IDs and the terminal. Kernel builds compile nothing here.
+
+use std::env;
+use std::path::PathBuf;
+use std::process::Command;
+
+const SOURCES: [&str; 2] = ["../kernel/ring.c", "../tests/host/kernel_stubs.c"];
+
+fn main() {
+    for source in SOURCES {
+        println!("cargo:rerun-if-changed={}", source);
+    }
+    println!("cargo:rerun-if-changed=../kernel/ring.h");
+    if env::var_os("CARGO_FEATURE_HOST").is_none() {
+        return;
+    }
+
+    let out = PathBuf::from(env::var("OUT_DIR").unwrap());
+    let cc = env::var("CC").unwrap_or_else(|_| "cc".to_string());
+    let mut objects = Vec::new();
+    for source in SOURCES {
+        let name = PathBuf::from(source).file_stem().unwrap().to_owned();
+        let object = out.join(name).with_extension("o");
+        let status = Command::new(&cc)
+            .args(["-O2", "-fPIC", "-iquote", "../kernel", "-c", source, "-o"])
+            .arg(&object)
+            .status()
+            .expect("failed to run the C compiler");
+        assert!(status.success(), "compiling {} failed", source);
+        objects.push(object);
+    }
+
+    let archive = out.join("libkhost.a");
+    let _ = std::fs::remove_file(&archive);
+    let status = Command::new("ar")
+        .arg("crs")
+        .arg(&archive)
+        .args(&objects)
+        .status()
+        .expect("failed to run ar");
+    assert!(status.success(), "ar failed");
+
+    println!("cargo:rustc-link-search=native={}", out.display());
+    println!("cargo:rustc-link-lib=static=khost");
+}
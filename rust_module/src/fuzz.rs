@@ -0,0 +1,395 @@
+// Operation interpreters for the host tests and the cargo-fuzz targets in
+// fuzz/. Each one reads its input as a little program, runs it against
+// the real structure and a simple std model side by side, and panics as
+// soon as the two disagree or an invariant breaks.
+
+use std::boxed::Box;
+use std::alloc::Layout;
+use std::cell::Cell;
+use std::collections::{BTreeMap, HashMap, VecDeque};
+use std::format;
+use std::string::String;
+use std::vec;
+use std::vec::Vec;
+
+use crate::bitmap::BitmapAllocator;
+use crate::ipc::{IpcMessageInfo, MessageQueue, MessageType, MAILBOX_DEPTH, MESSAGE_DATA_SIZE};
+use crate::memfs::MemFs;
+use crate::memory_pool::{MemoryPool, PageSource, POOL_CLASSES, POOL_CLASS_SIZES, POOL_MAX_BLOCK, POOL_MAX_SLABS, POOL_PAGE_SIZE};
+use crate::vfs::{FileType, VfsDirectory, VfsError};
+
+// Hands out input bytes; zeros once the input runs out
+struct Input<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Input<'a> {
+    fn new(data: &'a [u8]) -> Self {
+        Self { data, pos: 0 }
+    }
+
+    fn done(&self) -> bool {
+        self.pos >= self.data.len()
+    }
+
+    fn byte(&mut self) -> u8 {
+        let byte = self.data.get(self.pos).copied().unwrap_or(0);
+        self.pos += 1;
+        byte
+    }
+
+    fn word(&mut self) -> u16 {
+        u16::from_le_bytes([self.byte(), self.byte()])
+    }
+}
+
+const BITMAP_FRAMES: usize = 2048;
+
+pub fn bitmap_ops(data: &[u8]) {
+    let mut bitmap = BitmapAllocator::new();
+    let mut model = vec![false; BITMAP_FRAMES];
+    let mut input = Input::new(data);
+
+    while !input.done() {
+        match input.byte() % 3 {
+            0 => {
+                // Lowest free frame first
+                let expected = model.iter().position(|used| !used);
+                assert_eq!(bitmap.allocate_frame(), expected);
+                if let Some(frame) = expected {
+                    model[frame] = true;
+                }
+            }
+            1 => {
+                let frame = input.word() as usize % (BITMAP_FRAMES + 16);
+                let was_used = frame < BITMAP_FRAMES && model[frame];
+                assert_eq!(bitmap.free_frame(frame), was_used);
+                if was_used {
+                    model[frame] = false;
+                }
+            }
+            _ => {
+                let frame = input.word() as usize % (BITMAP_FRAMES + 16);
+                assert_eq!(bitmap.is_allocated(frame), frame < BITMAP_FRAMES && model[frame]);
+            }
+        }
+        let used = model.iter().filter(|used| **used).count();
+        assert_eq!(bitmap.get_allocated_count(), used);
+        assert_eq!(bitmap.get_free_count(), BITMAP_FRAMES - used);
+    }
+}
+
+// Pages from the host allocator, at most HOST_PAGE_LIMIT at a time so
+// the pool also runs out
+const HOST_PAGE_LIMIT: usize = 24;
+
+std::thread_local! {
+    static HOST_PAGES: Cell<usize> = const { Cell::new(0) };
+}
+
+struct HostPages;
+
+impl HostPages {
+    fn layout() -> Layout {
+        Layout::from_size_align(POOL_PAGE_SIZE, POOL_PAGE_SIZE).unwrap()
+    }
+
+    fn outstanding() -> usize {
+        HOST_PAGES.with(|pages| pages.get())
+    }
+}
+
+impl PageSource for HostPages {
+    fn alloc_page() -> Option<usize> {
+        if Self::outstanding() == HOST_PAGE_LIMIT {
+            return None;
+        }
+        HOST_PAGES.with(|pages| pages.set(pages.get() + 1));
+        let page = unsafe { std::alloc::alloc(Self::layout()) };
+        assert!(!page.is_null());
+        Some(page as usize)
+    }
+
+    fn free_page(page: usize) {
+        HOST_PAGES.with(|pages| pages.set(pages.get() - 1));
+        unsafe { std::alloc::dealloc(page as *mut u8, Self::layout()) };
+    }
+}
+
+struct LiveBlock {
+    size: usize,
+    block_size: usize,
+    fill: u8,
+}
+
+fn check_block(ptr: usize, block: &LiveBlock) {
+    let bytes = unsafe { core::slice::from_raw_parts(ptr as *const u8, block.size) };
+    assert!(bytes.iter().all(|byte| *byte == block.fill));
+}
+
+pub fn pool_ops(data: &[u8]) {
+    let mut pool: Box<MemoryPool<HostPages>> = Box::new(MemoryPool::new());
+    let start_pages = HostPages::outstanding();
+    // Keyed by address so overlaps show up as neighbours
+    let mut live: BTreeMap<usize, LiveBlock> = BTreeMap::new();
+    let mut class_live = [0usize; POOL_CLASSES];
+    let mut freed: Vec<usize> = Vec::new();
+    let mut input = Input::new(data);
+
+    while !input.done() {
+        match input.byte() % 4 {
+            0 | 1 => {
+                let size = input.word() as usize % (POOL_MAX_BLOCK + 64);
+                match pool.allocate(size) {
+                    Some(ptr) => {
+                        let addr = ptr as usize;
+                        let class = POOL_CLASS_SIZES.iter().position(|&s| size <= s).unwrap();
+                        let block_size = POOL_CLASS_SIZES[class];
+                        class_live[class] += 1;
+                        assert_eq!(addr % block_size, 0);
+                        assert!(addr % POOL_PAGE_SIZE + block_size <= POOL_PAGE_SIZE);
+                        if let Some((&prev, block)) = live.range(..addr).next_back() {
+                            assert!(prev + block.block_size <= addr);
+                        }
+                        if let Some((&next, _)) = live.range(addr..).next() {
+                            assert!(addr + block_size <= next);
+                        }
+                        let fill = input.byte();
+                        unsafe { core::ptr::write_bytes(ptr, fill, size) };
+                        live.insert(addr, LiveBlock { size, block_size, fill });
+                    }
+                    // Too big, or every page the host will give is in use
+                    None => assert!(
+                        size > POOL_MAX_BLOCK
+                            || HostPages::outstanding() - start_pages == HOST_PAGE_LIMIT.min(POOL_MAX_SLABS)
+                    ),
+                }
+            }
+            2 if !live.is_empty() => {
+                let nth = input.word() as usize % live.len();
+                let addr = *live.keys().nth(nth).unwrap();
+                let block = live.remove(&addr).unwrap();
+                check_block(addr, &block);
+                class_live[POOL_CLASS_SIZES.iter().position(|&s| s == block.block_size).unwrap()] -= 1;
+                assert!(pool.free(addr as *mut u8));
+                freed.push(addr);
+            }
+            _ => {
+                // Double frees and pointers into the middle of a block
+                if let Some(addr) = freed.pop() {
+                    if !live.contains_key(&addr) {
+                        assert!(!pool.free(addr as *mut u8));
+                    }
+                }
+                if let Some((&addr, block)) = live.iter().next() {
+                    let inside = 1 + input.byte() as usize % (block.block_size - 1);
+                    assert!(!pool.free((addr + inside) as *mut u8));
+                }
+            }
+        }
+        assert_eq!(pool.get_allocated_count(), live.len());
+        assert_eq!(pool.get_page_count(), HostPages::outstanding() - start_pages);
+        for (class, &block_size) in POOL_CLASS_SIZES.iter().enumerate() {
+            let stats = pool.class_stats(class);
+            assert_eq!(stats.allocated, class_live[class]);
+            assert!(stats.allocated <= stats.pages * (POOL_PAGE_SIZE / block_size));
+        }
+    }
+
+    for (addr, block) in &live {
+        check_block(*addr, block);
+        assert!(pool.free(*addr as *mut u8));
+    }
+    pool.trim();
+    assert_eq!(pool.get_allocated_count(), 0);
+    assert_eq!(HostPages::outstanding(), start_pages);
+}
+
+// Type, sender and payload of a message the queue should still hold
+type Queued = (u8, u32, Vec<u8>);
+
+pub fn queue_ops(data: &[u8]) {
+    let mut queue = Box::new(MessageQueue::new());
+    queue.init();
+    let mut model: VecDeque<Queued> = VecDeque::new();
+    let mut input = Input::new(data);
+
+    while !input.done() {
+        match input.byte() % 2 {
+            0 => {
+                let sender = input.byte() as u32;
+                let len = input.byte() as usize % (MESSAGE_DATA_SIZE + 8);
+                let payload: Vec<u8> = (0..len).map(|_| input.byte()).collect();
+                let signal = input.byte() & 1 != 0;
+                let msg_type = if signal { MessageType::Signal } else { MessageType::Data };
+                let accepted = len <= MESSAGE_DATA_SIZE && model.len() < MAILBOX_DEPTH;
+                assert_eq!(queue.send_message(msg_type, sender, 1, &payload), accepted);
+                if accepted {
+                    model.push_back((msg_type as u8, sender, payload));
+                }
+            }
+            _ => {
+                let expected = model.pop_front();
+                let message = queue.pop();
+                assert_eq!(message.is_some(), expected.is_some());
+                if let Some(message) = message {
+                    let mut info = IpcMessageInfo { msg_type: 0, sender_pid: 0, length: 0 };
+                    let mut buf = [0u8; MESSAGE_DATA_SIZE];
+                    let copied = message.fill_info(&mut info, &mut buf);
+                    assert_eq!(copied, info.length as usize);
+                    let got = (info.msg_type, info.sender_pid, buf[..copied].to_vec());
+                    assert_eq!(Some(got), expected);
+                }
+            }
+        }
+        assert_eq!(queue.get_count(), model.len());
+    }
+}
+
+const MEMFS_MAX_FILES: usize = 64;
+const MEMFS_MAX_FILE_SIZE: usize = 4096;
+
+// A file's contents, or None for a directory
+type ModelFile = Option<Vec<u8>>;
+
+pub fn memfs_ops(data: &[u8]) {
+    let mut fs = Box::new(MemFs::new());
+    let mut model: HashMap<String, ModelFile> = HashMap::new();
+    let mut input = Input::new(data);
+
+    while !input.done() {
+        let op = input.byte();
+        // Enough names to fill the file table
+        let name = format!("f{}", input.byte() as usize % (MEMFS_MAX_FILES + 16));
+        match op % 4 {
+            0 => {
+                let directory = op & 0x80 != 0;
+                let file_type = if directory { FileType::Directory } else { FileType::Regular };
+                let expected = if model.contains_key(&name) {
+                    Err(VfsError::AlreadyExists)
+                } else if model.len() >= MEMFS_MAX_FILES {
+                    Err(VfsError::OutOfSpace)
+                } else {
+                    Ok(())
+                };
+                assert_eq!(fs.create(&name, file_type), expected);
+                if expected.is_ok() {
+                    model.insert(name, if directory { None } else { Some(Vec::new()) });
+                }
+            }
+            1 => {
+                let expected = if model.remove(&name).is_some() { Ok(()) } else { Err(VfsError::NotFound) };
+                assert_eq!(fs.remove(&name), expected);
+            }
+            2 => {
+                let offset = input.word() as usize % (MEMFS_MAX_FILE_SIZE + 512);
+                let len = input.word() as usize % 512;
+                let fill = input.byte();
+                let buf = vec![fill; len];
+                let expected = match model.get_mut(&name) {
+                    None => Err(VfsError::NotFound),
+                    Some(None) => Err(VfsError::IsDirectory),
+                    Some(Some(_)) if offset + len > MEMFS_MAX_FILE_SIZE => Err(VfsError::OutOfSpace),
+                    Some(Some(contents)) => {
+                        if contents.len() < offset + len {
+                            contents.resize(offset + len, 0);
+                        }
+                        contents[offset..offset + len].fill(fill);
+                        Ok(len)
+                    }
+                };
+                assert_eq!(fs.write_file(&name, &buf, offset as u64), expected);
+            }
+            _ => {
+                let offset = input.word() as u64;
+                let len = input.word() as usize % 512;
+                let mut buf = vec![0u8; len];
+                match (fs.lookup(&name), model.get(&name)) {
+                    (Err(error), None) => assert_eq!(error, VfsError::NotFound),
+                    (Ok(node), Some(None)) => {
+                        assert!(node.metadata().is_dir());
+                        assert_eq!(node.read(&mut buf, offset), Err(VfsError::IsDirectory));
+                    }
+                    (Ok(node), Some(Some(contents))) => {
+                        assert_eq!(node.metadata().size, contents.len() as u64);
+                        let start = (offset as usize).min(contents.len());
+                        let end = (start + len).min(contents.len());
+                        assert_eq!(node.read(&mut buf, offset), Ok(end - start));
+                        assert_eq!(&buf[..end - start], &contents[start..end]);
+                    }
+                    (found, expected) => panic!("lookup {}: {:?} vs {:?}", name, found.is_ok(), expected),
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ipc::MailboxTable;
+
+    // Deterministic random inputs, so a failure names its seed
+    fn random_inputs(seed: u32, count: usize, len: usize, mut run: impl FnMut(&[u8])) {
+        let mut state = seed;
+        let mut buf = vec![0u8; len];
+        for _ in 0..count {
+            for byte in buf.iter_mut() {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                *byte = state as u8;
+            }
+            run(&buf);
+        }
+    }
+
+    #[test]
+    fn bitmap_random() {
+        random_inputs(1, 200, 4096, bitmap_ops);
+    }
+
+    #[test]
+    fn pool_random() {
+        random_inputs(2, 200, 4096, pool_ops);
+    }
+
+    #[test]
+    fn queue_random() {
+        random_inputs(3, 200, 4096, queue_ops);
+    }
+
+    #[test]
+    fn memfs_random() {
+        random_inputs(4, 100, 4096, memfs_ops);
+    }
+
+    #[test]
+    fn mailbox_close() {
+        let mut table = Box::new(MailboxTable::new());
+        let mailbox = table.get_or_create(7).unwrap();
+        assert!(mailbox.queue.send_message(MessageType::Data, 1, 7, b"ping"));
+        assert!(mailbox.queue.send_message(MessageType::Signal, 1, 7, b""));
+
+        assert_eq!(table.close(7), None);
+        assert!(!table.is_open(7));
+        assert!(!table.has_message_for(7));
+
+        let mailbox = table.get_or_create(7).unwrap();
+        assert_eq!(mailbox.queue.get_count(), 0);
+        assert!(mailbox.park(42));
+        assert_eq!(table.close(7), Some(42));
+        assert_eq!(table.close(7), None);
+        assert!(table.get_or_create(0).is_none());
+        assert!(!table.is_open(0));
+    }
+
+    #[test]
+    fn empty_inputs() {
+        bitmap_ops(&[]);
+        pool_ops(&[]);
+        queue_ops(&[]);
+        memfs_ops(&[]);
+    }
+}
@@ -0,0 +1,267 @@
+use crate::vfs::{
+    FileMetadata, FilePermissions, FileType, VfsDirectory, VfsError, VfsNode, VfsResult,
+};
+use crate::sync::RwLock;
+use core::cmp;
+
+// Read-only filesystem over a cpio "newc" archive left in memory by the
+// bootloader. Only the name index is built at mount time; file contents are
+// served straight from the archive.
+
+const MAX_IMAGE_FILES: usize = 128;
+
+const CPIO_HEADER_SIZE: usize = 110;
+const CPIO_MAGIC: &[u8] = b"070701";
+const CPIO_TRAILER: &[u8] = b"TRAILER!!!";
+
+const CPIO_FIELD_MODE: usize = 1;
+const CPIO_FIELD_FILESIZE: usize = 6;
+const CPIO_FIELD_NAMESIZE: usize = 11;
+
+const MODE_TYPE_MASK: u32 = 0o170000;
+const MODE_DIRECTORY: u32 = 0o040000;
+const MODE_REGULAR: u32 = 0o100000;
+
+#[derive(Clone, Copy)]
+struct ImageFile {
+    name: &'static [u8],
+    data: &'static [u8],
+    metadata: FileMetadata,
+}
+
+impl ImageFile {
+    const fn empty() -> Self {
+        Self {
+            name: &[],
+            data: &[],
+            metadata: FileMetadata::new(FileType::Regular, FilePermissions::readonly(), 0, 0),
+        }
+    }
+}
+
+impl VfsNode for ImageFile {
+    fn name(&self) -> &str {
+        core::str::from_utf8(self.name).unwrap_or("")
+    }
+
+    fn metadata(&self) -> &FileMetadata {
+        &self.metadata
+    }
+
+    fn read(&self, buf: &mut [u8], offset: u64) -> VfsResult<usize> {
+        if self.metadata.file_type == FileType::Directory {
+            return Err(VfsError::IsDirectory);
+        }
+
+        let offset = offset as usize;
+        if offset >= self.data.len() {
+            return Ok(0);
+        }
+
+        let to_read = cmp::min(buf.len(), self.data.len() - offset);
+        buf[..to_read].copy_from_slice(&self.data[offset..offset + to_read]);
+        Ok(to_read)
+    }
+
+    fn write(&mut self, _buf: &[u8], _offset: u64) -> VfsResult<usize> {
+        Err(VfsError::PermissionDenied)
+    }
+}
+
+pub struct ImageFs {
+    files: [ImageFile; MAX_IMAGE_FILES],
+    file_count: usize,
+}
+
+impl ImageFs {
+    pub const fn new() -> Self {
+        Self {
+            files: [ImageFile::empty(); MAX_IMAGE_FILES],
+            file_count: 0,
+        }
+    }
+
+    pub fn mount(&mut self, image: &'static [u8]) -> VfsResult<usize> {
+        self.file_count = 0;
+        let mut offset = 0;
+
+        loop {
+            let header = image
+                .get(offset..offset + CPIO_HEADER_SIZE)
+                .ok_or(VfsError::IoError)?;
+            if &header[..CPIO_MAGIC.len()] != CPIO_MAGIC {
+                return Err(VfsError::IoError);
+            }
+
+            let mode = parse_field(header, CPIO_FIELD_MODE)?;
+            let file_size = parse_field(header, CPIO_FIELD_FILESIZE)? as usize;
+            let name_size = parse_field(header, CPIO_FIELD_NAMESIZE)? as usize;
+            if name_size == 0 {
+                return Err(VfsError::IoError);
+            }
+
+            let name_start = offset + CPIO_HEADER_SIZE;
+            let raw_name = image
+                .get(name_start..name_start + name_size - 1)
+                .ok_or(VfsError::IoError)?;
+            if raw_name == CPIO_TRAILER {
+                break;
+            }
+
+            let data_start = align4(name_start + name_size);
+            let data = image
+                .get(data_start..data_start + file_size)
+                .ok_or(VfsError::IoError)?;
+            offset = align4(data_start + file_size);
+
+            let file_type = match mode & MODE_TYPE_MASK {
+                MODE_REGULAR => FileType::Regular,
+                MODE_DIRECTORY => FileType::Directory,
+                _ => continue,
+            };
+
+            let name = strip_prefix(raw_name);
+            if name.is_empty() || core::str::from_utf8(name).is_err() {
+                continue;
+            }
+
+            let permissions = if mode & 0o111 != 0 {
+                FilePermissions::executable()
+            } else {
+                FilePermissions::readonly()
+            };
+            let inode = self.file_count as u32 + 1;
+            self.insert_sorted(ImageFile {
+                name,
+                data,
+                metadata: FileMetadata::new(file_type, permissions, file_size as u64, inode),
+            })?;
+        }
+
+        Ok(self.file_count)
+    }
+
+    pub fn file_count(&self) -> usize {
+        self.file_count
+    }
+
+    fn insert_sorted(&mut self, file: ImageFile) -> VfsResult<()> {
+        if self.file_count >= MAX_IMAGE_FILES {
+            return Err(VfsError::OutOfSpace);
+        }
+
+        let pos = match self.search(file.name) {
+            Ok(_) => return Err(VfsError::AlreadyExists),
+            Err(pos) => pos,
+        };
+
+        let mut i = self.file_count;
+        while i > pos {
+            self.files[i] = self.files[i - 1];
+            i -= 1;
+        }
+        self.files[pos] = file;
+        self.file_count += 1;
+        Ok(())
+    }
+
+    fn search(&self, name: &[u8]) -> Result<usize, usize> {
+        self.files[..self.file_count].binary_search_by(|f| f.name.cmp(name))
+    }
+
+    pub fn find_file(&self, name: &str) -> Option<usize> {
+        self.search(name.as_bytes()).ok()
+    }
+
+    pub fn read(&self, name: &str, buf: &mut [u8], offset: u64) -> VfsResult<usize> {
+        match self.find_file(name) {
+            Some(idx) => self.files[idx].read(buf, offset),
+            None => Err(VfsError::NotFound),
+        }
+    }
+}
+
+impl VfsDirectory for ImageFs {
+    fn lookup(&self, name: &str) -> VfsResult<&dyn VfsNode> {
+        match self.find_file(name) {
+            Some(idx) => Ok(&self.files[idx]),
+            None => Err(VfsError::NotFound),
+        }
+    }
+
+    fn create(&mut self, _name: &str, _file_type: FileType) -> VfsResult<()> {
+        Err(VfsError::PermissionDenied)
+    }
+
+    fn remove(&mut self, _name: &str) -> VfsResult<()> {
+        Err(VfsError::PermissionDenied)
+    }
+
+    fn list(&self) -> VfsResult<&[&str]> {
+        Err(VfsError::IoError)
+    }
+}
+
+fn align4(value: usize) -> usize {
+    (value + 3) & !3
+}
+
+fn parse_field(header: &[u8], index: usize) -> VfsResult<u32> {
+    let start = CPIO_MAGIC.len() + index * 8;
+    let mut value = 0u32;
+    for &c in &header[start..start + 8] {
+        let digit = match c {
+            b'0'..=b'9' => c - b'0',
+            b'a'..=b'f' => c - b'a' + 10,
+            b'A'..=b'F' => c - b'A' + 10,
+            _ => return Err(VfsError::IoError),
+        };
+        value = (value << 4) | digit as u32;
+    }
+    Ok(value)
+}
+
+fn strip_prefix(mut name: &[u8]) -> &[u8] {
+    loop {
+        match name {
+            [b'.', b'/', rest @ ..] => name = rest,
+            [b'/', rest @ ..] => name = rest,
+            [b'.'] => return &[],
+            _ => return name,
+        }
+    }
+}
+
+// Mounted once at boot, then only read
+static GLOBAL_IMAGEFS: RwLock<ImageFs> = RwLock::new(ImageFs::new());
+
+pub(crate) fn register_lock() {
+    GLOBAL_IMAGEFS.register(c"imagefs");
+}
+
+pub(crate) fn image_read(name: &str, buf: &mut [u8], offset: u64) -> VfsResult<usize> {
+    GLOBAL_IMAGEFS.read().read(name, buf, offset)
+}
+
+#[no_mangle]
+pub extern "C" fn rust_vfs_mount_image(base: *const u8, len: usize) -> i32 {
+    if base.is_null() || len == 0 {
+        return -1;
+    }
+
+    let image = unsafe { core::slice::from_raw_parts(base, len) };
+
+    let mut fs = GLOBAL_IMAGEFS.write();
+    match fs.mount(image) {
+        Ok(count) => count as i32,
+        Err(_) => {
+            fs.file_count = 0;
+            -1
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_vfs_image_file_count() -> u32 {
+    GLOBAL_IMAGEFS.read().file_count() as u32
+}
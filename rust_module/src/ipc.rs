@@ -1,5 +1,9 @@
-const MAX_MESSAGES: usize = 64;
-const MESSAGE_DATA_SIZE: usize = 128;
+use crate::ring::{self, Ring, RING_MULTI_PRODUCER};
+
+const MAX_MAILBOXES: usize = 32;
+pub const MAILBOX_DEPTH: usize = 8;
+pub const MESSAGE_DATA_SIZE: usize = 128;
+const QUEUE_STORAGE_SIZE: usize = ring::storage_size::<Message>(MAILBOX_DEPTH);
 
 #[derive(Copy, Clone, PartialEq)]
 #[repr(u8)]
@@ -9,6 +13,14 @@ pub enum MessageType {
     Signal = 2,
 }
 
+// Receiver-side view of a message; `length` is the payload size in bytes.
+#[repr(C)]
+pub struct IpcMessageInfo {
+    pub msg_type: u8,
+    pub sender_pid: u32,
+    pub length: u32,
+}
+
 #[derive(Copy, Clone)]
 pub struct Message {
     msg_type: MessageType,
@@ -28,25 +40,42 @@ impl Message {
             data: [0; MESSAGE_DATA_SIZE],
         }
     }
+    
+    pub fn fill_info(&self, info: &mut IpcMessageInfo, buf: &mut [u8]) -> usize {
+        info.msg_type = self.msg_type as u8;
+        info.sender_pid = self.sender_pid;
+        info.length = self.data_length as u32;
+        
+        let copy_len = self.data_length.min(buf.len());
+        buf[..copy_len].copy_from_slice(&self.data[..copy_len]);
+        copy_len
+    }
 }
 
+// Bounded FIFO of messages for a single receiver, backed by the kernel's
+// lock-free ring so several senders can enqueue without a lock.
 pub struct MessageQueue {
-    messages: [Message; MAX_MESSAGES],
-    head: usize,
-    tail: usize,
-    count: usize,
+    ring: Ring<Message>,
+    storage: [u8; QUEUE_STORAGE_SIZE],
 }
 
 impl MessageQueue {
     pub const fn new() -> Self {
         Self {
-            messages: [Message::new(); MAX_MESSAGES],
-            head: 0,
-            tail: 0,
-            count: 0,
+            ring: Ring::new(),
+            storage: [0; QUEUE_STORAGE_SIZE],
         }
     }
     
+    // Must be called once the queue sits at its final address.
+    pub fn init(&mut self) {
+        self.ring.init(&mut self.storage, MAILBOX_DEPTH, RING_MULTI_PRODUCER);
+    }
+    
+    pub fn pop(&mut self) -> Option<Message> {
+        self.ring.pop()
+    }
+    
     pub fn send_message(
         &mut self,
         msg_type: MessageType,
@@ -54,62 +83,130 @@ impl MessageQueue {
         receiver_pid: u32,
         data: &[u8]
     ) -> bool {
-        if self.count >= MAX_MESSAGES {
+        if data.len() > MESSAGE_DATA_SIZE {
             return false;
         }
         
-        let data_length = data.len().min(MESSAGE_DATA_SIZE);
-        
-        self.messages[self.tail].msg_type = msg_type;
-        self.messages[self.tail].sender_pid = sender_pid;
-        self.messages[self.tail].receiver_pid = receiver_pid;
-        self.messages[self.tail].data_length = data_length;
-        self.messages[self.tail].data[..data_length].copy_from_slice(&data[..data_length]);
-        
-        self.tail = (self.tail + 1) % MAX_MESSAGES;
-        self.count += 1;
+        let mut msg = Message::new();
+        msg.msg_type = msg_type;
+        msg.sender_pid = sender_pid;
+        msg.receiver_pid = receiver_pid;
+        msg.data_length = data.len();
+        msg.data[..data.len()].copy_from_slice(data);
+        self.ring.push(&msg)
+    }
+    
+    pub fn get_count(&self) -> usize {
+        self.ring.count()
+    }
+}
+
+const NO_OWNER: u32 = 0;
+pub const NO_WAITER: u32 = u32::MAX;
+
+pub struct Mailbox {
+    owner_pid: u32,
+    waiting_task: u32,
+    pub queue: MessageQueue,
+}
+
+impl Mailbox {
+    const fn new() -> Self {
+        Self {
+            owner_pid: NO_OWNER,
+            waiting_task: NO_WAITER,
+            queue: MessageQueue::new(),
+        }
+    }
+    
+    // Records the task that sleeps until a message arrives. Refuses when a
+    // message is already queued so the caller cannot miss the wakeup.
+    pub fn park(&mut self, task_id: u32) -> bool {
+        if self.queue.get_count() > 0 {
+            return false;
+        }
+        self.waiting_task = task_id;
         true
     }
     
-    pub fn receive_message(&mut self, receiver_pid: u32) -> Option<Message> {
-        for i in 0..self.count {
-            let idx = (self.head + i) % MAX_MESSAGES;
-            
-            if self.messages[idx].receiver_pid == receiver_pid {
-                let msg = self.messages[idx];
-                
-                for j in i..self.count - 1 {
-                    let curr_idx = (self.head + j) % MAX_MESSAGES;
-                    let next_idx = (self.head + j + 1) % MAX_MESSAGES;
-                    self.messages[curr_idx] = self.messages[next_idx];
-                }
-                
-                self.count -= 1;
-                self.tail = if self.tail == 0 {
-                    MAX_MESSAGES - 1
-                } else {
-                    self.tail - 1
-                };
-                
-                return Some(msg);
+    pub fn take_waiter(&mut self) -> Option<u32> {
+        if self.waiting_task == NO_WAITER {
+            return None;
+        }
+        let task_id = self.waiting_task;
+        self.waiting_task = NO_WAITER;
+        Some(task_id)
+    }
+}
+
+// Per-process mailboxes, found by open addressing on the PID so lookups do
+// not depend on how many messages are queued anywhere else.
+pub struct MailboxTable {
+    boxes: [Mailbox; MAX_MAILBOXES],
+}
+
+impl MailboxTable {
+    pub const fn new() -> Self {
+        const EMPTY: Mailbox = Mailbox::new();
+        Self {
+            boxes: [EMPTY; MAX_MAILBOXES],
+        }
+    }
+    
+    fn slot_for(&self, pid: u32) -> Option<usize> {
+        let start = pid as usize % MAX_MAILBOXES;
+        for i in 0..MAX_MAILBOXES {
+            let idx = (start + i) % MAX_MAILBOXES;
+            if self.boxes[idx].owner_pid == pid {
+                return Some(idx);
             }
         }
-        
         None
     }
     
-    pub fn has_message_for(&self, receiver_pid: u32) -> bool {
-        for i in 0..self.count {
-            let idx = (self.head + i) % MAX_MESSAGES;
-            
-            if self.messages[idx].receiver_pid == receiver_pid {
-                return true;
-            }
+    pub fn get(&mut self, pid: u32) -> Option<&mut Mailbox> {
+        match self.slot_for(pid) {
+            Some(idx) => Some(&mut self.boxes[idx]),
+            None => None,
         }
-        false
     }
     
-    pub fn get_count(&self) -> usize {
-        self.count
+    pub fn get_or_create(&mut self, pid: u32) -> Option<&mut Mailbox> {
+        if pid == NO_OWNER {
+            return None;
+        }
+        if let Some(idx) = self.slot_for(pid) {
+            return Some(&mut self.boxes[idx]);
+        }
+        let idx = self.slot_for(NO_OWNER)?;
+        let mailbox = &mut self.boxes[idx];
+        mailbox.waiting_task = NO_WAITER;
+        mailbox.queue.init();
+        mailbox.owner_pid = pid;
+        Some(mailbox)
+    }
+    
+    // Releases the mailbox of pid and drops whatever is still queued.
+    // Returns the task parked on the mailbox, which the caller has to wake.
+    pub fn close(&mut self, pid: u32) -> Option<u32> {
+        let idx = match self.slot_for(pid) {
+            Some(idx) if pid != NO_OWNER => idx,
+            _ => return None,
+        };
+        let mailbox = &mut self.boxes[idx];
+        while mailbox.queue.pop().is_some() {}
+        mailbox.owner_pid = NO_OWNER;
+        mailbox.take_waiter()
+    }
+    
+    pub fn is_open(&self, pid: u32) -> bool {
+        pid != NO_OWNER && self.slot_for(pid).is_some()
+    }
+    
+    pub fn has_message_for(&self, pid: u32) -> bool {
+        match self.slot_for(pid) {
+            Some(idx) => self.boxes[idx].queue.get_count() > 0,
+            None => false,
+        }
     }
 }
@@ -1,110 +1,214 @@
-#![no_std]
+// The "host" feature builds the crate with std for the host-side tests
+// and fuzz targets; build.rs then links C stand-ins for the kernel.
+#![cfg_attr(not(any(test, feature = "host")), no_std)]
 #![allow(internal_features)]
 #![feature(lang_items)]
 #![feature(core_intrinsics)]
 
+#[cfg(not(any(test, feature = "host")))]
 use core::panic::PanicInfo;
 use core::sync::atomic::{AtomicU32, Ordering};
-use core::cell::UnsafeCell;
 
 pub mod bitmap;
 pub mod scheduler;
 pub mod memory_pool;
 pub mod process;
 pub mod ipc;
+pub mod ring;
+pub mod page_cache;
+pub mod sync;
 pub mod utils;
 pub mod vfs;
 pub mod memfs;
+pub mod imagefs;
+#[cfg(any(test, feature = "host"))]
+pub mod fuzz;
 
-use memory_pool::MemoryPool;
+use memory_pool::{MemoryPool, PageSource, POOL_CLASSES};
 use process::ProcessManager;
-use ipc::MessageQueue;
+use ipc::MailboxTable;
+use sync::{CacheAligned, PerCpu, SpinLock, MAX_CPUS};
+use page_cache::{FrameDepot, PageMagazine, MAGAZINE_BATCH};
 
+#[cfg(not(any(test, feature = "host")))]
 #[panic_handler]
 fn panic(_info: &PanicInfo) -> ! {
     loop {}
 }
 
+#[cfg(not(any(test, feature = "host")))]
 #[lang = "eh_personality"]
 extern "C" fn eh_personality() {}
 
 const TOTAL_PAGES: u32 = 1024;
 const PAGE_SIZE: u32 = 4096;
-const MIN_PAGE_ADDR: u32 = 0x100000;
+const MIN_PAGE_ADDR: u32 = 0x0110_0000;
 const MAX_PAGE_ADDR: u32 = MIN_PAGE_ADDR + (TOTAL_PAGES * PAGE_SIZE);
 
+// Frames taken out of the global pools (NEXT_PAGE and the depot),
+// counting the ones parked in per-CPU magazines. Both move a batch at a
+// time, not per page.
 static ALLOCATED_PAGES: AtomicU32 = AtomicU32::new(0);
 static NEXT_PAGE: AtomicU32 = AtomicU32::new(MIN_PAGE_ADDR);
 
+// Allocation and free go through the calling CPU's magazine and touch
+// shared state only to refill or flush MAGAZINE_BATCH frames.
+static PAGE_MAGAZINES: PerCpu<PageMagazine> =
+    PerCpu::new([const { CacheAligned(PageMagazine::new()) }; MAX_CPUS]);
+static FRAME_DEPOT: SpinLock<FrameDepot<{ TOTAL_PAGES as usize }>> = SpinLock::new(FrameDepot::new());
+// Frames in each CPU's magazine, for statistics only
+static CACHED_PAGES: [CacheAligned<AtomicU32>; MAX_CPUS] =
+    [const { CacheAligned(AtomicU32::new(0)) }; MAX_CPUS];
+
 struct MemoryManager {
-    free_pages: UnsafeCell<u32>,
+    free_pages: AtomicU32,
 }
 
-unsafe impl Sync for MemoryManager {}
-
 impl MemoryManager {
     const fn new() -> Self {
         Self {
-            free_pages: UnsafeCell::new(TOTAL_PAGES),
+            free_pages: AtomicU32::new(TOTAL_PAGES),
         }
     }
     
     fn get_free_pages(&self) -> u32 {
-        unsafe { *self.free_pages.get() }
+        self.free_pages.load(Ordering::Relaxed)
     }
     
-    fn decrement_free_pages(&self) {
-        unsafe {
-            let free = self.free_pages.get();
-            if *free > 0 {
-                *free -= 1;
-            }
-        }
+    fn take_pages(&self, count: u32) {
+        let _ = self.free_pages.fetch_update(Ordering::Relaxed, Ordering::Relaxed, |free| {
+            Some(free.saturating_sub(count))
+        });
     }
     
-    fn increment_free_pages(&self) {
-        unsafe {
-            let free = self.free_pages.get();
-            if *free < TOTAL_PAGES {
-                *free += 1;
-            }
-        }
+    fn give_pages(&self, count: u32) {
+        let _ = self.free_pages.fetch_update(Ordering::Relaxed, Ordering::Relaxed, |free| {
+            Some((free + count).min(TOTAL_PAGES))
+        });
     }
     
     fn reset(&self) {
-        unsafe {
-            *self.free_pages.get() = TOTAL_PAGES;
+        self.free_pages.store(TOTAL_PAGES, Ordering::Relaxed);
+    }
+}
+
+// The block pool grows and shrinks a frame at a time, through the same
+// magazines as any other page. Frames are identity mapped.
+struct FramePages;
+
+impl PageSource for FramePages {
+    fn alloc_page() -> Option<usize> {
+        match rust_allocate_page() {
+            0 => None,
+            page => Some(page as usize),
         }
     }
+
+    fn free_page(page: usize) {
+        rust_free_page(page as u32);
+    }
 }
 
 static MEMORY_MANAGER: MemoryManager = MemoryManager::new();
-static mut GLOBAL_MEMORY_POOL: MemoryPool = MemoryPool::new();
-static mut GLOBAL_PROCESS_MANAGER: ProcessManager = ProcessManager::new();
-static mut GLOBAL_MESSAGE_QUEUE: MessageQueue = MessageQueue::new();
+// The block pool takes the frame depot's lock inside its own, and a
+// closing mailbox frees its frames under the mailbox lock.
+static GLOBAL_MEMORY_POOL: SpinLock<MemoryPool<FramePages>> = SpinLock::new(MemoryPool::new());
+static GLOBAL_PROCESS_MANAGER: SpinLock<ProcessManager> = SpinLock::new(ProcessManager::new());
+static GLOBAL_MAILBOXES: SpinLock<MailboxTable> = SpinLock::new(MailboxTable::new());
 
 #[no_mangle]
 pub extern "C" fn rust_memory_init() {
+    GLOBAL_MEMORY_POOL.register(c"block_pool");
+    GLOBAL_PROCESS_MANAGER.register(c"processes");
+    GLOBAL_MAILBOXES.register(c"mailboxes");
+    FRAME_DEPOT.register(c"frame_depot");
+    imagefs::register_lock();
     MEMORY_MANAGER.reset();
     ALLOCATED_PAGES.store(0, Ordering::SeqCst);
     NEXT_PAGE.store(MIN_PAGE_ADDR, Ordering::SeqCst);
 }
 
+// Carves up to `want` new frames with one CAS on NEXT_PAGE
+fn carve_pages(mag: &mut PageMagazine, want: usize) -> u32 {
+    loop {
+        let current_page = NEXT_PAGE.load(Ordering::Relaxed);
+        
+        if current_page >= MAX_PAGE_ADDR {
+            return 0;
+        }
+        
+        let count = (want as u32).min((MAX_PAGE_ADDR - current_page) / PAGE_SIZE);
+        let next_page = current_page + count * PAGE_SIZE;
+        
+        if NEXT_PAGE.compare_exchange(
+            current_page,
+            next_page,
+            Ordering::Relaxed,
+            Ordering::Relaxed
+        ).is_ok() {
+            // Pushed highest first so the magazine hands them out in order
+            for i in (0..count).rev() {
+                mag.push(current_page + i * PAGE_SIZE);
+            }
+            return count;
+        }
+    }
+}
+
+// Freed frames are used again before new ones are carved
+fn refill_magazine(mag: &mut PageMagazine) {
+    let mut taken = FRAME_DEPOT.lock().refill(mag, MAGAZINE_BATCH) as u32;
+    if taken == 0 {
+        taken = carve_pages(mag, MAGAZINE_BATCH);
+    }
+    ALLOCATED_PAGES.fetch_add(taken, Ordering::Relaxed);
+    MEMORY_MANAGER.take_pages(taken);
+}
+
+fn flush_magazine(mag: &mut PageMagazine) {
+    let returned = FRAME_DEPOT.lock().flush(mag, MAGAZINE_BATCH) as u32;
+    let _ = ALLOCATED_PAGES.fetch_update(Ordering::Relaxed, Ordering::Relaxed, |allocated| {
+        Some(allocated.saturating_sub(returned))
+    });
+    MEMORY_MANAGER.give_pages(returned);
+}
+
+fn cached_pages() -> u32 {
+    CACHED_PAGES.iter().map(|cached| cached.0.load(Ordering::Relaxed)).sum()
+}
+
 #[no_mangle]
 pub extern "C" fn rust_allocate_page() -> u32 {
-    let allocated = ALLOCATED_PAGES.load(Ordering::SeqCst);
-    if allocated >= TOTAL_PAGES {
-        return 0;
-    }
+    PAGE_MAGAZINES.with(|cpu, mag| {
+        if mag.is_empty() {
+            refill_magazine(mag);
+        }
+        let page = mag.pop().unwrap_or(0);
+        CACHED_PAGES[cpu].0.store(mag.len() as u32, Ordering::Relaxed);
+        page
+    })
+}
+
+// Also drops frames in the range that already sit in this CPU's
+// magazine or the depot. Runs at boot, before other CPUs allocate.
+#[no_mangle]
+pub extern "C" fn rust_memory_reserve(start: u32, end: u32) {
+    let end = utils::align_up(end as usize, PAGE_SIZE as usize) as u32;
+    
+    PAGE_MAGAZINES.with(|cpu, mag| {
+        mag.remove_range(start, end);
+        CACHED_PAGES[cpu].0.store(mag.len() as u32, Ordering::Relaxed);
+    });
+    FRAME_DEPOT.lock().remove_range(start, end);
     
     loop {
         let current_page = NEXT_PAGE.load(Ordering::SeqCst);
         
-        if current_page >= MAX_PAGE_ADDR {
-            return 0;
+        if end <= current_page || start >= MAX_PAGE_ADDR {
+            return;
         }
         
-        let next_page = current_page + PAGE_SIZE;
+        let next_page = end.min(MAX_PAGE_ADDR);
         
         if NEXT_PAGE.compare_exchange(
             current_page,
@@ -112,13 +216,16 @@ pub extern "C" fn rust_allocate_page() -> u32 {
             Ordering::SeqCst,
             Ordering::SeqCst
         ).is_ok() {
-            ALLOCATED_PAGES.fetch_add(1, Ordering::SeqCst);
-            MEMORY_MANAGER.decrement_free_pages();
-            return current_page;
+            let skipped = (next_page - current_page) / PAGE_SIZE;
+            ALLOCATED_PAGES.fetch_add(skipped, Ordering::SeqCst);
+            MEMORY_MANAGER.take_pages(skipped);
+            return;
         }
     }
 }
 
+// A frame that finds both the magazine and the depot full is dropped,
+// as every freed frame was before there was a depot
 #[no_mangle]
 pub extern "C" fn rust_free_page(page: u32) {
     if page < MIN_PAGE_ADDR || page >= MAX_PAGE_ADDR {
@@ -129,13 +236,13 @@ pub extern "C" fn rust_free_page(page: u32) {
         return;
     }
     
-    let allocated = ALLOCATED_PAGES.load(Ordering::SeqCst);
-    if allocated == 0 {
-        return;
-    }
-    
-    ALLOCATED_PAGES.fetch_sub(1, Ordering::SeqCst);
-    MEMORY_MANAGER.increment_free_pages();
+    PAGE_MAGAZINES.with(|cpu, mag| {
+        if mag.is_full() {
+            flush_magazine(mag);
+        }
+        mag.push(page);
+        CACHED_PAGES[cpu].0.store(mag.len() as u32, Ordering::Relaxed);
+    });
 }
 
 extern "C" {
@@ -173,8 +280,9 @@ fn print_u32(num: u32) {
 
 #[no_mangle]
 pub extern "C" fn rust_print_stats() {
-    let allocated = ALLOCATED_PAGES.load(Ordering::SeqCst);
-    let free = MEMORY_MANAGER.get_free_pages();
+    let cached = cached_pages();
+    let allocated = ALLOCATED_PAGES.load(Ordering::SeqCst).saturating_sub(cached);
+    let free = MEMORY_MANAGER.get_free_pages() + cached;
     
     print_str("  Total pages: ");
     print_u32(TOTAL_PAGES);
@@ -182,7 +290,11 @@ pub extern "C" fn rust_print_stats() {
     print_u32(allocated);
     print_str("\n  Free: ");
     print_u32(free);
-    print_str("\n");
+    print_str(" (");
+    print_u32(cached);
+    print_str(" in CPU magazines, ");
+    print_u32(FRAME_DEPOT.lock().len() as u32);
+    print_str(" in depot)\n");
 }
 
 #[no_mangle]
@@ -192,12 +304,12 @@ pub extern "C" fn rust_get_total_memory() -> u32 {
 
 #[no_mangle]
 pub extern "C" fn rust_get_free_memory() -> u32 {
-    MEMORY_MANAGER.get_free_pages() * PAGE_SIZE
+    (MEMORY_MANAGER.get_free_pages() + cached_pages()) * PAGE_SIZE
 }
 
 #[no_mangle]
 pub extern "C" fn rust_get_allocated_memory() -> u32 {
-    ALLOCATED_PAGES.load(Ordering::SeqCst) * PAGE_SIZE
+    ALLOCATED_PAGES.load(Ordering::SeqCst).saturating_sub(cached_pages()) * PAGE_SIZE
 }
 
 #[no_mangle]
@@ -207,31 +319,39 @@ pub extern "C" fn rust_is_valid_page(page: u32) -> bool {
     page % PAGE_SIZE == 0
 }
 
+// Null above 2048 bytes or when out of frames
 #[no_mangle]
-pub extern "C" fn rust_pool_allocate() -> *mut u8 {
-    unsafe {
-        let pool = &mut *core::ptr::addr_of_mut!(GLOBAL_MEMORY_POOL);
-        pool.allocate_block().unwrap_or(core::ptr::null_mut())
-    }
+pub extern "C" fn rust_pool_allocate(size: usize) -> *mut u8 {
+    GLOBAL_MEMORY_POOL.lock().allocate(size).unwrap_or(core::ptr::null_mut())
 }
 
 #[no_mangle]
 pub extern "C" fn rust_pool_free(ptr: *mut u8) -> bool {
-    unsafe {
-        let pool = &mut *core::ptr::addr_of_mut!(GLOBAL_MEMORY_POOL);
-        pool.free_block(ptr)
-    }
+    GLOBAL_MEMORY_POOL.lock().free(ptr)
 }
 
 #[no_mangle]
 pub extern "C" fn rust_pool_stats() {
-    unsafe {
-        let pool = &*core::ptr::addr_of!(GLOBAL_MEMORY_POOL);
-        print_str("  Pool allocated: ");
-        print_u32(pool.get_allocated_count() as u32);
-        print_str("\n  Pool free: ");
-        print_u32(pool.get_free_count() as u32);
-        print_str("\n");
+    // Counts are read first so the lock is not held while printing
+    let stats = {
+        let pool = GLOBAL_MEMORY_POOL.lock();
+        core::array::from_fn::<_, POOL_CLASSES, _>(|class| pool.class_stats(class))
+    };
+    let mut shown = false;
+    for class in stats.iter().filter(|class| class.pages > 0) {
+        print_str("  ");
+        print_u32(class.block_size as u32);
+        print_str(" bytes: ");
+        print_u32(class.allocated as u32);
+        print_str(" used, ");
+        print_u32(class.free as u32);
+        print_str(" free, ");
+        print_u32(class.pages as u32);
+        print_str(" pages\n");
+        shown = true;
+    }
+    if !shown {
+        print_str("  No pages\n");
     }
 }
 
@@ -245,25 +365,18 @@ pub extern "C" fn rust_process_create(priority: u8, name: *const u8) -> u32 {
         let name_len = utils::string_length(name);
         let name_slice = core::slice::from_raw_parts(name, name_len);
         
-        let manager = &mut *core::ptr::addr_of_mut!(GLOBAL_PROCESS_MANAGER);
-        manager.create_process(priority, name_slice).unwrap_or(0)
+        GLOBAL_PROCESS_MANAGER.lock().create_process(priority, name_slice).unwrap_or(0)
     }
 }
 
 #[no_mangle]
 pub extern "C" fn rust_process_terminate(pid: u32) -> bool {
-    unsafe {
-        let manager = &mut *core::ptr::addr_of_mut!(GLOBAL_PROCESS_MANAGER);
-        manager.terminate_process(pid)
-    }
+    GLOBAL_PROCESS_MANAGER.lock().terminate_process(pid)
 }
 
 #[no_mangle]
 pub extern "C" fn rust_process_schedule() -> u32 {
-    unsafe {
-        let manager = &mut *core::ptr::addr_of_mut!(GLOBAL_PROCESS_MANAGER);
-        manager.schedule_next().unwrap_or(0)
-    }
+    GLOBAL_PROCESS_MANAGER.lock().schedule_next().unwrap_or(0)
 }
 
 #[no_mangle]
@@ -286,16 +399,72 @@ pub extern "C" fn rust_ipc_send(
             _ => ipc::MessageType::Empty,
         };
         
-        let queue = &mut *core::ptr::addr_of_mut!(GLOBAL_MESSAGE_QUEUE);
-        queue.send_message(msg_type_enum, sender_pid, receiver_pid, data_slice)
+        let mut mailboxes = GLOBAL_MAILBOXES.lock();
+        match mailboxes.get_or_create(receiver_pid) {
+            Some(mailbox) => mailbox.queue.send_message(msg_type_enum, sender_pid, receiver_pid, data_slice),
+            None => false,
+        }
     }
 }
 
 #[no_mangle]
-pub extern "C" fn rust_ipc_has_message(receiver_pid: u32) -> bool {
+pub extern "C" fn rust_ipc_receive(
+    receiver_pid: u32,
+    info: *mut ipc::IpcMessageInfo,
+    buf: *mut u8,
+    buf_len: usize
+) -> i32 {
     unsafe {
-        let queue = &*core::ptr::addr_of!(GLOBAL_MESSAGE_QUEUE);
-        queue.has_message_for(receiver_pid)
+        if info.is_null() || (buf.is_null() && buf_len != 0) {
+            return -1;
+        }
+        
+        let popped = GLOBAL_MAILBOXES.lock().get(receiver_pid).and_then(|mailbox| mailbox.queue.pop());
+        let msg = match popped {
+            Some(msg) => msg,
+            None => return -1,
+        };
+        
+        let buf_slice = if buf.is_null() {
+            &mut [][..]
+        } else {
+            core::slice::from_raw_parts_mut(buf, buf_len)
+        };
+        msg.fill_info(&mut *info, buf_slice) as i32
     }
 }
 
+#[no_mangle]
+pub extern "C" fn rust_ipc_has_message(receiver_pid: u32) -> bool {
+    GLOBAL_MAILBOXES.lock().has_message_for(receiver_pid)
+}
+
+#[no_mangle]
+pub extern "C" fn rust_ipc_park(receiver_pid: u32, task_id: u32) -> bool {
+    match GLOBAL_MAILBOXES.lock().get_or_create(receiver_pid) {
+        Some(mailbox) => mailbox.park(task_id),
+        None => false,
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_ipc_take_waiter(receiver_pid: u32) -> i32 {
+    match GLOBAL_MAILBOXES.lock().get(receiver_pid).and_then(|mailbox| mailbox.take_waiter()) {
+        Some(task_id) => task_id as i32,
+        None => -1,
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_ipc_close(pid: u32) -> i32 {
+    match GLOBAL_MAILBOXES.lock().close(pid) {
+        Some(task_id) => task_id as i32,
+        None => -1,
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_ipc_is_open(pid: u32) -> bool {
+    GLOBAL_MAILBOXES.lock().is_open(pid)
+}
+
@@ -52,10 +52,10 @@ impl VfsNode for MemFile {
             return Err(VfsError::IsDirectory);
         }
 
-        let offset = offset as usize;
-        if offset >= self.data_len {
-            return Ok(0);
-        }
+        let offset = match usize::try_from(offset) {
+            Ok(offset) if offset < self.data_len => offset,
+            _ => return Ok(0),
+        };
 
         let to_read = cmp::min(buf.len(), self.data_len - offset);
         buf[..to_read].copy_from_slice(&self.data[offset..offset + to_read]);
@@ -71,10 +71,10 @@ impl VfsNode for MemFile {
             return Err(VfsError::PermissionDenied);
         }
 
-        let offset = offset as usize;
-        if offset + buf.len() > MAX_FILE_SIZE {
-            return Err(VfsError::OutOfSpace);
-        }
+        let offset = match usize::try_from(offset) {
+            Ok(offset) if offset <= MAX_FILE_SIZE && buf.len() <= MAX_FILE_SIZE - offset => offset,
+            _ => return Err(VfsError::OutOfSpace),
+        };
 
         let to_write = cmp::min(buf.len(), MAX_FILE_SIZE - offset);
         self.data[offset..offset + to_write].copy_from_slice(&buf[..to_write]);
@@ -108,6 +108,13 @@ impl MemFs {
         }
         None
     }
+
+    pub fn write_file(&mut self, name: &str, buf: &[u8], offset: u64) -> VfsResult<usize> {
+        match self.find_file(name) {
+            Some(idx) => self.files[idx].as_mut().unwrap().write(buf, offset),
+            None => Err(VfsError::NotFound),
+        }
+    }
 }
 
 impl VfsDirectory for MemFs {
@@ -194,6 +201,26 @@ pub extern "C" fn rust_vfs_create(name_ptr: *const u8, name_len: usize, file_typ
     }
 }
 
+#[no_mangle]
+pub extern "C" fn rust_vfs_remove(name_ptr: *const u8, name_len: usize) -> i32 {
+    if name_ptr.is_null() {
+        return -1;
+    }
+
+    let name_slice = unsafe { core::slice::from_raw_parts(name_ptr, name_len) };
+    let name = match core::str::from_utf8(name_slice) {
+        Ok(s) => s,
+        Err(_) => return -1,
+    };
+
+    unsafe {
+        match GLOBAL_MEMFS.remove(name) {
+            Ok(_) => 0,
+            Err(_) => -1,
+        }
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn rust_vfs_write(
     name_ptr: *const u8,
@@ -214,28 +241,14 @@ pub extern "C" fn rust_vfs_write(
     let data_slice = unsafe { core::slice::from_raw_parts(data_ptr, data_len) };
 
     unsafe {
-        let file_idx = match GLOBAL_MEMFS.find_file(name) {
-            Some(idx) => idx,
-            None => return -1,
-        };
-
-        match &mut GLOBAL_MEMFS.files[file_idx] {
-            Some(file) => match file.write(data_slice, 0) {
-                Ok(written) => written as i32,
-                Err(_) => -1,
-            },
-            None => -1,
+        match GLOBAL_MEMFS.write_file(name, data_slice, 0) {
+            Ok(written) => written as i32,
+            Err(_) => -1,
         }
     }
 }
 
-#[no_mangle]
-pub extern "C" fn rust_vfs_read(
-    name_ptr: *const u8,
-    name_len: usize,
-    buf_ptr: *mut u8,
-    buf_len: usize,
-) -> i32 {
+fn read_at(name_ptr: *const u8, name_len: usize, offset: u64, buf_ptr: *mut u8, buf_len: usize) -> i32 {
     if name_ptr.is_null() || buf_ptr.is_null() {
         return -1;
     }
@@ -251,11 +264,16 @@ pub extern "C" fn rust_vfs_read(
     unsafe {
         let file_idx = match GLOBAL_MEMFS.find_file(name) {
             Some(idx) => idx,
-            None => return -1,
+            None => {
+                return match crate::imagefs::image_read(name, buf_slice, offset) {
+                    Ok(read) => read as i32,
+                    Err(_) => -1,
+                }
+            }
         };
 
         match &GLOBAL_MEMFS.files[file_idx] {
-            Some(file) => match file.read(buf_slice, 0) {
+            Some(file) => match file.read(buf_slice, offset) {
                 Ok(read) => read as i32,
                 Err(_) => -1,
             },
@@ -263,3 +281,25 @@ pub extern "C" fn rust_vfs_read(
         }
     }
 }
+
+#[no_mangle]
+pub extern "C" fn rust_vfs_read(
+    name_ptr: *const u8,
+    name_len: usize,
+    buf_ptr: *mut u8,
+    buf_len: usize,
+) -> i32 {
+    read_at(name_ptr, name_len, 0, buf_ptr, buf_len)
+}
+
+// Reads from `offset` on; 0 at or past the end of the file
+#[no_mangle]
+pub extern "C" fn rust_vfs_read_at(
+    name_ptr: *const u8,
+    name_len: usize,
+    offset: u32,
+    buf_ptr: *mut u8,
+    buf_len: usize,
+) -> i32 {
+    read_at(name_ptr, name_len, offset as u64, buf_ptr, buf_len)
+}
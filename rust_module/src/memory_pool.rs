@@ -1,70 +1,219 @@
-const POOL_BLOCK_SIZE: usize = 64;
-const POOL_BLOCK_COUNT: usize = 256;
+// Small kernel objects by size class, packed into whole pages taken from
+// a PageSource. Each page (a slab) serves one class, and a bitmap with a
+// bit set per free slot records its occupancy, so allocation is a
+// trailing_zeros over at most four words. Slab records live outside the
+// pages: blocks are dense and aligned to their size.
 
-#[repr(C, align(64))]
-struct PoolBlock {
-    data: [u8; POOL_BLOCK_SIZE],
+use core::marker::PhantomData;
+
+pub const POOL_PAGE_SIZE: usize = 4096;
+pub const POOL_CLASSES: usize = 8;
+pub const POOL_CLASS_SIZES: [usize; POOL_CLASSES] = [16, 32, 64, 128, 256, 512, 1024, 2048];
+pub const POOL_MAX_BLOCK: usize = POOL_CLASS_SIZES[POOL_CLASSES - 1];
+// Slabs are tracked with one bit each in a u64, so at most 256 KiB
+pub const POOL_MAX_SLABS: usize = 64;
+
+const SLAB_WORDS: usize = POOL_PAGE_SIZE / POOL_CLASS_SIZES[0] / 64;
+
+pub trait PageSource {
+    // A page-aligned POOL_PAGE_SIZE page, None when memory is out
+    fn alloc_page() -> Option<usize>;
+    fn free_page(page: usize);
+}
+
+#[derive(Clone, Copy)]
+struct Slab {
+    page: usize,
+    free_bits: [u64; SLAB_WORDS],
+    free: u16,
+    class: u8,
+}
+
+impl Slab {
+    const EMPTY: Slab = Slab {
+        page: 0,
+        free_bits: [0; SLAB_WORDS],
+        free: 0,
+        class: 0,
+    };
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct PoolClassStats {
+    pub block_size: usize,
+    pub allocated: usize,
+    pub free: usize,
+    pub pages: usize,
+}
+
+pub struct MemoryPool<P: PageSource> {
+    slabs: [Slab; POOL_MAX_SLABS],
+    // Slabs holding a page, and per class the ones with a free slot
+    used_slabs: u64,
+    partial: [u64; POOL_CLASSES],
+    pages: [u32; POOL_CLASSES],
+    allocated: [u32; POOL_CLASSES],
+    _source: PhantomData<P>,
+}
+
+fn class_of(size: usize) -> Option<usize> {
+    POOL_CLASS_SIZES.iter().position(|&block_size| size <= block_size)
 }
 
-pub struct MemoryPool {
-    blocks: [PoolBlock; POOL_BLOCK_COUNT],
-    free_list: [bool; POOL_BLOCK_COUNT],
-    allocated_count: usize,
+fn slots_per_page(class: usize) -> usize {
+    POOL_PAGE_SIZE / POOL_CLASS_SIZES[class]
 }
 
-impl MemoryPool {
+impl<P: PageSource> MemoryPool<P> {
     pub const fn new() -> Self {
-        const EMPTY_BLOCK: PoolBlock = PoolBlock {
-            data: [0; POOL_BLOCK_SIZE],
-        };
-        
         Self {
-            blocks: [EMPTY_BLOCK; POOL_BLOCK_COUNT],
-            free_list: [true; POOL_BLOCK_COUNT],
-            allocated_count: 0,
+            slabs: [Slab::EMPTY; POOL_MAX_SLABS],
+            used_slabs: 0,
+            partial: [0; POOL_CLASSES],
+            pages: [0; POOL_CLASSES],
+            allocated: [0; POOL_CLASSES],
+            _source: PhantomData,
         }
     }
-    
-    pub fn allocate_block(&mut self) -> Option<*mut u8> {
-        for (idx, is_free) in self.free_list.iter_mut().enumerate() {
-            if *is_free {
-                *is_free = false;
-                self.allocated_count += 1;
-                return Some(self.blocks[idx].data.as_mut_ptr());
-            }
+
+    // A block of at least size bytes, aligned to its class size; None
+    // above POOL_MAX_BLOCK or when no page can be had
+    pub fn allocate(&mut self, size: usize) -> Option<*mut u8> {
+        let class = class_of(size)?;
+        if self.partial[class] == 0 {
+            self.grow(class)?;
         }
-        None
+
+        let index = self.partial[class].trailing_zeros() as usize;
+        let slab = &mut self.slabs[index];
+        let word = slab.free_bits.iter().position(|bits| *bits != 0)?;
+        let bit = slab.free_bits[word].trailing_zeros() as usize;
+        slab.free_bits[word] &= !(1u64 << bit);
+        slab.free -= 1;
+        if slab.free == 0 {
+            self.partial[class] &= !(1u64 << index);
+        }
+        self.allocated[class] += 1;
+
+        let slot = word * 64 + bit;
+        Some((slab.page + slot * POOL_CLASS_SIZES[class]) as *mut u8)
     }
-    
-    pub fn free_block(&mut self, ptr: *mut u8) -> bool {
-        let pool_start = self.blocks[0].data.as_ptr() as usize;
-        let pool_end = pool_start + (POOL_BLOCK_SIZE * POOL_BLOCK_COUNT);
+
+    // False for a pointer the pool did not hand out or already has back.
+    // A page left empty goes back to the source unless it is the last
+    // one of its class.
+    pub fn free(&mut self, ptr: *mut u8) -> bool {
         let addr = ptr as usize;
-        
-        if addr < pool_start || addr >= pool_end {
+        let page = addr & !(POOL_PAGE_SIZE - 1);
+        let index = match self.find_slab(page) {
+            Some(index) => index,
+            None => return false,
+        };
+
+        let slab = &mut self.slabs[index];
+        let class = slab.class as usize;
+        let offset = addr - page;
+        if offset % POOL_CLASS_SIZES[class] != 0 {
             return false;
         }
-        
-        if (addr - pool_start) % POOL_BLOCK_SIZE != 0 {
+        let slot = offset / POOL_CLASS_SIZES[class];
+        let mask = 1u64 << (slot % 64);
+        if slab.free_bits[slot / 64] & mask != 0 {
             return false;
         }
-        
-        let block_idx = (addr - pool_start) / POOL_BLOCK_SIZE;
-        
-        if self.free_list[block_idx] {
-            return false;
+
+        slab.free_bits[slot / 64] |= mask;
+        slab.free += 1;
+        self.partial[class] |= 1u64 << index;
+        self.allocated[class] -= 1;
+
+        if slab.free as usize == slots_per_page(class) && self.pages[class] > 1 {
+            self.release(index);
         }
-        
-        self.free_list[block_idx] = true;
-        self.allocated_count -= 1;
         true
     }
-    
+
+    // Returns every empty page to the source
+    pub fn trim(&mut self) {
+        let mut used = self.used_slabs;
+        while used != 0 {
+            let index = used.trailing_zeros() as usize;
+            used &= used - 1;
+            let slab = &self.slabs[index];
+            if slab.free as usize == slots_per_page(slab.class as usize) {
+                self.release(index);
+            }
+        }
+    }
+
+    pub fn class_stats(&self, class: usize) -> PoolClassStats {
+        let pages = self.pages[class] as usize;
+        let allocated = self.allocated[class] as usize;
+        PoolClassStats {
+            block_size: POOL_CLASS_SIZES[class],
+            allocated,
+            free: pages * slots_per_page(class) - allocated,
+            pages,
+        }
+    }
+
     pub fn get_allocated_count(&self) -> usize {
-        self.allocated_count
+        self.allocated.iter().map(|&count| count as usize).sum()
+    }
+
+    pub fn get_page_count(&self) -> usize {
+        self.pages.iter().map(|&count| count as usize).sum()
     }
-    
-    pub fn get_free_count(&self) -> usize {
-        POOL_BLOCK_COUNT - self.allocated_count
+
+    fn grow(&mut self, class: usize) -> Option<()> {
+        if self.used_slabs == u64::MAX {
+            return None;
+        }
+        let page = P::alloc_page()?;
+        let index = (!self.used_slabs).trailing_zeros() as usize;
+        let slots = slots_per_page(class);
+
+        let slab = &mut self.slabs[index];
+        slab.page = page;
+        slab.class = class as u8;
+        slab.free = slots as u16;
+        for (word, bits) in slab.free_bits.iter_mut().enumerate() {
+            let first = word * 64;
+            *bits = if slots >= first + 64 {
+                u64::MAX
+            } else if slots > first {
+                (1u64 << (slots - first)) - 1
+            } else {
+                0
+            };
+        }
+
+        self.used_slabs |= 1u64 << index;
+        self.partial[class] |= 1u64 << index;
+        self.pages[class] += 1;
+        Some(())
+    }
+
+    fn release(&mut self, index: usize) {
+        let slab = &mut self.slabs[index];
+        let class = slab.class as usize;
+        P::free_page(slab.page);
+        *slab = Slab::EMPTY;
+        self.used_slabs &= !(1u64 << index);
+        self.partial[class] &= !(1u64 << index);
+        self.pages[class] -= 1;
+    }
+
+    // At most POOL_MAX_SLABS compares, over the slabs in use only
+    fn find_slab(&self, page: usize) -> Option<usize> {
+        let mut used = self.used_slabs;
+        while used != 0 {
+            let index = used.trailing_zeros() as usize;
+            if self.slabs[index].page == page {
+                return Some(index);
+            }
+            used &= used - 1;
+        }
+        None
     }
 }
@@ -0,0 +1,118 @@
+// Per-CPU frame magazines and the shared depot behind them. A magazine
+// is a small stack of free frames owned by one CPU; the depot holds
+// frames that overflowed a magazine until some CPU refills from it.
+
+pub const MAGAZINE_SIZE: usize = 16;
+pub const MAGAZINE_BATCH: usize = 8;
+
+pub struct PageMagazine {
+    frames: [u32; MAGAZINE_SIZE],
+    count: usize,
+}
+
+impl PageMagazine {
+    pub const fn new() -> Self {
+        Self {
+            frames: [0; MAGAZINE_SIZE],
+            count: 0,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.count
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.count == 0
+    }
+
+    pub fn is_full(&self) -> bool {
+        self.count == MAGAZINE_SIZE
+    }
+
+    pub fn push(&mut self, frame: u32) -> bool {
+        if self.is_full() {
+            return false;
+        }
+        self.frames[self.count] = frame;
+        self.count += 1;
+        true
+    }
+
+    pub fn pop(&mut self) -> Option<u32> {
+        if self.count == 0 {
+            return None;
+        }
+        self.count -= 1;
+        Some(self.frames[self.count])
+    }
+
+    // Drops cached frames inside [start, end); returns how many
+    pub fn remove_range(&mut self, start: u32, end: u32) -> usize {
+        let before = self.count;
+        let mut kept = 0;
+        for i in 0..self.count {
+            let frame = self.frames[i];
+            if frame < start || frame >= end {
+                self.frames[kept] = frame;
+                kept += 1;
+            }
+        }
+        self.count = kept;
+        before - kept
+    }
+}
+
+pub struct FrameDepot<const N: usize> {
+    frames: [u32; N],
+    count: usize,
+}
+
+impl<const N: usize> FrameDepot<N> {
+    pub const fn new() -> Self {
+        Self {
+            frames: [0; N],
+            count: 0,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.count
+    }
+
+    // Moves up to `want` frames into the magazine
+    pub fn refill(&mut self, mag: &mut PageMagazine, want: usize) -> usize {
+        let mut moved = 0;
+        while moved < want && self.count > 0 && !mag.is_full() {
+            self.count -= 1;
+            mag.push(self.frames[self.count]);
+            moved += 1;
+        }
+        moved
+    }
+
+    // Takes the oldest `want` frames of the magazine, so the ones the
+    // CPU freed last stay cache-warm there
+    pub fn flush(&mut self, mag: &mut PageMagazine, want: usize) -> usize {
+        let moved = want.min(mag.count).min(N - self.count);
+        self.frames[self.count..self.count + moved].copy_from_slice(&mag.frames[..moved]);
+        self.count += moved;
+        mag.frames.copy_within(moved..mag.count, 0);
+        mag.count -= moved;
+        moved
+    }
+
+    pub fn remove_range(&mut self, start: u32, end: u32) -> usize {
+        let before = self.count;
+        let mut kept = 0;
+        for i in 0..self.count {
+            let frame = self.frames[i];
+            if frame < start || frame >= end {
+                self.frames[kept] = frame;
+                kept += 1;
+            }
+        }
+        self.count = kept;
+        before - kept
+    }
+}
@@ -0,0 +1,82 @@
+use core::ffi::c_void;
+use core::marker::PhantomData;
+use core::mem::size_of;
+
+// Bindings to the lock-free ring in kernel/ring.c. The C struct is three
+// cache lines (consumer index, producer index, read-mostly fields); Rust only
+// needs its size and alignment.
+
+pub const RING_SINGLE_PRODUCER: u32 = 0x0;
+pub const RING_MULTI_PRODUCER: u32 = 0x1;
+
+const RING_CACHE_LINE: usize = 64;
+
+#[repr(C, align(64))]
+pub struct RawRing {
+    _opaque: [u8; 3 * RING_CACHE_LINE],
+}
+
+extern "C" {
+    fn ring_init(ring: *mut RawRing, storage: *mut c_void, capacity: u32, elem_size: u32, flags: u32) -> bool;
+    fn ring_push(ring: *mut RawRing, elem: *const c_void) -> bool;
+    fn ring_pop(ring: *mut RawRing, elem: *mut c_void) -> bool;
+    fn ring_count(ring: *const RawRing) -> u32;
+}
+
+pub const fn slot_size(elem_size: usize) -> usize {
+    4 + ((elem_size + 3) & !3)
+}
+
+pub const fn storage_size<T>(capacity: usize) -> usize {
+    capacity * slot_size(size_of::<T>())
+}
+
+// Typed view of a ring carrying `T` by value. The storage must stay at a
+// fixed address once init() has been called.
+pub struct Ring<T: Copy> {
+    raw: RawRing,
+    _marker: PhantomData<T>,
+}
+
+impl<T: Copy> Ring<T> {
+    pub const fn new() -> Self {
+        Self {
+            raw: RawRing { _opaque: [0; 3 * RING_CACHE_LINE] },
+            _marker: PhantomData,
+        }
+    }
+
+    pub fn init(&mut self, storage: &mut [u8], capacity: usize, flags: u32) -> bool {
+        if storage.len() < storage_size::<T>(capacity) {
+            return false;
+        }
+        unsafe {
+            ring_init(
+                &mut self.raw,
+                storage.as_mut_ptr() as *mut c_void,
+                capacity as u32,
+                size_of::<T>() as u32,
+                flags,
+            )
+        }
+    }
+
+    pub fn push(&mut self, item: &T) -> bool {
+        unsafe { ring_push(&mut self.raw, item as *const T as *const c_void) }
+    }
+
+    pub fn pop(&mut self) -> Option<T> {
+        let mut item = core::mem::MaybeUninit::<T>::uninit();
+        unsafe {
+            if ring_pop(&mut self.raw, item.as_mut_ptr() as *mut c_void) {
+                Some(item.assume_init())
+            } else {
+                None
+            }
+        }
+    }
+
+    pub fn count(&self) -> usize {
+        unsafe { ring_count(&self.raw) as usize }
+    }
+}
@@ -0,0 +1,252 @@
+use core::cell::UnsafeCell;
+use core::ffi::CStr;
+use core::ops::{Deref, DerefMut};
+
+// Bindings to the locks in kernel/lock.c. Rust only needs their sizes:
+// an all-zero lock is unlocked, so these can be built in const context
+// and placed in statics. Spin and RW locks are always taken with
+// interrupts off, since Rust code does not know whether a handler on the
+// same CPU might want the same lock.
+
+#[repr(C)]
+pub struct RawSpinLock {
+    _opaque: [u32; 6],
+}
+
+#[repr(C)]
+pub struct RawRwLock {
+    _opaque: [u32; 6],
+}
+
+#[repr(C)]
+pub struct RawMutex {
+    _opaque: [u32; 12],
+}
+
+// Same as MAX_CPUS in kernel/percpu.h
+pub const MAX_CPUS: usize = 8;
+
+extern "C" {
+    fn percpu_id() -> u32;
+    fn cpu_irq_save() -> u32;
+    fn cpu_irq_restore(flags: u32);
+    fn spin_lock_irqsave(lock: *mut RawSpinLock) -> u32;
+    fn spin_unlock_irqrestore(lock: *mut RawSpinLock, flags: u32);
+    fn spin_register(lock: *mut RawSpinLock, name: *const u8);
+    fn read_lock_irqsave(lock: *mut RawRwLock) -> u32;
+    fn read_unlock_irqrestore(lock: *mut RawRwLock, flags: u32);
+    fn write_lock_irqsave(lock: *mut RawRwLock) -> u32;
+    fn write_unlock_irqrestore(lock: *mut RawRwLock, flags: u32);
+    fn rwlock_register(lock: *mut RawRwLock, name: *const u8);
+    fn mutex_lock(lock: *mut RawMutex);
+    fn mutex_unlock(lock: *mut RawMutex);
+    fn mutex_register(lock: *mut RawMutex, name: *const u8);
+}
+
+// Ticket spinlock owning its data. lock() returns a guard that derefs to
+// the data and unlocks when dropped.
+pub struct SpinLock<T> {
+    raw: UnsafeCell<RawSpinLock>,
+    data: UnsafeCell<T>,
+}
+
+unsafe impl<T: Send> Sync for SpinLock<T> {}
+unsafe impl<T: Send> Send for SpinLock<T> {}
+
+impl<T> SpinLock<T> {
+    pub const fn new(data: T) -> Self {
+        Self {
+            raw: UnsafeCell::new(RawSpinLock { _opaque: [0; 6] }),
+            data: UnsafeCell::new(data),
+        }
+    }
+
+    // Lists the lock in the shell's "lockstat"
+    pub fn register(&'static self, name: &'static CStr) {
+        unsafe { spin_register(self.raw.get(), name.as_ptr() as *const u8) }
+    }
+
+    pub fn lock(&self) -> SpinLockGuard<'_, T> {
+        let flags = unsafe { spin_lock_irqsave(self.raw.get()) };
+        SpinLockGuard { lock: self, flags }
+    }
+}
+
+pub struct SpinLockGuard<'a, T> {
+    lock: &'a SpinLock<T>,
+    flags: u32,
+}
+
+impl<T> Deref for SpinLockGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+impl<T> DerefMut for SpinLockGuard<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        unsafe { &mut *self.lock.data.get() }
+    }
+}
+
+impl<T> Drop for SpinLockGuard<'_, T> {
+    fn drop(&mut self) {
+        unsafe { spin_unlock_irqrestore(self.lock.raw.get(), self.flags) }
+    }
+}
+
+// Reader-writer spinlock. A waiting writer holds off new readers.
+pub struct RwLock<T> {
+    raw: UnsafeCell<RawRwLock>,
+    data: UnsafeCell<T>,
+}
+
+unsafe impl<T: Send + Sync> Sync for RwLock<T> {}
+unsafe impl<T: Send> Send for RwLock<T> {}
+
+impl<T> RwLock<T> {
+    pub const fn new(data: T) -> Self {
+        Self {
+            raw: UnsafeCell::new(RawRwLock { _opaque: [0; 6] }),
+            data: UnsafeCell::new(data),
+        }
+    }
+
+    pub fn register(&'static self, name: &'static CStr) {
+        unsafe { rwlock_register(self.raw.get(), name.as_ptr() as *const u8) }
+    }
+
+    pub fn read(&self) -> ReadGuard<'_, T> {
+        let flags = unsafe { read_lock_irqsave(self.raw.get()) };
+        ReadGuard { lock: self, flags }
+    }
+
+    pub fn write(&self) -> WriteGuard<'_, T> {
+        let flags = unsafe { write_lock_irqsave(self.raw.get()) };
+        WriteGuard { lock: self, flags }
+    }
+}
+
+pub struct ReadGuard<'a, T> {
+    lock: &'a RwLock<T>,
+    flags: u32,
+}
+
+impl<T> Deref for ReadGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+impl<T> Drop for ReadGuard<'_, T> {
+    fn drop(&mut self) {
+        unsafe { read_unlock_irqrestore(self.lock.raw.get(), self.flags) }
+    }
+}
+
+pub struct WriteGuard<'a, T> {
+    lock: &'a RwLock<T>,
+    flags: u32,
+}
+
+impl<T> Deref for WriteGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+impl<T> DerefMut for WriteGuard<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        unsafe { &mut *self.lock.data.get() }
+    }
+}
+
+impl<T> Drop for WriteGuard<'_, T> {
+    fn drop(&mut self) {
+        unsafe { write_unlock_irqrestore(self.lock.raw.get(), self.flags) }
+    }
+}
+
+// Sleeping lock for task context: a task that finds it held blocks until
+// the owner unlocks. Never take one from an interrupt handler.
+pub struct Mutex<T> {
+    raw: UnsafeCell<RawMutex>,
+    data: UnsafeCell<T>,
+}
+
+unsafe impl<T: Send> Sync for Mutex<T> {}
+unsafe impl<T: Send> Send for Mutex<T> {}
+
+impl<T> Mutex<T> {
+    pub const fn new(data: T) -> Self {
+        Self {
+            raw: UnsafeCell::new(RawMutex { _opaque: [0; 12] }),
+            data: UnsafeCell::new(data),
+        }
+    }
+
+    pub fn register(&'static self, name: &'static CStr) {
+        unsafe { mutex_register(self.raw.get(), name.as_ptr() as *const u8) }
+    }
+
+    pub fn lock(&self) -> MutexGuard<'_, T> {
+        unsafe { mutex_lock(self.raw.get()) };
+        MutexGuard { lock: self }
+    }
+}
+
+pub struct MutexGuard<'a, T> {
+    lock: &'a Mutex<T>,
+}
+
+impl<T> Deref for MutexGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+impl<T> DerefMut for MutexGuard<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        unsafe { &mut *self.lock.data.get() }
+    }
+}
+
+impl<T> Drop for MutexGuard<'_, T> {
+    fn drop(&mut self) {
+        unsafe { mutex_unlock(self.lock.raw.get()) }
+    }
+}
+
+// Keeps each CPU's copy of per-CPU data on its own cache line
+#[repr(C, align(64))]
+pub struct CacheAligned<T>(pub T);
+
+// One T per CPU. with() hands the calling CPU's copy to the closure with
+// interrupts off, so no handler and no other CPU can reach it meanwhile;
+// a task only changes CPU when it switches, which cannot happen inside.
+pub struct PerCpu<T> {
+    slots: UnsafeCell<[CacheAligned<T>; MAX_CPUS]>,
+}
+
+unsafe impl<T: Send> Sync for PerCpu<T> {}
+
+impl<T> PerCpu<T> {
+    pub const fn new(slots: [CacheAligned<T>; MAX_CPUS]) -> Self {
+        Self { slots: UnsafeCell::new(slots) }
+    }
+
+    pub fn with<R>(&self, f: impl FnOnce(usize, &mut T) -> R) -> R {
+        unsafe {
+            let flags = cpu_irq_save();
+            let cpu = percpu_id() as usize;
+            let slot = &mut *core::ptr::addr_of_mut!((*self.slots.get())[cpu].0);
+            let result = f(cpu, slot);
+            cpu_irq_restore(flags);
+            result
+        }
+    }
+}
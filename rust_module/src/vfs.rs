@@ -64,7 +64,7 @@ impl FileMetadata {
     }
 }
 
-#[derive(Debug)]
+#[derive(Debug, PartialEq)]
 pub enum VfsError {
     NotFound,
     PermissionDenied,
@@ -0,0 +1,57 @@
+/* Stand-in for libFuzzer's main when building with gcc: runs the target
+   on each file named on the command line, or on random inputs.
+   Usage: <target> [files...] | <target> -runs=N [-seed=S] */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_INPUT 4096
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static uint8_t input[MAX_INPUT];
+
+static int run_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    size_t size = fread(input, 1, sizeof(input), file);
+    fclose(file);
+    LLVMFuzzerTestOneInput(input, size);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    unsigned long runs = 0;
+    unsigned long seed = (unsigned long)time(NULL);
+    int files = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtoul(argv[i] + 6, NULL, 0);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoul(argv[i] + 6, NULL, 0);
+        } else if (run_file(argv[i]) != 0) {
+            return 1;
+        } else {
+            files++;
+        }
+    }
+    if (files && !runs) return 0;
+
+    if (!runs) runs = 10000;
+    printf("%s: %lu random inputs, seed %lu\n", argv[0], runs, seed);
+    srand((unsigned)seed);
+    for (unsigned long run = 0; run < runs; run++) {
+        size_t size = (size_t)rand() % MAX_INPUT;
+        for (size_t i = 0; i < size; i++) input[i] = (uint8_t)rand();
+        LLVMFuzzerTestOneInput(input, size);
+    }
+    printf("%s: ok\n", argv[0]);
+    return 0;
+}
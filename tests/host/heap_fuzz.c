@@ -0,0 +1,89 @@
+/* libFuzzer target for kernel/heap.c. Each input is a program of
+   3-byte operations on a small region, so exhaustion and merging come
+   up quickly. Build with clang -fsanitize=fuzzer, or with fuzz_main.c
+   for a plain random run. */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heap.h"
+
+#define FUZZ_REGION_SIZE (64 * 1024)
+#define FUZZ_SLOTS 64
+#define FUZZ_CPUS 4
+
+uint32_t host_cpu;
+
+static uint8_t region[FUZZ_REGION_SIZE] __attribute__((aligned(64)));
+
+typedef struct {
+    uint8_t* ptr;
+    uint32_t size;
+    uint8_t fill;
+} fuzz_slot_t;
+
+static void verify(const fuzz_slot_t* slot) {
+    for (uint32_t i = 0; i < slot->size; i++) {
+        if (slot->ptr[i] != slot->fill) abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzz_slot_t slots[FUZZ_SLOTS];
+
+    memset(slots, 0, sizeof(slots));
+    host_cpu = 0;
+    heap_init_region(region, sizeof(region));
+
+    for (size_t i = 0; i + 3 <= size; i += 3) {
+        uint8_t op = data[i] & 3;
+        fuzz_slot_t* slot = &slots[data[i] >> 2 & (FUZZ_SLOTS - 1)];
+        /* Half the sizes under 256 bytes, the rest up to 8 KB */
+        uint32_t len = data[i + 1] | (uint32_t)data[i + 2] << 8;
+        len = (len & 0x8000) ? len & 0x1FFF : len & 0xFF;
+
+        switch (op) {
+        case 0:
+        case 1:
+            if (slot->ptr) {
+                verify(slot);
+                kfree(slot->ptr);
+                slot->ptr = NULL;
+            } else {
+                slot->ptr = kmalloc(len);
+                slot->size = slot->ptr ? len : 0;
+                slot->fill = data[i + 1];
+                if (slot->ptr) memset(slot->ptr, slot->fill, len);
+            }
+            break;
+        case 2:
+            if (slot->ptr && len) {
+                verify(slot);
+                uint8_t* p = krealloc(slot->ptr, len);
+                if (p) {
+                    uint32_t kept = len < slot->size ? len : slot->size;
+                    for (uint32_t j = 0; j < kept; j++) {
+                        if (p[j] != slot->fill) abort();
+                    }
+                    memset(p, slot->fill, len);
+                    slot->ptr = p;
+                    slot->size = len;
+                }
+            }
+            break;
+        default:
+            host_cpu = data[i + 1] % FUZZ_CPUS;
+            break;
+        }
+        if (!heap_check()) abort();
+    }
+
+    for (uint32_t i = 0; i < FUZZ_SLOTS; i++) {
+        if (slots[i].ptr) {
+            verify(&slots[i]);
+            kfree(slots[i].ptr);
+        }
+    }
+    if (!heap_check()) abort();
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef HEAP_HOST_H
+#define HEAP_HOST_H
+
+/* Stands in for lock.h, cpu.h and percpu.h when heap.c is built on the
+   host with -DHEAP_HOSTED. There is one thread and no interrupts; locks
+   only check that they are not taken twice, and the CPU number is a
+   variable the test sets to exercise several CPUs' magazines. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define MAX_CPUS 8              /* as in kernel/percpu.h */
+
+typedef struct {
+    bool held;
+} spinlock_t;
+
+#define SPINLOCK_INIT { false }
+
+extern uint32_t host_cpu;
+
+static inline uint32_t cpu_id(void) { return host_cpu; }
+static inline uint32_t irq_save(void) { return 0; }
+static inline void irq_restore(uint32_t flags) { (void)flags; }
+
+static inline void spin_lock(spinlock_t* lock) {
+    assert(!lock->held);
+    lock->held = true;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    assert(lock->held);
+    lock->held = false;
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    spin_lock(lock);
+    return 0;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    (void)flags;
+    spin_unlock(lock);
+}
+
+static inline void spin_register(spinlock_t* lock, const char* name) {
+    (void)lock;
+    (void)name;
+}
+
+#endif
@@ -0,0 +1,221 @@
+/* Host build of kernel/heap.c against a static region: unit checks and
+   a randomized stress run that verifies block contents and heap_check()
+   as it goes. Usage: heap_test [seed] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "heap.h"
+
+#define REGION_SIZE (1024 * 1024)
+#define SLOTS 512
+#define STRESS_OPS 200000
+#define CHECK_EVERY 64
+
+uint32_t host_cpu;
+
+static uint8_t region[REGION_SIZE] __attribute__((aligned(64)));
+static uint32_t rng_state;
+static int failures;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond);                \
+            failures++;                                                        \
+            return;                                                            \
+        }                                                                      \
+    } while (0)
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void reset(void) {
+    host_cpu = 0;
+    heap_init_region(region, sizeof(region));
+}
+
+static void test_basic(void) {
+    reset();
+    CHECK(kmalloc(0) == NULL);
+    kfree(NULL);
+
+    void* small = kmalloc(24);
+    void* large = kmalloc(5000);
+    CHECK(small && large && small != large);
+    CHECK(((uintptr_t)small & 3) == 0 && ((uintptr_t)large & 3) == 0);
+    memset(small, 0xAA, 24);
+    memset(large, 0xBB, 5000);
+    CHECK(heap_check());
+
+    kfree(small);
+    kfree(large);
+    CHECK(heap_check());
+}
+
+/* Large blocks bypass the magazines: freeing all of them gives the
+   region back in one piece */
+static void test_exhaust_and_merge(void) {
+    static void* blocks[REGION_SIZE / 1024];
+    uint32_t count = 0;
+    heap_stats_t stats;
+
+    reset();
+    while (count < sizeof(blocks) / sizeof(blocks[0])) {
+        void* p = kmalloc(4000);
+        if (!p) break;
+        blocks[count++] = p;
+    }
+    CHECK(count > 200);
+    CHECK(kmalloc(4000) == NULL);
+    CHECK(heap_check());
+
+    for (uint32_t i = 0; i < count; i += 2) kfree(blocks[i]);
+    for (uint32_t i = 1; i < count; i += 2) kfree(blocks[i]);
+    CHECK(heap_check());
+    CHECK(heap_get_used() == 0);
+    heap_get_stats(&stats);
+    CHECK(stats.free_blocks == 1);
+    CHECK(kmalloc(REGION_SIZE / 2) != NULL);
+}
+
+/* A second free, or a pointer from elsewhere, must change nothing */
+static void test_bad_frees(void) {
+    static uint8_t outside[64];
+
+    reset();
+    void* small = kmalloc(32);
+    void* large = kmalloc(2048);
+    kfree(small);
+    kfree(small);
+    kfree(large);
+    kfree(large);
+    kfree(outside + 32);
+    CHECK(heap_check());
+
+    void* a = kmalloc(32);
+    void* b = kmalloc(32);
+    CHECK(a && b && a != b);
+}
+
+/* Blocks freed on another CPU land in that CPU's magazines and must
+   still be reusable and consistent */
+static void test_cross_cpu(void) {
+    void* blocks[64];
+
+    reset();
+    for (uint32_t i = 0; i < 64; i++) {
+        blocks[i] = kmalloc(64);
+        CHECK(blocks[i] != NULL);
+    }
+    host_cpu = 3;
+    for (uint32_t i = 0; i < 64; i++) kfree(blocks[i]);
+    CHECK(heap_check());
+    for (uint32_t i = 0; i < 64; i++) {
+        blocks[i] = kmalloc(64);
+        CHECK(blocks[i] != NULL);
+    }
+    CHECK(heap_check());
+}
+
+static void test_realloc(void) {
+    reset();
+    uint8_t* p = kmalloc(40);
+    CHECK(p != NULL);
+    for (uint32_t i = 0; i < 40; i++) p[i] = (uint8_t)i;
+    p = krealloc(p, 3000);
+    CHECK(p != NULL);
+    for (uint32_t i = 0; i < 40; i++) CHECK(p[i] == (uint8_t)i);
+    CHECK(krealloc(p, 0) == NULL);
+    CHECK(heap_check());
+}
+
+typedef struct {
+    uint8_t* ptr;
+    uint32_t size;
+    uint8_t fill;
+} slot_t;
+
+static bool contents_ok(const slot_t* slot) {
+    for (uint32_t i = 0; i < slot->size; i++) {
+        if (slot->ptr[i] != slot->fill) return false;
+    }
+    return true;
+}
+
+/* Mostly magazine-sized requests with some large ones, random frees,
+   reallocs and CPU changes. Every live block carries a fill byte that
+   must survive until it is freed. */
+static void test_stress(void) {
+    static slot_t slots[SLOTS];
+
+    reset();
+    memset(slots, 0, sizeof(slots));
+    for (uint32_t op = 0; op < STRESS_OPS; op++) {
+        slot_t* slot = &slots[rng() % SLOTS];
+        uint32_t action = rng() % 16;
+
+        if (action == 0) {
+            host_cpu = rng() % 4;
+        } else if (slot->ptr && action < 7) {
+            CHECK(contents_ok(slot));
+            kfree(slot->ptr);
+            slot->ptr = NULL;
+        } else if (slot->ptr && action == 7) {
+            CHECK(contents_ok(slot));
+            uint32_t size = 1 + rng() % 4096;
+            uint8_t* p = krealloc(slot->ptr, size);
+            if (p) {
+                uint32_t kept = size < slot->size ? size : slot->size;
+                for (uint32_t i = 0; i < kept; i++) CHECK(p[i] == slot->fill);
+                slot->ptr = p;
+                slot->size = size;
+                memset(p, slot->fill, size);
+            }
+        } else if (!slot->ptr) {
+            uint32_t size = (rng() % 4) ? 1 + rng() % 256 : 1 + rng() % 8192;
+            slot->ptr = kmalloc(size);
+            if (slot->ptr) {
+                slot->size = size;
+                slot->fill = (uint8_t)rng();
+                memset(slot->ptr, slot->fill, size);
+            }
+        }
+
+        if (op % CHECK_EVERY == 0) {
+            CHECK(heap_check());
+        }
+    }
+
+    for (uint32_t i = 0; i < SLOTS; i++) {
+        if (slots[i].ptr) {
+            CHECK(contents_ok(&slots[i]));
+            kfree(slots[i].ptr);
+        }
+    }
+    CHECK(heap_check());
+}
+
+static void run(const char* name, void (*test)(void)) {
+    int before = failures;
+    test();
+    printf("%s %s\n", failures == before ? "PASS" : "FAIL", name);
+}
+
+int main(int argc, char** argv) {
+    uint32_t seed = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : (uint32_t)time(NULL);
+    rng_state = seed ? seed : 1;
+    printf("heap_test seed %u\n", seed);
+
+    run("basic", test_basic);
+    run("exhaust_and_merge", test_exhaust_and_merge);
+    run("bad_frees", test_bad_frees);
+    run("cross_cpu", test_cross_cpu);
+    run("realloc", test_realloc);
+    run("stress", test_stress);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/* The kernel functions rust_module calls, for host builds of the crate
+   (cargo test --features host). Locks are plain test-and-set spinlocks
+   on the first word of the opaque lock, so tests running in parallel
+   threads stay safe; there are no interrupts and every thread is CPU 0. */
+#include <stdint.h>
+
+static void lock_word(uint32_t* word) {
+    while (__atomic_exchange_n(word, 1, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static void unlock_word(uint32_t* word) {
+    __atomic_store_n(word, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t percpu_id(void) { return 0; }
+uint32_t cpu_irq_save(void) { return 0; }
+void cpu_irq_restore(uint32_t flags) { (void)flags; }
+
+uint32_t spin_lock_irqsave(uint32_t* lock) { lock_word(lock); return 0; }
+void spin_unlock_irqrestore(uint32_t* lock, uint32_t flags) { (void)flags; unlock_word(lock); }
+void spin_register(uint32_t* lock, const char* name) { (void)lock; (void)name; }
+
+/* Readers exclude each other too; only correctness matters here */
+uint32_t read_lock_irqsave(uint32_t* lock) { lock_word(lock); return 0; }
+void read_unlock_irqrestore(uint32_t* lock, uint32_t flags) { (void)flags; unlock_word(lock); }
+uint32_t write_lock_irqsave(uint32_t* lock) { lock_word(lock); return 0; }
+void write_unlock_irqrestore(uint32_t* lock, uint32_t flags) { (void)flags; unlock_word(lock); }
+void rwlock_register(uint32_t* lock, const char* name) { (void)lock; (void)name; }
+
+void mutex_lock(uint32_t* lock) { lock_word(lock); }
+void mutex_unlock(uint32_t* lock) { unlock_word(lock); }
+void mutex_register(uint32_t* lock, const char* name) { (void)lock; (void)name; }
+
+void terminal_writestring(const char* s) { (void)s; }
+void terminal_putchar(char c) { (void)c; }
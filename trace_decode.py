@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# Decodes the binary trace dumps ("trace serial") found in a COM1 capture
+# into the same lines the shell's "trace" command prints. Format strings
+# are not sent; they are read from the kernel image at the address each
+# record carries, so pass the toyos.elf that produced the capture.
+#
+#   qemu-system-i386 -kernel build/toyos.elf -serial file:build/serial.log
+#   ./trace_decode.py build/toyos.elf build/serial.log
+#
+# Record layout (kernel/trace.c, encode_record), little endian:
+#   tsc:8 seq:4 level:1 module:1 nargs:1 pad:1 fmt:4 args:4x4
+
+import re
+import struct
+import sys
+
+WIRE_SIZE = 36
+MAX_ARGS = 4
+
+# Same order as trace_level_t and trace_module_t in kernel/trace.h
+LEVELS = ["INFO", "WARN", "ERR ", "DBG "]
+MODULES = ["kernel", "sched", "ipc", "irq", "mem", "fs", "driver", "shell"]
+
+BEGIN = re.compile(rb"--- trace begin (\d+) ---\n")
+END = b"--- trace end ---\n"
+
+
+class KernelImage:
+    """Allocated sections of an ELF32 image, for reading strings by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            sys.exit(f"{path}: not a 32-bit ELF file")
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, _, addr, offset, size,
+             _, _, _, _) = struct.unpack_from("<10I", self.data, shoff + i * shentsize)
+            # SHT_NOBITS (.bss) has no bytes in the file
+            if addr != 0 and sh_type != 8:
+                self.sections.append((addr, offset, size))
+
+    def string_at(self, addr):
+        for base, offset, size in self.sections:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.data.index(b"\0", start, offset + size)
+                return self.data[start:end].decode("latin-1")
+        return None
+
+
+def signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+# %d %u %x %c %%, as trace_format() renders them
+def format_message(fmt, args):
+    out = []
+    arg = 0
+    i = 0
+    while i < len(fmt):
+        c = fmt[i]
+        if c != "%" or i + 1 == len(fmt):
+            out.append(c)
+            i += 1
+            continue
+        conv = fmt[i + 1]
+        i += 2
+        if conv == "%":
+            out.append("%")
+            continue
+        value = args[arg] if arg < len(args) else 0
+        arg += 1
+        if conv == "d":
+            out.append(str(signed32(value)))
+        elif conv == "u":
+            out.append(str(value))
+        elif conv == "x":
+            out.append(f"{value:08x}")
+        elif conv == "c":
+            out.append(chr(value & 0xFF))
+        else:
+            out.append("%" + conv)
+    return "".join(out)
+
+
+def decode_record(image, raw):
+    tsc, _seq, level, module, nargs, _pad, fmt_addr = struct.unpack_from("<QIBBBBI", raw)
+    args = struct.unpack_from(f"<{MAX_ARGS}I", raw, 20)[:nargs]
+    fmt = image.string_at(fmt_addr)
+    if fmt is None:
+        message = f"<format at {fmt_addr:08x} not in image> " + " ".join(f"{a:08x}" for a in args)
+    else:
+        message = format_message(fmt, args)
+    level_name = LEVELS[level] if level < len(LEVELS) else "?   "
+    module_name = MODULES[module] if module < len(MODULES) else "?"
+    return f"{tsc:016x} {level_name} {module_name}: {message}"
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit(f"usage: {sys.argv[0]} <toyos.elf> [serial capture, default stdin]")
+    image = KernelImage(sys.argv[1])
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "rb") as f:
+            capture = f.read()
+    else:
+        capture = sys.stdin.buffer.read()
+
+    dumps = 0
+    pos = 0
+    while True:
+        match = BEGIN.search(capture, pos)
+        if match is None:
+            break
+        count = int(match.group(1))
+        start = match.end()
+        end = start + count * WIRE_SIZE
+        if capture[end:end + len(END)] != END:
+            sys.exit(f"dump at byte {match.start()} is truncated or garbled "
+                     "(capture with -serial file:, a terminal rewrites newlines)")
+        print("--- trace begin ---")
+        for offset in range(start, end, WIRE_SIZE):
+            print(decode_record(image, capture[offset:offset + WIRE_SIZE]))
+        print("--- trace end ---")
+        dumps += 1
+        pos = end + len(END)
+
+    if dumps == 0:
+        sys.exit("no trace dump found")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,13 @@
+#include "ulib.h"
+
+static volatile char bss_page[4096];
+
+int main(void) {
+    print("Hello from ring 3, pid ");
+    print_dec((uint32_t)getpid());
+    print("\n");
+
+    /* Touches a .bss page, which is only mapped now */
+    bss_page[0] = 1;
+    return bss_page[0] == 1 ? 0 : 1;
+}
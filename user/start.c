@@ -0,0 +1,12 @@
+#include "ulib.h"
+
+int main(void);
+
+/* The kernel enters here with the stack 16 bytes below the top of the
+   user window; realign in case main uses SSE */
+__attribute__((section(".text.start"), noreturn, force_align_arg_pointer))
+void _start(void) {
+    exit(main());
+    for (;;) {
+    }
+}
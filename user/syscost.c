@@ -0,0 +1,28 @@
+#include "ulib.h"
+
+#define ROUNDS 10000
+
+/* Round trip of the cheapest system call from ring 3: int 0x80, the
+   GS reload, dispatch and iret */
+int main(void) {
+    uint32_t best = 0xFFFFFFFF;
+    uint32_t total = 0;
+
+    getpid();
+    for (uint32_t i = 0; i < ROUNDS; i++) {
+        uint64_t start = urdtsc();
+        getpid();
+        uint32_t cycles = (uint32_t)(urdtsc() - start);
+        total += cycles;
+        if (cycles < best) best = cycles;
+    }
+
+    print("getpid round trip: min ");
+    print_dec(best);
+    print(" cycles, avg ");
+    print_dec(total / ROUNDS);
+    print(" cycles over ");
+    print_dec(ROUNDS);
+    print(" calls\n");
+    return 0;
+}
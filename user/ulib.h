@@ -0,0 +1,37 @@
+#ifndef ULIB_H
+#define ULIB_H
+
+#include <stdint.h>
+#include "syscall_wrapper.h"
+
+/* Helpers for the programs in user/; each one is a single file linked
+   with start.c and nothing else */
+
+static inline uint32_t ulen(const char* s) {
+    uint32_t len = 0;
+    while (s[len]) len++;
+    return len;
+}
+
+static inline void print(const char* s) {
+    write(1, s, ulen(s));
+}
+
+static inline void print_dec(uint32_t value) {
+    char buf[12];
+    int i = 11;
+    buf[i] = '\0';
+    do {
+        buf[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value && i > 0);
+    print(&buf[i]);
+}
+
+static inline uint64_t urdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif